@@ -6,13 +6,33 @@
 *          2 - AI main function : they have to return the choosen direction to go.
 */
 
+#include <stdio.h>      //for 'printf()'
 #include <stdlib.h>     //for 'rand()'
 #include <stdbool.h>
 #include <math.h>
 #include "types.h"
+#include "trace.h"
+#include "grid.h"
 
 #include "AI.h"
 
+// Engine ==============================================================
+//Every function reading the field is written once, for any view of it (see
+//'grid.h'), and the functions of 'AI.h' read it through a 'runtime_grid'.
+template<class G> static int detect_on(G g, snake* s, direction c);
+template<class G> static int rec_on(G g, coord c, coord* tableau, int* i);
+template<class G> static direction best_aggro_on(G g, float a, float b, float c, float d, snake* s);
+template<class G> static direction best_def_on(G g, float a, float b, float c, float d, snake* s);
+template<class G> static direction rngesus2_on(G g, snake* s);
+template<class G> static direction spread_on(G g, snake* s);
+template<class G> static direction aggro_dist_on(G g, snake* s, snake* enemy);
+template<class G> static direction defensif_dist_on(G g, snake* s, snake* enemy);
+template<class G> static direction heat_map_on(G g, snake* s);
+template<class G> static direction food_seeker_on(G g, snake* s);
+template<class G> static direction ai_play_on(G g, int version, snake* s, snake* enemy);
+
+static const char* ai_names[NB_AI_VERSIONS] = {"rngesus", "rngesus2", "spread", "aggro_dist", "defensif_dist", "heat_map", "food_seeker"};
+
 
 // Helpers =============================================================
 /**
@@ -20,20 +40,27 @@
 * \brief function that returns 1 if the 's' snake can go in the
 *        'c' direction without dying.
 */
-int detect(snake* s, direction c, field* map){
+template<class G>
+static int detect_on(G g, snake* s, direction c){
     coord start = s->body.front();
     int a=start.x;
     int b=start.y;
+    square q;
     if (c == UP) {
-        return !(map->f[a-1][b] == WALL || map->f[a-1][b] == SNAKE || map->f[a-1][b] == SCHLANGA);
+        q = g.at(new_coord(a-1, b));
     } else if (c == LEFT) {
-        return !(map->f[a][b-1] == WALL || map->f[a][b-1] == SNAKE || map->f[a][b-1] == SCHLANGA);
+        q = g.at(new_coord(a, b-1));
     } else if (c == RIGHT) {
-        return !(map->f[a][b+1] == WALL || map->f[a][b+1] == SNAKE || map->f[a][b+1] == SCHLANGA);
+        q = g.at(new_coord(a, b+1));
     } else if (c == DOWN) {
-        return !(map->f[a+1][b] == WALL || map->f[a+1][b] == SNAKE || map->f[a+1][b] == SCHLANGA);
+        q = g.at(new_coord(a+1, b));
     }
     else{return 1;}
+    return !(q == WALL || q == SNAKE || q == SCHLANGA);
+}
+
+int detect(snake* s, direction c, field* map){
+    return detect_on(runtime_grid(map), s, c);
 }
 
 /**
@@ -57,28 +84,33 @@ bool not_in(coord c, coord* array, int size){
 * Return how many empty squares are free in a given space.
 * Marks every square already visited in the array "tableau".
 */
-int rec(field* map, coord c, coord* tableau, int* i){
+template<class G>
+static int rec_on(G g, coord c, coord* tableau, int* i){
     coord up=coord_after_dir(c,UP);
     coord down=coord_after_dir(c,DOWN);
     coord left=coord_after_dir(c,LEFT);
     coord right=coord_after_dir(c,RIGHT);
 
-    if (get_square_at(map,c) != EMPTY || !not_in(c,tableau,i[0]) || i[0]>20){
+    if (g.at(c) != EMPTY || !not_in(c,tableau,i[0]) || i[0]>SPREAD_MAX){
         return 0;
     }
     else{
         tableau[i[0]]=c;
         i[0]++;
 
-        int zz=rec(map,up,tableau,i);
-        int ze=rec(map,left,tableau,i);
-        int zr=rec(map,right,tableau,i);
-        int zt=rec(map,down,tableau,i);
+        int zz=rec_on(g,up,tableau,i);
+        int ze=rec_on(g,left,tableau,i);
+        int zr=rec_on(g,right,tableau,i);
+        int zt=rec_on(g,down,tableau,i);
         return (1+zz+ze+zr+zt);
     }
     return 0;
 }
 
+int rec(field* map, coord c, coord* tableau, int* i){
+    return rec_on(runtime_grid(map), c, tableau, i);
+}
+
 /**
 * \fn float dist(coord depart, coord arrivee);
 * \brief Return the euclidian distance between 2 points.
@@ -109,24 +141,29 @@ bool compare_aggro(float a, float b){
 * \brief Base of the aggro_dist AI.
 * Returns the best choice between the different distances for an aggressiv AI (therefore the shortest).
 */
-direction best_aggro(float a, float b, float c, float d, snake* s, field* map){
-    if ((compare_aggro(c,a)) && (compare_aggro(c,b)) && (compare_aggro(c,d)) && detect(s,LEFT,map)){
+template<class G>
+static direction best_aggro_on(G g, float a, float b, float c, float d, snake* s){
+    if ((compare_aggro(c,a)) && (compare_aggro(c,b)) && (compare_aggro(c,d)) && detect_on(g,s,LEFT)){
         return LEFT;
     }
-    else if ((compare_aggro(b,a)) && (compare_aggro(b,c)) && (compare_aggro(b,d)) && detect(s,DOWN,map)){
+    else if ((compare_aggro(b,a)) && (compare_aggro(b,c)) && (compare_aggro(b,d)) && detect_on(g,s,DOWN)){
         return DOWN;
     }
-    else if ((compare_aggro(a,b)) && (compare_aggro(a,c)) && (compare_aggro(a,d)) && detect(s,UP,map)){
+    else if ((compare_aggro(a,b)) && (compare_aggro(a,c)) && (compare_aggro(a,d)) && detect_on(g,s,UP)){
         return UP;
     }
-    else if ((compare_aggro(d,a)) && (compare_aggro(d,b)) && (compare_aggro(d,c)) && detect(s,RIGHT,map)){
+    else if ((compare_aggro(d,a)) && (compare_aggro(d,b)) && (compare_aggro(d,c)) && detect_on(g,s,RIGHT)){
         return RIGHT;
     }
     else{
-        return spread(s,map);
+        return spread_on(g,s);
     }
 }
 
+direction best_aggro(float a, float b, float c, float d, snake* s, field* map){
+    return best_aggro_on(runtime_grid(map), a, b, c, d, s);
+}
+
 /**
 * \fn compare_def(float a, float b);
 * \brief Used in best_def.
@@ -149,24 +186,29 @@ bool compare_def(float a, float b){
 * \brief Base of the defensif_dist AI.
 * Returns the best choice between the different distances for a defensiv AI (therefore the longest).
 */
-direction best_def(float a, float b, float c, float d, snake* s, field* map){
-    if ((compare_def(c,a)) && (compare_def(c,b)) && (compare_def(c,d)) && detect(s,LEFT,map)){
+template<class G>
+static direction best_def_on(G g, float a, float b, float c, float d, snake* s){
+    if ((compare_def(c,a)) && (compare_def(c,b)) && (compare_def(c,d)) && detect_on(g,s,LEFT)){
         return LEFT;
     }
-    else if ((compare_def(b,a)) && (compare_def(b,c)) && (compare_def(b,d)) && detect(s,DOWN,map)){
+    else if ((compare_def(b,a)) && (compare_def(b,c)) && (compare_def(b,d)) && detect_on(g,s,DOWN)){
         return DOWN;
     }
-    else if ((compare_def(a,b)) && (compare_def(a,c)) && (compare_def(a,d)) && detect(s,UP,map)){
+    else if ((compare_def(a,b)) && (compare_def(a,c)) && (compare_def(a,d)) && detect_on(g,s,UP)){
         return UP;
     }
-    else if ((compare_def(d,a)) && (compare_def(d,b)) && (compare_def(d,c)) && detect(s,RIGHT,map)){
+    else if ((compare_def(d,a)) && (compare_def(d,b)) && (compare_def(d,c)) && detect_on(g,s,RIGHT)){
         return RIGHT;
     }
     else{
-        return spread(s,map);
+        return spread_on(g,s);
     }
 }
 
+direction best_def(float a, float b, float c, float d, snake* s, field* map){
+    return best_def_on(runtime_grid(map), a, b, c, d, s);
+}
+
 // AI main functions ===================================================
 /**
 * \fn dir rngesus(snake* s);
@@ -194,29 +236,35 @@ direction rngesus(snake* s){
 * \brief chooses a direction to move randomly. With wall and snake
 *        avoiding mechanism.
 */
-direction rngesus2(snake* s, field* map){
+template<class G>
+static direction rngesus2_on(G g, snake* s){
     direction dir;
     int pick_counter = 0;
 
     do{
         dir = direction(rand() % 4);
         pick_counter++;
-    }while( (dir == opposite(s->dir) || !detect(s, dir, map))
+    }while( (dir == opposite(s->dir) || !detect_on(g, s, dir))
                 && pick_counter < IA_MAX_PICK);
 
     return dir;
 }
 
+direction rngesus2(snake* s, field* map){
+    return rngesus2_on(runtime_grid(map), s);
+}
+
 /**
 * \fn direction spread(snake* s,field* map);
 * \brief Chooses a direction considering how much space is left to move in.
 *        When the choice doesn't matter, rngesus2 will be used.
 */
-direction spread(snake* s,field* map){
-    coord tableft[(map->width)*(map->height)];
-    coord tabright[(map->width)*(map->height)];
-    coord tabup[(map->width)*(map->height)];
-    coord tabdown[(map->width)*(map->height)];
+template<class G>
+static direction spread_on(G g, snake* s){
+    coord tableft[SPREAD_MAX + 1];
+    coord tabright[SPREAD_MAX + 1];
+    coord tabup[SPREAD_MAX + 1];
+    coord tabdown[SPREAD_MAX + 1];
 
     coord start=s->body.front();
     coord u=coord_after_dir(start,UP);
@@ -227,13 +275,13 @@ direction spread(snake* s,field* map){
     int a1,a2,a3,a4;
     int i=0;
 
-    a1=rec(map,l,tableft,&i);i=0;
-    a2=rec(map,r,tabright,&i);i=0;
-    a3=rec(map,d,tabdown,&i);i=0;
-    a4=rec(map,u,tabup,&i);
+    a1=rec_on(g,l,tableft,&i);i=0;
+    a2=rec_on(g,r,tabright,&i);i=0;
+    a3=rec_on(g,d,tabdown,&i);i=0;
+    a4=rec_on(g,u,tabup,&i);
 
     if ( (a1==a2 && a1==a3) || (a2==a3 && a2==a4) || (a3==a4 && a3==a1) || (a4==a2 && a4==a1)){
-        return rngesus2(s,map);
+        return rngesus2_on(g,s);
     }
     else if (a1>=a2 && a1>=a3 && a1>=a4){
         return LEFT;
@@ -248,40 +296,49 @@ direction spread(snake* s,field* map){
         return UP;
     }
     else {
-        return rngesus2(s,map);
+        return rngesus2_on(g,s);
     }
 }
 
+direction spread(snake* s,field* map){
+    return spread_on(runtime_grid(map), s);
+}
+
 /**
 * \fn direction aggro_dist(snake* s, field* map, snake* enemy);
 * \brief Chooses a direction the closest to the enemy's head.
 * Avoids walls and reacts randomly once it is close enough.
 */
-direction aggro_dist(snake* s, field* map, snake* enemy){
+template<class G>
+static direction aggro_dist_on(G g, snake* s, snake* enemy){
     coord end = get_head_coord(enemy);
     float a=0,b=0,c=0,d=0;
     coord start = get_head_coord(s);
 
     if (dist(start,end) < 6){
-        spread(s,map);
+        spread_on(g,s);
     }
 
     else{ 
-        if (detect(s,UP,map)){
+        if (detect_on(g,s,UP)){
             a=dist(coord_after_dir(start,UP),end);
         }
-        if (detect(s,DOWN,map)){
+        if (detect_on(g,s,DOWN)){
             b=dist(coord_after_dir(start,DOWN),end);
         }
-        if (detect(s,LEFT,map)){
+        if (detect_on(g,s,LEFT)){
             c=dist(coord_after_dir(start,LEFT),end);
         }
-        if (detect(s,RIGHT,map)){
+        if (detect_on(g,s,RIGHT)){
             d=dist(coord_after_dir(start,RIGHT),end);
         }
-        return best_aggro(a,b,c,d,s,map);
+        return best_aggro_on(g,a,b,c,d,s);
     }
-    return spread(s,map);
+    return spread_on(g,s);
+}
+
+direction aggro_dist(snake* s, field* map, snake* enemy){
+    return aggro_dist_on(runtime_grid(map), s, enemy);
 }
 
 /**
@@ -289,41 +346,53 @@ direction aggro_dist(snake* s, field* map, snake* enemy){
 * \brief Chooses a direction the further from the enemy's head.
 * Avoids walls and reacts randomly once it is far enough.
 */
-direction defensif_dist(snake* s, field* map, snake* enemy){
+template<class G>
+static direction defensif_dist_on(G g, snake* s, snake* enemy){
     coord end = get_head_coord(enemy);
     float a=0,b=0,c=0,d=0;
     coord start = get_head_coord(s);
 
-    if (dist(start,end) > 0.5*map->height){
-        spread(s,map);
+    if (dist(start,end) > 0.5*g.height()){
+        spread_on(g,s);
     }
 
     else{
-        if (detect(s,UP,map)){
+        if (detect_on(g,s,UP)){
             a=dist(coord_after_dir(start,UP),end);
         }
-        if (detect(s,DOWN,map)){
+        if (detect_on(g,s,DOWN)){
             b=dist(coord_after_dir(start,DOWN),end);
         }
-        if (detect(s,LEFT,map)){
+        if (detect_on(g,s,LEFT)){
             c=dist(coord_after_dir(start,LEFT),end);
         }
-        if (detect(s,RIGHT,map)){
+        if (detect_on(g,s,RIGHT)){
             d=dist(coord_after_dir(start,RIGHT),end);
         }
-        return best_def(a,b,c,d,s,map);
+        return best_def_on(g,a,b,c,d,s);
     }
-    return spread(s,map);
+    return spread_on(g,s);
+}
+
+direction defensif_dist(snake* s, field* map, snake* enemy){
+    return defensif_dist_on(runtime_grid(map), s, enemy);
 }
 
 /**
 * \fn direction heat_map(snake* s, field* map);
 * \brief AI based on a map heat of the field.
 * Is attracted by the object that will put the enemy in a bad spot and/or the enemy
+* \details Heat spreads by one square every pass, so only the squares up to
+*          HEAT_RADIUS from the head can change the heat next to it : the map is
+*          only made of them. Squares out of the field are walls.
+*          Whether a square gets warmed is known before the passes, which then
+*          only read the window.
 */
-direction heat_map(snake* s, field* map){
-    float** heat;
-    float** tampon;
+template<class G>
+static direction heat_map_on(G g, snake* s){
+    float heat[HEAT_SIDE][HEAT_SIDE];
+    float tampon[HEAT_SIDE][HEAT_SIDE];
+    bool warmed[HEAT_SIDE][HEAT_SIDE];     //empty squares of the field, out of the border of the window
     coord c;
     square q;
     int i,j,k;
@@ -333,100 +402,193 @@ direction heat_map(snake* s, field* map){
     coord d=coord_after_dir(start,DOWN);
     coord l=coord_after_dir(start,LEFT);
     coord r=coord_after_dir(start,RIGHT);
+    int x0=start.x-HEAT_RADIUS;    //'heat[j][k]' is the heat of the square (x0+j, y0+k)
+    int y0=start.y-HEAT_RADIUS;
 
     int a1,a2,a3,a4;
 
-    heat = (float**)malloc(map->height*sizeof(float*));
-    tampon = (float**)malloc(map->height*sizeof(float*));
-    for(j=0;j<map->height;j++){
-        heat[j] = (float*)malloc(map->width*sizeof(float));
-        tampon[j] = (float*)malloc(map->width*sizeof(float));
-    }
-
-    for(j=0;j<map->height;j++){
-        for(k=0;k<map->width;k++){
-            c=new_coord(j,k);
-            q=get_square_at(map,c);
+    for(j=0;j<HEAT_SIDE;j++){
+        for(k=0;k<HEAT_SIDE;k++){
+            c=new_coord(x0+j,y0+k);
+            q=g.at(c);
             switch(q){
             case WALL:
                 heat[j][k]=-3;
-                tampon[j][k]=-3;
                 break;
             case SCHLANGA:
                 heat[j][k]=-1;
-                tampon[j][k]=-1;
                 break;
             case SNAKE:
                 heat[j][k]=+5;
-                tampon[j][k]=+5;
                 break;
             case FOOD:
                 heat[j][k]=+2;
-                tampon[j][k]=+2;
                 break;
             case POPWALL:
                 heat[j][k]=+3;
-                tampon[j][k]=+3;
                 break;
             case HIGHSPEED:
                 heat[j][k]=+4;
-                tampon[j][k]=+4;
                 break;
             case LOWSPEED:
                 heat[j][k]=-1;
-                tampon[j][k]=-1;
                 break;
             case FREEZE:
                 heat[j][k]=+1;
-                tampon[j][k]=+1;
                 break;
             case EMPTY:
                 heat[j][k]=0;
-                tampon[j][k]=0;
                 break;
             }
+            tampon[j][k]=heat[j][k];
+            warmed[j][k]=(q == EMPTY && j>0 && j<(HEAT_SIDE-1) && k>0 && k<(HEAT_SIDE-1)
+                            && x0+j>=1 && x0+j<=g.height()-2 && y0+k>=1 && y0+k<=g.width()-2);
         }
     }
 
+    //the squares on the border of the window are not warmed : what they miss
+    //reaches one square further every pass, never the squares next to the head
     for(i=0;i<5;i++){
-        for(j=1;j<(map->height-1);j++){
-            for(k=1;k<(map->width-1);k++){
-                c=new_coord(j,k);
-                if (get_square_at(map,c) == EMPTY){
+        for(j=1;j<(HEAT_SIDE-1);j++){
+            for(k=1;k<(HEAT_SIDE-1);k++){
+                if (warmed[j][k]){
                     tampon[j][k]=(heat[j-1][k-1]+heat[j-1][k]+heat[j-1][k+1]+heat[j][k-1]+heat[j][k]+heat[j][k+1]+heat[j+1][k-1]+heat[j+1][k]+heat[j+1][k+1])/9;
                 }
             }
         }
-        for(j=1;j<map->height;j++){
-            for(k=1;k<map->width;k++){
+        for(j=0;j<HEAT_SIDE;j++){
+            for(k=0;k<HEAT_SIDE;k++){
                 heat[j][k]=tampon[j][k];
             }
         }
     }
 
-    a1=heat[u.x][u.y];
-    a2=heat[d.x][d.y];
-    a3=heat[l.x][l.y];
-    a4=heat[r.x][r.y];
-
-    for(j=0;j<map->height;j++){
-        free(heat[j]);
-        free(tampon[j]);
-    }
+    a1=heat[u.x-x0][u.y-y0];
+    a2=heat[d.x-x0][d.y-y0];
+    a3=heat[l.x-x0][l.y-y0];
+    a4=heat[r.x-x0][r.y-y0];
 
-    free(heat); free(tampon);
-
-    if( (a1>a2) && (a1>a3) && (a1>a4) && detect(s,UP,map) ){
+    if( (a1>a2) && (a1>a3) && (a1>a4) && detect_on(g,s,UP) ){
         return UP;
     }
-    else if ( (a2>a1) && (a2>a3) && (a2>a4) && detect(s,DOWN,map)){
+    else if ( (a2>a1) && (a2>a3) && (a2>a4) && detect_on(g,s,DOWN)){
         return DOWN;
     }
-    else if ( (a3>a2) && (a3>a1) && (a1>a4) && detect(s,LEFT,map)){
+    else if ( (a3>a2) && (a3>a1) && (a1>a4) && detect_on(g,s,LEFT)){
         return LEFT;
     }
-    else if ( (a4>a2) && (a4>a1) && (a4>a3) && detect(s,RIGHT,map)){
+    else if ( (a4>a2) && (a4>a1) && (a4>a3) && detect_on(g,s,RIGHT)){
         return RIGHT;
     }
-    return spread(s,map);
-}
\ No newline at end of file
+    return spread_on(g,s);
+}
+
+direction heat_map(snake* s, field* map){
+    return heat_map_on(runtime_grid(map), s);
+}
+
+/**
+* \fn direction food_seeker(snake* s, field* map);
+* \brief AI going for the nearest food it can get closer to.
+* \details The foods are asked to the index of the items of the field : the
+*          field is not scanned. Only the squares next to the head are read.
+*          With no food to go to, spread is used.
+*/
+template<class G>
+static direction food_seeker_on(G g, snake* s){
+    static const direction dirs[4] = {UP, DOWN, LEFT, RIGHT};
+    coord food[FOOD_CANDIDATES];
+    coord head = get_head_coord(s);
+    int n = items_nearest(g.items, FOOD, head, FOOD_CANDIDATES, food);
+    int i, k;
+
+    for(i=0;i<n;i++){
+        int best = -1;
+        float best_dist = dist(head, food[i]);
+        for(k=0;k<4;k++){
+            coord c = coord_after_dir(head, dirs[k]);
+            square q = g.at(c);
+            if (dirs[k] == opposite(s->dir) || q == WALL || q == SNAKE || q == SCHLANGA){
+                continue;
+            }
+            if (dist(c, food[i]) < best_dist){
+                best_dist = dist(c, food[i]);
+                best = k;
+            }
+        }
+        if (best != -1){
+            return dirs[best];
+        }
+    }
+    return spread_on(g,s);
+}
+
+direction food_seeker(snake* s, field* map){
+    return food_seeker_on(runtime_grid(map), s);
+}
+
+/**
+* \fn direction ai_play(int version, snake* s, field* map, snake* enemy);
+* \brief Asks the AI of the given 'version' (between 1 and NB_AI_VERSIONS) which direction 's' should take.
+* \param enemy the snake that aggressive and defensive AIs chase or flee.
+*/
+template<class G>
+static direction ai_play_on(G g, int version, snake* s, snake* enemy){
+    direction d;
+
+    TRACE_BEGIN(start);
+    switch(version){
+        case 1:
+            d = rngesus(s);
+            break;
+        case 2:
+            d = rngesus2_on(g, s);
+            break;
+        case 3:
+            d = spread_on(g, s);
+            break;
+        case 4:
+            d = aggro_dist_on(g, s, enemy);
+            break;
+        case 5:
+            d = defensif_dist_on(g, s, enemy);
+            break;
+        case 6:
+            d = heat_map_on(g, s);
+            break;
+        case 7:
+            d = food_seeker_on(g, s);
+            break;
+        default:
+            printf("In 'ai_play()' : AI_version not recognized.\n");
+            exit(1);
+    }
+    TRACE_END(start, ai_names[version - 1], "ai");
+    return d;
+}
+
+direction ai_play(int version, snake* s, field* map, snake* enemy){
+    return ai_play_on(runtime_grid(map), version, s, enemy);
+}
+
+/**
+* \fn direction ai_play_fixed(int version, snake* s, field* map, snake* enemy);
+* \brief 'ai_play()' for a field whose arena is W x H.
+*/
+template<int W, int H>
+static direction ai_play_fixed(int version, snake* s, field* map, snake* enemy){
+    return ai_play_on(fixed_grid<W, H>(map), version, s, enemy);
+}
+
+/**
+* \fn ai_play_fn ai_engine(int width, int height);
+* \brief Chooses how the AI of a game of the given size reads its field.
+* \returns a version of 'ai_play()' compiled for that size if there is one,
+*          'ai_play()' otherwise.
+*/
+ai_play_fn ai_engine(int width, int height){
+    if(width == AI_FIXED_WIDTH && height == AI_FIXED_HEIGHT){
+        return ai_play_fixed<AI_FIXED_WIDTH, AI_FIXED_HEIGHT>;
+    }
+    return ai_play;
+}
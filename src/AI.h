@@ -9,6 +9,20 @@
 #define IA_MAX_PICK 20 /**< maximum times that the IA tries
                             picking a random direction before giving up.
                             Used to avoid infinite picking.*/
+#define NB_AI_VERSIONS 7 /**< AI versions go from 1 to NB_AI_VERSIONS */
+#define SPREAD_MAX 20    /**< 'rec()' stops counting free squares past this number */
+#define HEAT_RADIUS 6    /**< squares 'heat_map()' looks at around the head : its 5 passes, and the squares next to the head */
+#define HEAT_SIDE (2*HEAT_RADIUS + 1)
+#define FOOD_CANDIDATES 4   /**< foods 'food_seeker()' considers, the nearest first */
+#define AI_FIXED_WIDTH 60   /**< size of the arena 'ai_engine()' has a compiled version of 'ai_play()' for */
+#define AI_FIXED_HEIGHT 25
+
+// STRUCTURES ==========================================================
+/**
+* \typedef ai_play_fn
+* \brief A version of 'ai_play()', see 'ai_engine()'.
+*/
+typedef direction (*ai_play_fn)(int version, snake* s, field* map, snake* enemy);
 
 // PROTOTYPES ==========================================================
 // Helpers =============================================================
@@ -28,5 +42,8 @@ direction spread(snake* s,field* map);
 direction aggro_dist(snake* s, field* map, snake* enemy);
 direction defensif_dist(snake* s, field* map, snake* enemy);
 direction heat_map(snake* s, field* map);
+direction food_seeker(snake* s, field* map);
+direction ai_play(int version, snake* s, field* map, snake* enemy);
+ai_play_fn ai_engine(int width, int height);
 
 #endif
@@ -0,0 +1,170 @@
+/**
+* \file ai_pool.cpp
+* \brief Takes the AI decisions of a tick on several threads.
+*/
+
+#include <stdio.h>          //for 'printf()'
+#include <stdlib.h>         //for 'exit()'
+
+#include "types.h"
+#include "AI.h"
+#include "trace.h"
+
+#include "ai_pool.h"
+
+using namespace std;
+
+/**
+* \fn int claim_jobs(ai_batch* b);
+* \brief Takes the decisions of 'b' nobody claimed yet, one at a time, until there are none left.
+* \returns the number of decisions taken
+*/
+static int claim_jobs(ai_batch* b){
+    int nb = 0;
+    int i;
+
+    while((i = b->next.fetch_add(1, memory_order_relaxed)) < b->nb_jobs){
+        ai_job* j = &b->jobs[i];
+        j->dir = j->play(j->version, j->s, j->map, j->enemy);
+        nb++;
+    }
+    return nb;
+}
+
+/**
+* \fn void unlink_batch(ai_pool* p, ai_batch* b);
+* \brief Removes 'b' from the batches waiting for the pool, if it still is one. Called with the lock held.
+*/
+static void unlink_batch(ai_pool* p, ai_batch* b){
+    ai_batch** cur;
+    for(cur = &p->batches; *cur != NULL; cur = &(*cur)->next_batch){
+        if(*cur == b){
+            *cur = b->next_batch;
+            return;
+        }
+    }
+}
+
+/**
+* \fn void* run_ai_thread(void* p_p);
+* \brief Main loop of a thread of the pool : helps with a batch that has jobs left.
+*/
+static void* run_ai_thread(void* p_p){
+    ai_pool* p = (ai_pool*)p_p;
+    char name[32];
+
+    pthread_mutex_lock(&p->lock);
+    snprintf(name, sizeof(name), "ai %i", p->nb_started++);
+    pthread_mutex_unlock(&p->lock);
+    trace_thread_name(name);
+
+    pthread_mutex_lock(&p->lock);
+    while(p->running){
+        if(p->batches == NULL){
+            pthread_cond_wait(&p->work, &p->lock);
+            continue;
+        }
+        ai_batch* b = p->batches;
+        b->helpers++;
+        pthread_mutex_unlock(&p->lock);
+
+        int nb = claim_jobs(b);
+        p->nb_jobs.fetch_add(nb, memory_order_relaxed);
+
+        pthread_mutex_lock(&p->lock);
+        unlink_batch(p, b);     //every job is claimed
+        b->helpers--;
+        if(b->helpers == 0) pthread_cond_broadcast(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+* \fn ai_pool* new_ai_pool(int nb_threads);
+* \brief Creates a pool and launches its 'nb_threads' threads.
+* \param nb_threads 0 makes every caller take its decisions alone
+* \returns a pointer to the newly created 'ai_pool'
+*/
+ai_pool* new_ai_pool(int nb_threads){
+    ai_pool* p = new ai_pool;
+    int i;
+
+    p->nb_threads = nb_threads;
+    p->nb_started = 0;
+    p->batches = NULL;
+    p->nb_jobs = 0;
+    p->running = true;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    p->threads = new pthread_t[nb_threads];
+    for(i = 0; i < nb_threads; i++){
+        if(pthread_create(&p->threads[i], 0, run_ai_thread, p) != 0){
+            printf("error : could not create thread %i of the AI pool\n", i);
+            exit(1);
+        }
+    }
+    return p;
+}
+
+/**
+* \fn void free_ai_pool(ai_pool* p);
+* \brief Stops the threads of the pool and frees it. Nobody may be running a batch.
+*/
+void free_ai_pool(ai_pool* p){
+    int i;
+
+    pthread_mutex_lock(&p->lock);
+    p->running = false;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for(i = 0; i < p->nb_threads; i++){
+        pthread_join(p->threads[i], NULL);
+    }
+    delete[] p->threads;
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    delete p;
+}
+
+/**
+* \fn void ai_pool_run(ai_pool* p, ai_job* jobs, int nb_jobs);
+* \brief Takes every decision of 'jobs', with the help of the threads of 'p'.
+* \details The caller takes decisions too, so a busy pool only slows it down to
+*          the pace it would have alone. Returns once every decision is taken.
+*          Can be called by several threads at once.
+* \param p pool to help, NULL to take the decisions alone
+*/
+void ai_pool_run(ai_pool* p, ai_job* jobs, int nb_jobs){
+    ai_batch b;
+
+    b.jobs = jobs;
+    b.nb_jobs = nb_jobs;
+    b.next = 0;
+    b.helpers = 0;
+    if(p == NULL || p->nb_threads == 0 || nb_jobs < AI_POOL_MIN_JOBS){
+        claim_jobs(&b);
+        return;
+    }
+
+    //1 - let's hand the batch to the pool
+    pthread_mutex_lock(&p->lock);
+    b.next_batch = p->batches;
+    p->batches = &b;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    //2 - let's help
+    claim_jobs(&b);
+
+    //3 - let's wait for the jobs claimed by the pool
+    pthread_mutex_lock(&p->lock);
+    unlink_batch(p, &b);
+    while(b.helpers > 0){
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
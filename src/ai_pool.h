@@ -0,0 +1,72 @@
+/**
+* \file ai_pool.h
+* \brief Threads sharing the AI decisions of the ticks of every room.
+* \details A worker hands the pool every decision of a tick at once, and takes
+*          part in them while it waits. Decisions only read the field and the
+*          snakes, which do not change until the worker moves the snakes : they
+*          are computed against the same state, whatever their order.
+*/
+
+#ifndef H_AI_POOL
+#define H_AI_POOL
+
+#include <pthread.h>
+#include <atomic>
+
+#include "types.h"
+#include "AI.h"
+
+// CONSTANTS ============================================================
+#define AI_POOL_MIN_JOBS 2  /**< below this number of decisions, the caller takes them alone */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef ai_job
+* \brief A decision to take : the direction snake 's' will take on 'map'.
+*/
+struct ai_job {
+    ai_play_fn play;    /**< 'ai_play()', or a version of it compiled for the size of 'map' */
+    int version;        /**< version of the AI deciding, see 'ai_play()' */
+    int id;             /**< id of the snake, for the caller */
+    snake* s;
+    field* map;
+    snake* enemy;       /**< snake 's' is after, or runs from */
+    direction dir;      /**< the decision, once the job is done */
+};
+
+/**
+* \typedef ai_batch
+* \brief Decisions given to the pool by one call to 'ai_pool_run()'.
+* \details Jobs are claimed one at a time through 'next'. The batch lives on the
+*          stack of its caller, which waits until no thread of the pool uses it.
+*/
+struct ai_batch {
+    ai_job* jobs;
+    int nb_jobs;
+    std::atomic<int> next;      /**< first job nobody claimed yet */
+    int helpers;                /**< threads of the pool working on the batch, protected by the pool's lock */
+    ai_batch* next_batch;       /**< next batch waiting for the pool */
+};
+
+/**
+* \typedef ai_pool
+* \brief Threads taking AI decisions for whoever asks them.
+*/
+struct ai_pool {
+    pthread_t* threads;
+    int nb_threads;
+    int nb_started;             /**< threads that got their id */
+    pthread_mutex_t lock;       /**< protects 'batches', 'nb_started' and the helpers of every batch */
+    pthread_cond_t work;        /**< signaled when a batch is added, or the pool stops */
+    pthread_cond_t done;        /**< signaled when a thread of the pool leaves a batch */
+    ai_batch* batches;          /**< batches with jobs left to claim */
+    std::atomic<long> nb_jobs;  /**< decisions taken by the threads of the pool */
+    std::atomic<bool> running;  /**< cleared to stop the threads of the pool */
+};
+
+// PROTOTYPES ==========================================================
+ai_pool* new_ai_pool(int nb_threads);
+void free_ai_pool(ai_pool* p);
+void ai_pool_run(ai_pool* p, ai_job* jobs, int nb_jobs);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+* \file arena.cpp
+* \brief Memory of a game session, see 'arena.h'.
+*/
+
+#include <stdlib.h>     //for 'malloc()'
+#include <string.h>     //for 'memset()'
+
+#include "arena.h"
+
+/**
+* \fn size_t round_size(size_t size);
+* \returns 'size' rounded up to ARENA_ALIGN, at least ARENA_ALIGN
+*/
+static size_t round_size(size_t size){
+    if(size == 0) return ARENA_ALIGN;
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+* \fn char* block_data(arena_block* b);
+* \returns the first byte of the memory of 'b', aligned on ARENA_ALIGN
+*/
+static char* block_data(arena_block* b){
+    return (char*)b + round_size(sizeof(arena_block));
+}
+
+/**
+* \fn void use_block(session_arena* a, size_t size);
+* \brief Makes the arena hand out from a block with at least 'size' bytes : a
+*        spare one if it is big enough, a new one otherwise.
+*/
+static void use_block(session_arena* a, size_t size){
+    arena_block* b = NULL;
+    arena_block** link;
+
+    //1 - let's look for a spare block big enough
+    for(link = &a->spare; *link != NULL; link = &(*link)->next){
+        if((*link)->size >= size){
+            b = *link;
+            *link = b->next;
+            break;
+        }
+    }
+
+    //2 - let's ask the heap if there is none
+    if(b == NULL){
+        size_t data = (size > ARENA_BLOCK) ? size : ARENA_BLOCK;
+        b = (arena_block*)malloc(round_size(sizeof(arena_block)) + data);
+        if(b == NULL) throw std::bad_alloc();
+        b->size = data;
+    }
+
+    b->next = a->blocks;
+    a->blocks = b;
+    a->next = block_data(b);
+    a->end = a->next + b->size;
+}
+
+/**
+* \fn session_arena* new_session_arena();
+* \returns a new arena, holding nothing yet
+*/
+session_arena* new_session_arena(){
+    session_arena* a = (session_arena*)malloc(sizeof(session_arena));
+    memset(a, 0, sizeof(session_arena));
+    return a;
+}
+
+/**
+* \fn void free_session_arena(session_arena* a);
+* \brief Gives back to the heap 'a' and all its blocks. What was made in it must
+*        not be used anymore.
+*/
+void free_session_arena(session_arena* a){
+    arena_block* lists[2] = {a->blocks, a->spare};
+    int i;
+    for(i = 0; i < 2; i++){
+        while(lists[i] != NULL){
+            arena_block* next = lists[i]->next;
+            free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    free(a);
+}
+
+/**
+* \fn void arena_reset(session_arena* a);
+* \brief Forgets all that was made in 'a', without giving its blocks back to the
+*        heap : the next session uses them.
+*/
+void arena_reset(session_arena* a){
+    while(a->blocks != NULL){
+        arena_block* b = a->blocks;
+        a->blocks = b->next;
+        b->next = a->spare;
+        a->spare = b;
+    }
+    a->next = a->end = NULL;
+    memset(a->recycled, 0, sizeof(a->recycled));
+    a->used = 0;
+}
+
+/**
+* \fn void* arena_alloc(session_arena* a, size_t size);
+* \returns 'size' bytes of 'a', aligned on ARENA_ALIGN
+*/
+void* arena_alloc(session_arena* a, size_t size){
+    void* p;
+    size = round_size(size);
+    a->used += size;
+
+    //1 - let's take a piece given back, if one has this size
+    if(size <= ARENA_RECYCLED && a->recycled[size/ARENA_ALIGN - 1] != NULL){
+        p = a->recycled[size/ARENA_ALIGN - 1];
+        a->recycled[size/ARENA_ALIGN - 1] = *(void**)p;
+        return p;
+    }
+
+    //2 - let's cut it from the block in use
+    if(a->next == NULL || (size_t)(a->end - a->next) < size) use_block(a, size);
+    p = a->next;
+    a->next += size;
+    return p;
+}
+
+/**
+* \fn void arena_free(session_arena* a, void* p, size_t size);
+* \brief Gives back the 'size' bytes at 'p', for the next piece of this size.
+*        Bigger pieces than ARENA_RECYCLED stay lost until the arena is reset.
+*/
+void arena_free(session_arena* a, void* p, size_t size){
+    if(p == NULL) return;
+    size = round_size(size);
+    a->used -= size;
+    if(size > ARENA_RECYCLED) return;
+    *(void**)p = a->recycled[size/ARENA_ALIGN - 1];
+    a->recycled[size/ARENA_ALIGN - 1] = p;
+}
+
+/**
+* \fn void* arena_calloc(session_arena* a, size_t size);
+* \returns 'size' bytes set to 0, of 'a', or of the heap if 'a' is NULL : those
+*          are to be given back with 'free()'
+*/
+void* arena_calloc(session_arena* a, size_t size){
+    if(a == NULL) return calloc(1, size);
+    void* p = arena_alloc(a, size);
+    memset(p, 0, size);
+    return p;
+}
@@ -0,0 +1,90 @@
+/**
+* \file arena.h
+* \brief Memory of a game session, given back all at once when the game ends.
+* \details A session arena hands out memory from big blocks, one after the
+*          other. A piece given back with 'arena_free()' is kept for the next
+*          piece of the same size : containers that keep allocating and
+*          freeing the same sizes, like the body of a snake, stop asking the
+*          heap once they reached their size.
+*          Objects made in an arena are never freed one by one : they go with
+*          'arena_reset()', which keeps the blocks for the next session, or
+*          with 'free_session_arena()'.
+*/
+
+#ifndef H_ARENA
+#define H_ARENA
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+// CONSTANTS ============================================================
+#define ARENA_BLOCK (64*1024)       /**< size of the blocks of an arena, but for bigger pieces */
+#define ARENA_ALIGN 16              /**< every piece is aligned on this, and its size rounded up to it */
+#define ARENA_RECYCLED 8192         /**< pieces up to this size are kept for reuse when freed */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef arena_block
+* \brief A block of memory of an arena, followed by its 'size' bytes.
+*/
+struct arena_block {
+    arena_block* next;
+    size_t size;
+};
+
+/**
+* \typedef session_arena
+* \brief Memory of a game session, see the file.
+*/
+struct session_arena {
+    arena_block* blocks;        /**< every block, the one in use first */
+    arena_block* spare;         /**< blocks emptied by 'arena_reset()', to use again */
+    char* next;                 /**< first free byte of the block in use */
+    char* end;                  /**< end of the block in use */
+    void* recycled[ARENA_RECYCLED / ARENA_ALIGN];  /**< pieces given back, by size, chained through their first bytes */
+    size_t used;                /**< bytes handed out and not given back */
+};
+
+// PROTOTYPES ==========================================================
+session_arena* new_session_arena();
+void free_session_arena(session_arena* a);
+void arena_reset(session_arena* a);
+void* arena_alloc(session_arena* a, size_t size);
+void arena_free(session_arena* a, void* p, size_t size);
+void* arena_calloc(session_arena* a, size_t size);
+
+// Containers ==========================================================
+/**
+* \typedef arena_allocator
+* \brief Allocator putting a standard container in a session arena, or on the
+*        heap if it has none.
+* \details A container assigned another one takes its arena with its content.
+*/
+template<class T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    session_arena* arena;
+
+    arena_allocator(session_arena* a = NULL) : arena(a) {}
+    template<class U> arena_allocator(const arena_allocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n){
+        if(arena == NULL) return (T*)::operator new(n*sizeof(T));
+        return (T*)arena_alloc(arena, n*sizeof(T));
+    }
+    void deallocate(T* p, size_t n){
+        if(arena == NULL) ::operator delete(p);
+        else arena_free(arena, p, n*sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b){return a.arena == b.arena;}
+template<class T, class U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b){return a.arena != b.arena;}
+
+#endif
@@ -4,53 +4,140 @@
 #include <arpa/inet.h>  //for 'struct sockaddr_in'
 #include <stdlib.h>     //for 'exit()'
 #include <unistd.h>     //for 'read()'
-#include <pthread.h>
-#include <sys/time.h>
+#include <string.h>     //for 'memcpy()'
+#include <poll.h>       //for 'poll()'
+#include <time.h>       //for 'clock_gettime()'
+#include <getopt.h>     //for 'getopt()'
 
 #include "types.h"
+#include "stats.h"      //before game.h, whose 'clear' macro breaks <atomic>
+#include "trace.h"
 #include "game.h"
-#include "queue.h"
+#include "world.h"
+#include "net.h"
+#include "predict.h"
+#include "spectate.h"
+#include "metrics.h"
 
 //#define SERV_ADDR "192.168.0.38"
 #define SERV_ADDR "127.0.0.1"
 #define PORT 3490
-#define PING 10
+#define SPECTATE_PORT (PORT + 1)
+
+/**
+* \typedef client_phase
+* \brief Phases of an iteration of 'play_client()', timed by 'phases'.
+*/
+typedef enum {
+    CLIENT_PH_WAIT,     /**< waiting for a key, a frame or the next tick */
+    CLIENT_PH_INPUT,    /**< reading the keys */
+    CLIENT_PH_READ,     /**< reading a frame from the server */
+    CLIENT_PH_APPLY,    /**< applying it to the window, and reconciling the prediction */
+    CLIENT_PH_PREDICT,  /**< predicting a tick, and sending the turn to the server */
+    CLIENT_PH_RENDER,   /**< displaying the prediction */
+    NB_CLIENT_PHASES
+} client_phase;
+
+const char* client_phase_names[NB_CLIENT_PHASES] = {"wait", "input", "read", "apply", "predict", "render"};
 
 int sockfd;
+phase_timer phases;                 //time spent in each phase of 'play_client()'
+bool playing = false;               //true once 'phases' is used
+metrics_endpoint* endpoint = NULL;  //serves 'phases', if asked to
 
 int safe_quit(int return_value){
     mode_raw(0);
+    if(playing){
+        print_phase_timer(stdout, &phases);
+    }
+    if(endpoint != NULL){
+        free_metrics_endpoint(endpoint);
+    }
+    trace_stop();
     close(sockfd);
     exit(return_value);
 }
 
 /**
-* \fn int diff(struct timeval big_time, struct timeval small_time);
-* \returns The time in ms that separates 'big_time' from 'small_time'
+* \fn void write_client_metrics(FILE* f, void* arg);
+* \brief Writes the measures of the client on 'f', for 'new_metrics_endpoint()'.
 */
-int diff_time(struct timeval big_time, struct timeval small_time){
-    int sec = big_time.tv_sec - small_time.tv_sec;
-    int usec = big_time.tv_usec - small_time.tv_usec;
-    return sec * 1000 + usec / 1000;
+void write_client_metrics(FILE* f, void* arg){
+    (void)arg;
+    write_phase_metrics(f);
 }
 
-void free_all_client(field* map, snake** snakes, int size){
-    free_field(map);
-    int i;
-    for(i = 0; i<size; i++){
-        free_snake(snakes[i]);
+/**
+* \fn long now_ms();
+* \returns the time in ms given by the monotonic clock
+*/
+long now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/**
+* \fn void apply_frame(frame_header* hdr, cell_update* cells, client_window* w);
+* \brief Applies a frame received from the server to the window of the client, and displays it.
+* \details When the viewport moved, what is still in the window is kept and the
+*          whole viewport is drawn again. Updates outside of the window are ignored.
+*/
+void apply_frame(frame_header* hdr, cell_update* cells, client_window* w){
+    int win_width = w->view_width + 2*AOI_MARGIN;
+    int win_height = w->view_height + 2*AOI_MARGIN;
+    int i, x, y;
+
+    //1 - let's scroll if the viewport moved
+    if(!are_equal(w->origin, hdr->origin)){
+        int dx = hdr->origin.x - w->origin.x;
+        int dy = hdr->origin.y - w->origin.y;
+        square* old = (square*)malloc(win_width*win_height*sizeof(square));
+        memcpy(old, w->squares, win_width*win_height*sizeof(square));
+        for(x = 0; x < win_height; x++){
+            for(y = 0; y < win_width; y++){
+                bool kept = x + dx >= 0 && x + dx < win_height && y + dy >= 0 && y + dy < win_width;
+                w->squares[x*win_width + y] = kept ? old[(x + dx)*win_width + y + dy] : EMPTY;
+            }
+        }
+        free(old);
+        w->origin = hdr->origin;
+
+        clear();
+        for(x = 0; x < w->view_height; x++){
+            for(y = 0; y < w->view_width; y++){
+                print_square(new_coord(x, y), w->squares[(x + AOI_MARGIN)*win_width + y + AOI_MARGIN]);
+            }
+        }
+    }
+
+    //2 - let's apply the squares that changed
+    for(i = 0; i < hdr->nb_cells; i++){
+        x = cells[i].x - w->origin.x + AOI_MARGIN;
+        y = cells[i].y - w->origin.y + AOI_MARGIN;
+        if(x < 0 || x >= win_height || y < 0 || y >= win_width) continue;
+        w->squares[x*win_width + y] = (square)cells[i].content;
+        if(x >= AOI_MARGIN && x < w->view_height + AOI_MARGIN && y >= AOI_MARGIN && y < w->view_width + AOI_MARGIN){
+            print_square(new_coord(x - AOI_MARGIN, y - AOI_MARGIN), (square)cells[i].content);
+        }
     }
 }
 
-void play_client(config cfg, uint width, uint height) {
-    //time of the last step that occured. in ticks.
+/**
+* \fn void play_client(int view_width, int view_height);
+* \brief Plays online once the server sent the info about the game.
+* \details The client runs its own ticks, at the pace of the server's frames, and
+*          predicts the moves of its snake during them. This way, a turn shows
+*          up at the next tick instead of after a round trip to the server.
+*/
+void play_client(int view_width, int view_height) {
     int ok;               //signal we're waiting for before begining
     char c;               //key that is pressed
     int ret;              //value returned by 'read(0)', 0 if no new key was pressed
     int ret_serv;
-    myqueue p1_queue = new_queue(MAX_INPUT_STACK);    //queue used to stack player input
+    input_ring p1_queue;  //queue used to stack player input
     direction cur_dir;
-    direction* players_dir = new direction[cfg.nb_players];
+    init_ring(&p1_queue);
 
     //let's wait for server's signal
     ret_serv = read(sockfd, &ok, 1*sizeof(int));
@@ -71,38 +158,60 @@ void play_client(config cfg, uint width, uint height) {
     clear();
     mode_raw(1);
 
-    //creating field
-    field* map = new_field(width, height, cfg.timestep);
-
-    //creating snakes
+    //creating the window : what we know of the arena around our viewport
+    client_window w;
+    int win_size = (view_width + 2*AOI_MARGIN) * (view_height + 2*AOI_MARGIN);
     int i;
-    snake** snakes = (snake**)malloc(cfg.nb_players*sizeof(snake*));
-    for(i = 0; i < cfg.nb_players; i++){
-        if (i == 1) snakes[i] = new_snake(T_SCHLANGA, i, map);
-        else snakes[i] = new_snake(T_SNAKE, i, map);
+    w.squares = (square*)malloc(win_size*sizeof(square));
+    for(i = 0; i < win_size; i++){
+        w.squares[i] = EMPTY;
     }
+    w.origin = new_coord(0, 0);
+    w.view_width = view_width;
+    w.view_height = view_height;
+
+    prediction pred;
+    new_prediction(&pred);
+
+    frame_header hdr;
+    vector<cell_update> cells;
+    long last_frame = -1;   //when the last frame came. in ms.
+    long timestep = 0;      //time between two frames, as measured. in ms.
+    long next_tick = -1;    //when our next tick is due. in ms.
+    struct pollfd fds[2];
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = sockfd;
+    fds[1].events = POLLIN;
 
     fflush(stdout);
+    playing = true;
+    phase_start(&phases);
 
-    struct timeval last_step_time;
-    gettimeofday(&last_step_time, NULL);
-    struct timeval now;
-    int elapsed_time;       //elapsed time
     while(1){
         //SUMMARY
-        //1 - let's check if it's time to retrieve input
+        //1 - let's wait for a key, a frame or our next tick
         //2 - let's retrieve and sort every input
-        //3 - let's send the server our direction
-        //4 - let's wait for server's directions
-        //5 - let's make snakes move
-        //6 - let's update last_step_time
+        //3 - let's apply server's frame
+        //4 - let's predict our next tick, and tell the server if we turn
+        //5 - let's display our prediction
         //--------------------------------------
 
-        //1 - let's check if it's time to retrieve input
-        gettimeofday(&now, NULL);
-        elapsed_time = diff_time(now, last_step_time); //time elapsed since last round. in ms.
-        if(elapsed_time > cfg.timestep - PING){
-            //2 - let's retrieve and sort every input
+        //1 - let's wait for a key, a frame or our next tick
+        long timeout = -1;
+        if(next_tick != -1){
+            timeout = next_tick - now_ms();
+            if(timeout < 0) timeout = 0;
+        }
+        TRACE_BEGIN(wait_start);
+        if(poll(fds, 2, timeout) == -1){
+            perror("poll in 'play_client()'"); safe_quit(1);
+        }
+        TRACE_END(wait_start, "poll", "sleep");
+        phase_end(&phases, CLIENT_PH_WAIT);
+
+        //2 - let's retrieve and sort every input
+        if(fds[0].revents & POLLIN){
             while((ret = read(0, &c, sizeof(char))) != 0){
                 if(ret == -1){
                     perror("read in 'play()'"); safe_quit(1);
@@ -111,66 +220,191 @@ void play_client(config cfg, uint width, uint height) {
                 if(c == C_QUIT){
                     mode_raw(0);
                     clear();
-                    myfree_queue(&p1_queue);
-                    free_all_client(map, snakes, cfg.nb_players);
+                    printf("%i ticks were mispredicted.\n", pred.nb_rollbacks);
+                    print_phase_timer(stdout, &phases);
+                    playing = false;
+                    free(w.squares);
                     return;
                 }
                 else if(key_is_p1_dir(c)){
                     //if the key is a move key for player 1:
-                    if(! myqueue_full(&p1_queue)){
-                        myenqueue(&p1_queue, key_to_dir(c));
+                    if(ring_count(&p1_queue) < MAX_INPUT_STACK){
+                        ring_try_push(&p1_queue, key_to_dir(c));
                     }
                 }
                 else{
                     //key pressed was a useless key. Do nothing.
                 }
             }
+            phase_end(&phases, CLIENT_PH_INPUT);
+        }
 
-            //3 - let's send the server our direction
-            cur_dir = (! myqueue_empty(&p1_queue)) ? mydequeue(&p1_queue) : snakes[cfg.id]->dir;
-            cur_dir = (cur_dir == opposite(snakes[cfg.id]->dir)) ? snakes[cfg.id]->dir : cur_dir;
-            if(write(sockfd, &cur_dir, 1*sizeof(direction)) < 0){
-                perror("handle_server write"); safe_quit(1);
+        //3 - let's apply server's frame
+        bool tick_now = next_tick != -1 && now_ms() >= next_tick;
+        if(fds[1].revents & (POLLIN | POLLHUP)){
+            ret_serv = read_full(sockfd, &hdr, sizeof(frame_header));
+            if(ret_serv > 0 && hdr.nb_cells > 0){
+                cells.resize(hdr.nb_cells);
+                ret_serv = read_full(sockfd, cells.data(), hdr.nb_cells*sizeof(cell_update));
             }
-
-            //4 - let's wait for server's directions
-            ret_serv = read(sockfd, players_dir, cfg.nb_players*sizeof(direction));
             if(ret_serv == -1){
                 perror("handle_server read"); safe_quit(1);
             }
             else if(ret_serv == 0){
                 clear(); printf("Server closed connection.\n"); safe_quit(1);
             }
+            phase_end(&phases, CLIENT_PH_READ);
+
+            TRACE_BEGIN(apply_start);
+            long now = now_ms();
+            if(last_frame != -1){
+                timestep = (timestep == 0) ? now - last_frame : (7*timestep + now - last_frame) / 8;
+            }
+            last_frame = now;
+
+            apply_frame(&hdr, cells.data(), &w);
+            if(hdr.flags & FRAME_KEYFRAME){
+                //we may have missed frames : what we knew of our snake is outdated
+                forget_prediction(&pred);
+            }
+            reconcile(&pred, &w, &hdr);
 
-            //5 - let's make snakes move
-            for (i = 0; i < cfg.nb_players; i++)
-            {
-                if (players_dir[i] != 4) //if the player is not dead (dir = 4 => dead player)
-                {       
-                    move(snakes[i], players_dir[i], map);
+            if(pred.tick <= hdr.tick){
+                //we are not ahead of the server anymore
+                tick_now = true;
+                next_tick = now;
+            }
+            TRACE_END_ARG(apply_start, "frame", "tick", "tick", hdr.tick);
+            phase_end(&phases, CLIENT_PH_APPLY);
+        }
+
+        //4 - let's predict our next tick, and tell the server if we turn
+        if(tick_now && pred.auth_tick != -1 && pred.tick < pred.auth_tick + MAX_INPUT_LEAD){
+            if(! ring_try_pop(&p1_queue, &cur_dir)) cur_dir = pred.dir;
+            if(pred.dir != DEAD_DIR && cur_dir != pred.dir && cur_dir != opposite(pred.dir)){
+                input_msg in;
+                in.tick = pred.tick + 1;
+                in.dir = cur_dir;
+                if(write_full(sockfd, &in, sizeof(input_msg)) < 0){
+                    perror("handle_server write"); safe_quit(1);
                 }
             }
-            fflush(stdout);
+            TRACE_BEGIN(predict_start);
+            predict_step(&pred, &w, cur_dir);
+            TRACE_END_ARG(predict_start, "predict tick", "tick", "tick", pred.tick);
+            phase_end(&phases, CLIENT_PH_PREDICT);
+        }
+        if(tick_now){
+            next_tick = (timestep == 0) ? -1 : next_tick + timestep;
+        }
 
-            //6 - let's update last_step_time
-            gettimeofday(&last_step_time, NULL);
+        //5 - let's display our prediction
+        TRACE_BEGIN(render_start);
+        draw_prediction(&pred, &w);
+        fflush(stdout);
+        TRACE_END(render_start, "render", "render");
+        phase_end(&phases, CLIENT_PH_RENDER);
+    }
+}
+
+/**
+* \fn void spectate_client();
+* \brief Watches the games the server sends, until the player quits.
+* \details The whole arena is drawn on every keyframe, then only the squares
+*          that changed. A keyframe also comes when the server moves us to
+*          another game.
+*/
+void spectate_client(){
+    spectate_header hdr;
+    spectate_info info;
+    vector<square_run> runs;
+    vector<cell_update> cells;
+    square* arena = NULL;
+    char c;
+    int ret_serv;
+    int i, j, n;
+    struct pollfd fds[2];
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = sockfd;
+    fds[1].events = POLLIN;
+
+    info.width = 0;
+    info.height = 0;
+    clear();
+    mode_raw(1);
+    printf("Waiting for a game to watch.\n");
+    fflush(stdout);
+
+    while(1){
+        if(poll(fds, 2, -1) == -1){
+            perror("poll in 'spectate_client()'"); safe_quit(1);
+        }
+
+        //1 - let's see if the player leaves
+        if(fds[0].revents & POLLIN){
+            if(read(0, &c, sizeof(char)) == 1 && c == C_QUIT){
+                mode_raw(0);
+                clear();
+                free(arena);
+                return;
+            }
+        }
+        if(!(fds[1].revents & (POLLIN | POLLHUP))) continue;
+
+        //2 - let's read the frame
+        ret_serv = read_full(sockfd, &hdr, sizeof(spectate_header));
+        if(ret_serv > 0 && (hdr.flags & FRAME_KEYFRAME)){
+            ret_serv = read_full(sockfd, &info, sizeof(spectate_info));
+            runs.resize(hdr.nb_runs);
+            if(ret_serv > 0 && hdr.nb_runs > 0){
+                ret_serv = read_full(sockfd, runs.data(), hdr.nb_runs*sizeof(square_run));
+            }
+        }
+        else if(ret_serv > 0 && hdr.nb_cells > 0){
+            cells.resize(hdr.nb_cells);
+            ret_serv = read_full(sockfd, cells.data(), hdr.nb_cells*sizeof(cell_update));
         }
-        else{
-            //sleep 90% of the remaining time
-            usleep ((((cfg.timestep - PING) - elapsed_time) * 0.9) * 1000);
+        if(ret_serv == -1){
+            perror("handle_server read"); safe_quit(1);
         }
+        else if(ret_serv == 0){
+            clear(); printf("Server closed connection.\n"); safe_quit(1);
+        }
+
+        //3 - let's draw it
+        if(hdr.flags & FRAME_KEYFRAME){
+            arena = (square*)realloc(arena, info.width*info.height*sizeof(square));
+            n = 0;
+            for(i = 0; i < hdr.nb_runs; i++){
+                for(j = 0; j < runs[i].count && n < info.width*info.height; j++){
+                    arena[n++] = (square)runs[i].content;
+                }
+            }
+            clear();
+            for(i = 0; i < n; i++){
+                print_square(new_coord(i / info.width, i % info.width), arena[i]);
+            }
+        }
+        else if(arena != NULL){
+            for(i = 0; i < hdr.nb_cells; i++){
+                if(cells[i].x < 0 || cells[i].x >= info.height || cells[i].y < 0 || cells[i].y >= info.width) continue;
+                arena[cells[i].x*info.width + cells[i].y] = (square)cells[i].content;
+                print_square(new_coord(cells[i].x, cells[i].y), (square)cells[i].content);
+            }
+        }
+        printf("\033[%d;1HRoom %i, tick %i, %i snakes alive. %i ticks behind the game.\033[K",
+            info.height + 1, info.room, hdr.tick, hdr.nb_alive, info.delay);
+        fflush(stdout);
     }
 }
 
-int main(){
-    int id;
-    int size;
-    int nb_players;
-    int width;
-    int height;
+/**
+* \fn void connect_server(int port);
+* \brief Connects 'sockfd' to the server, on 'port'.
+*/
+void connect_server(int port){
     struct sockaddr_in serv;
-    int ret_serv;
-    config cfg;
 
     printf("Creating socket...\n");
     if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1){
@@ -180,7 +414,7 @@ int main(){
 
     printf("Preparing serv address...\n");
     serv.sin_family = AF_INET;
-    serv.sin_port = htons(PORT);
+    serv.sin_port = htons(port);
     inet_aton(SERV_ADDR, (struct in_addr*) &serv.sin_addr.s_addr);
     bzero(&(serv.sin_zero), 8);
     printf("Ok.\n");
@@ -190,6 +424,48 @@ int main(){
         perror("connect"); safe_quit(1);
     }
     printf("Ok.\n");
+}
+
+void usage(char* name){
+    printf("Usage : %s [-s] [-m socket]\n", name);
+    printf("  -s  watch the games instead of playing\n");
+    printf("  -m  serve the measures of the client on this Unix socket\n");
+}
+
+int main(int argc, char** argv){
+    int id;
+    int size;
+    int nb_players;
+    int width;
+    int height;
+    int ret_serv;
+    bool spectate = false;
+    const char* metrics_path = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "sm:h")) != -1){
+        switch(opt){
+            case 's': spectate = true; break;
+            case 'm': metrics_path = optarg; break;
+            default: usage(argv[0]); exit(1);
+        }
+    }
+    trace_start("client");
+    init_phase_timer(&phases, "client", client_phase_names, NB_CLIENT_PHASES);
+    if(metrics_path != NULL){
+        register_phase_timer(&phases);
+        endpoint = new_metrics_endpoint(metrics_path, write_client_metrics, NULL);
+    }
+
+    if(spectate){
+        connect_server(SPECTATE_PORT);
+        spectate_client();
+        close(sockfd);
+        if(endpoint != NULL) free_metrics_endpoint(endpoint);
+        trace_stop();
+        return 0;
+    }
+    connect_server(PORT);
 
     printf("Waiting for server to send info about the game.\n");
     ret_serv = read(sockfd, &size, 1*sizeof(int));
@@ -210,20 +486,18 @@ int main(){
     ret_serv = read(sockfd, &width, 1 * sizeof(int));
     if(ret_serv == -1){ perror("read"); safe_quit(1); }
     if(ret_serv == 0){ clear(); printf("server closed connection.\n"); safe_quit(1);}
-    printf("Game width: %i.\n", width);
+    printf("Viewport width: %i.\n", width);
 
     ret_serv = read(sockfd, &height, 1 * sizeof(int));
     if(ret_serv == -1) {perror("read"); safe_quit(1);}
     if (ret_serv == 0){clear(); printf("server closed connection.\n"); safe_quit(1);}
-    printf("Game height: %i.\n", height);
+    printf("Viewport height: %i.\n", height);
 
     printf("Waiting for the server to start the game.\n");
 
-    cfg.size = size;
-    cfg.nb_players = nb_players;
-    cfg.id = id;
-
-    play_client(cfg, width, height);
+    play_client(width, height);
 
+    if(endpoint != NULL) free_metrics_endpoint(endpoint);
+    trace_stop();
     return 0;
 }
\ No newline at end of file
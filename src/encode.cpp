@@ -0,0 +1,195 @@
+/**
+* \file encode.cpp
+* \brief Turns a field into planes of 0 and 1, see 'encode.h'.
+* \details A row of squares is encoded 16 squares at a time where SSE2 is there :
+*          the squares are compared to what every plane stands for at once,
+*          and the masks of the comparisons, cut to 1, are the planes.
+*/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "types.h"
+#include "encode.h"
+
+#ifdef __SSE2__
+/**
+* \fn void encode_16(__m128i v, unsigned char* out, size_t plane);
+* \brief Encodes the 16 squares of 'v', see 'encode_row()'.
+*/
+static inline void encode_16(__m128i v, unsigned char* out, size_t plane){
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i body = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(SNAKE)), _mm_cmpeq_epi8(v, _mm_set1_epi8(SCHLANGA)));
+    int k;
+
+    _mm_storeu_si128((__m128i*)(out + ENC_WALL*plane), _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(WALL)), one));
+    _mm_storeu_si128((__m128i*)(out + ENC_OWN*plane), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i*)(out + ENC_ENEMY*plane), _mm_and_si128(body, one));
+    for(k = FOOD; k <= FREEZE; k++){
+        __m128i is_k = _mm_cmpeq_epi8(v, _mm_set1_epi8(k));
+        _mm_storeu_si128((__m128i*)(out + (ENC_FOOD + k - FOOD)*plane), _mm_and_si128(is_k, one));
+    }
+}
+
+/**
+* \fn void encode_8(__m128i v, unsigned char* out, size_t plane);
+* \brief Encodes the 8 squares in the low half of 'v', see 'encode_row()'.
+*/
+static inline void encode_8(__m128i v, unsigned char* out, size_t plane){
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i body = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(SNAKE)), _mm_cmpeq_epi8(v, _mm_set1_epi8(SCHLANGA)));
+    int k;
+
+    _mm_storel_epi64((__m128i*)(out + ENC_WALL*plane), _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(WALL)), one));
+    _mm_storel_epi64((__m128i*)(out + ENC_OWN*plane), _mm_setzero_si128());
+    _mm_storel_epi64((__m128i*)(out + ENC_ENEMY*plane), _mm_and_si128(body, one));
+    for(k = FOOD; k <= FREEZE; k++){
+        __m128i is_k = _mm_cmpeq_epi8(v, _mm_set1_epi8(k));
+        _mm_storel_epi64((__m128i*)(out + (ENC_FOOD + k - FOOD)*plane), _mm_and_si128(is_k, one));
+    }
+}
+#endif
+
+/**
+* \fn void encode_row(const unsigned char* row, int n, unsigned char* out, size_t plane);
+* \brief Encodes the 'n' squares of 'row' into every plane, but ENC_OWN which
+*        is set to 0.
+* \details With SSE2, the squares go 16 at a time, then 8 : the last ones are
+*          taken with the 16, or the 8, before them, encoded twice.
+* \param out where the first square goes in the first plane
+* \param plane bytes from a plane to the next
+*/
+static void encode_row(const unsigned char* row, int n, unsigned char* out, size_t plane){
+    int i = 0, k;
+
+#ifdef __SSE2__
+    if(n >= 16){
+        for(; i + 16 <= n; i += 16){
+            encode_16(_mm_loadu_si128((const __m128i*)(row + i)), out + i, plane);
+        }
+        if(i < n) encode_16(_mm_loadu_si128((const __m128i*)(row + n - 16)), out + n - 16, plane);
+        return;
+    }
+    if(n >= 8){
+        encode_8(_mm_loadl_epi64((const __m128i*)row), out, plane);
+        encode_8(_mm_loadl_epi64((const __m128i*)(row + n - 8)), out + n - 8, plane);
+        return;
+    }
+#endif
+
+    //a row too short for SSE2, or all of it without SSE2
+    for(; i < n; i++){
+        unsigned char sq = row[i];
+        out[ENC_WALL*plane + i] = (sq == WALL);
+        out[ENC_OWN*plane + i] = 0;
+        out[ENC_ENEMY*plane + i] = (sq == SNAKE || sq == SCHLANGA);
+        for(k = FOOD; k <= FREEZE; k++){
+            out[(ENC_FOOD + k - FOOD)*plane + i] = (sq == k);
+        }
+    }
+}
+
+/**
+* \fn void mark_own(unsigned char* out, size_t plane, int i);
+* \brief Moves square 'i' of the encoding from the enemies to the snake it is for.
+*/
+static void mark_own(unsigned char* out, size_t plane, int i){
+    out[ENC_OWN*plane + i] = 1;
+    out[ENC_ENEMY*plane + i] = 0;
+}
+
+/**
+* \fn void encode_planes(field* map, snake* own, unsigned char* out);
+* \brief Encodes the arena of 'map' into the ENC_PLANES planes of 'out', each
+*        'map->height' x 'map->width'.
+* \param own the snake the encoding is for, NULL to count every snake as an enemy
+* \details The rows of the arena are read right from the chunks of the field.
+*/
+void encode_planes(field* map, snake* own, unsigned char* out){
+    size_t plane = (size_t)map->width*map->height;
+    int x, cy;
+
+    //1 - let's encode the arena, a row of a chunk at a time
+    for(x = 0; x < map->height; x++){
+        field_chunk** row = map->chunks + ((x >> CHUNK_BITS) + 1)*map->chunk_cols + 1;
+        const int offset = (x & CHUNK_MASK) << CHUNK_BITS;
+        for(cy = 0; cy*CHUNK_SIZE < map->width; cy++){
+            int n = map->width - cy*CHUNK_SIZE;
+            if(n > CHUNK_SIZE) n = CHUNK_SIZE;
+            encode_row(row[cy]->squares + offset, n, out + x*map->width + cy*CHUNK_SIZE, plane);
+        }
+    }
+
+    //2 - let's tell the body of 'own' from the others
+    if(own == NULL) return;
+    body_deque& body = body_access::of(own->body);
+    for(body_deque::iterator it = body.begin(); it != body.end(); ++it){
+        if(it->x < 0 || it->x >= map->height || it->y < 0 || it->y >= map->width) continue;
+        mark_own(out, plane, it->x*map->width + it->y);
+    }
+}
+
+/**
+* \fn coord crop_offset(coord head, direction d, coord c);
+* \returns where 'c' is, seen from 'head' turned so that 'd' is up : 'x' the
+*          rows below the head, 'y' the columns on its right
+*/
+static coord crop_offset(coord head, direction d, coord c){
+    switch(d){
+        case DOWN: return new_coord(head.x - c.x, head.y - c.y);
+        case LEFT: return new_coord(c.y - head.y, head.x - c.x);
+        case RIGHT: return new_coord(head.y - c.y, c.x - head.x);
+        default: return new_coord(c.x - head.x, c.y - head.y);
+    }
+}
+
+/**
+* \fn void encode_crop(field* map, snake* own, int radius, unsigned char* out);
+* \brief Encodes the squares of 'map' up to 'radius' squares from the head of
+*        'own', turned so that it heads up, into the ENC_PLANES planes of 'out',
+*        each (2*radius + 1) x (2*radius + 1).
+* \details A row of the crop is a row or a column of the field, either way
+*          round depending on the heading : its squares are gathered from the
+*          chunks in a row of their own, then encoded as a row of the arena.
+*          'radius' is at most ENC_MAX_RADIUS.
+*/
+void encode_crop(field* map, snake* own, int radius, unsigned char* out){
+    unsigned char squares[2*ENC_MAX_RADIUS + 1];
+    coord head = get_head_coord(own);
+    direction d = own->dir;
+    int side, i, j;
+    size_t plane;
+
+    if(radius > ENC_MAX_RADIUS) radius = ENC_MAX_RADIUS;
+    side = 2*radius + 1;
+    plane = (size_t)side*side;
+
+    //1 - let's encode the crop, a row at a time : the squares of row 'i' go
+    //from 'start' by 'step', out of the arena they are walls
+    for(i = 0; i < side; i++){
+        int ahead = i - radius;
+        coord start, step;
+        switch(d){
+            case DOWN: start = new_coord(head.x - ahead, head.y + radius); step = new_coord(0, -1); break;
+            case LEFT: start = new_coord(head.x + radius, head.y + ahead); step = new_coord(-1, 0); break;
+            case RIGHT: start = new_coord(head.x - radius, head.y - ahead); step = new_coord(1, 0); break;
+            default: start = new_coord(head.x + ahead, head.y - radius); step = new_coord(0, 1); break;
+        }
+        for(j = 0; j < side; j++){
+            int x = start.x + j*step.x, y = start.y + j*step.y;
+            if(x < 0 || x >= map->height || y < 0 || y >= map->width) squares[j] = WALL;
+            else squares[j] = map->chunks[((x >> CHUNK_BITS) + 1)*map->chunk_cols + (y >> CHUNK_BITS) + 1]
+                                  ->squares[((x & CHUNK_MASK) << CHUNK_BITS) | (y & CHUNK_MASK)];
+        }
+        encode_row(squares, side, out + i*side, plane);
+    }
+
+    //2 - let's tell the body of 'own' from the others
+    body_deque& body = body_access::of(own->body);
+    for(body_deque::iterator it = body.begin(); it != body.end(); ++it){
+        coord o = crop_offset(head, d, *it);
+        if(o.x < -radius || o.x > radius || o.y < -radius || o.y > radius) continue;
+        mark_own(out, plane, (o.x + radius)*side + o.y + radius);
+    }
+}
@@ -0,0 +1,36 @@
+/**
+* \file encode.h
+* \brief Turns a field into planes of 0 and 1, as bots learning from it read it.
+* \details Plane k of an encoding has a 1 on every square holding what k stands
+*          for, see 'enc_plane', and a 0 elsewhere. The planes are written one
+*          after the other, each row after row, one byte per square, right into
+*          the buffer of the caller.
+*          'encode_planes()' encodes the whole arena. 'encode_crop()' encodes the
+*          squares around the head of a snake, turned so that the snake heads
+*          up : the head is in the middle, what is in front of it above, what
+*          is on its right on the right. Squares out of the arena are walls.
+*          Snakes all look the same on a field : the squares of the body of the
+*          snake the encoding is for are found from its body.
+*/
+
+#ifndef H_ENCODE
+#define H_ENCODE
+
+#include "types.h"
+
+// CONSTANTS ============================================================
+/**
+* \typedef enc_plane
+* \brief Planes of an encoding, in their order. The items have a plane each,
+*        in the order of 'square', from ENC_FOOD.
+*/
+typedef enum {ENC_WALL, ENC_OWN, ENC_ENEMY, ENC_FOOD, ENC_POPWALL, ENC_HIGHSPEED, ENC_LOWSPEED, ENC_FREEZE} enc_plane;
+
+#define ENC_PLANES 8        /**< planes of an encoding */
+#define ENC_MAX_RADIUS 31   /**< squares 'encode_crop()' can see from the head, at most, along each axis */
+
+// PROTOTYPES ==========================================================
+void encode_planes(field* map, snake* own, unsigned char* out);
+void encode_crop(field* map, snake* own, int radius, unsigned char* out);
+
+#endif
@@ -0,0 +1,265 @@
+/**
+* \file env.cpp
+* \brief Many games stepped together, for the training of bots, see 'env.h'.
+* \details Every game is a 'world', as in a room of the server. They are all
+*          made in one session arena, and start again by restoring a snapshot
+*          of the first state of a game : once every game started, stepping
+*          them asks nothing of the heap.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>     //for 'malloc()'
+#include <string.h>     //for 'memcpy()'
+
+#include "types.h"
+#include "world.h"
+#include "AI.h"
+#include "encode.h"
+#include "env.h"
+
+// STRUCTURES ==========================================================
+/**
+* \typedef snake_env
+* \brief An environment, see 'env.h'.
+*/
+struct snake_env {
+    env_config cfg;
+    session_arena* arena;       /**< memory of every game */
+    world** games;              /**< every game */
+    world_snapshot* start;      /**< first state of a game, the same for all but the seed */
+    ai_play_fn play;            /**< AI of the other snakes, compiled for the size of the arena if it can */
+    unsigned int rng;           /**< gives the seed of every game started */
+    long episodes;              /**< games started so far */
+    int* head_x;                /**< state of every snake of every game, see 'env.h' */
+    int* head_y;
+    unsigned char* dirs;        /**< direction of every snake, DEAD_DIR once dead */
+    unsigned char* alive;
+    int* sizes;
+    int* ticks;                 /**< steps played by every game since it started */
+};
+
+// Games ===============================================================
+/**
+* \fn void mirror(snake_env* e, int g);
+* \brief Copies the state of the snakes of game 'g' into the arrays of 'e'.
+*/
+static void mirror(snake_env* e, int g){
+    world* w = e->games[g];
+    int base = g*e->cfg.nb_snakes;
+    int i;
+
+    for(i = 0; i < e->cfg.nb_snakes; i++){
+        coord head = get_head_coord(w->snakes[i]);
+        e->head_x[base + i] = head.x;
+        e->head_y[base + i] = head.y;
+        e->dirs[base + i] = (unsigned char)w->dirs[i];
+        e->alive[base + i] = (w->dirs[i] != DEAD_DIR);
+        e->sizes[base + i] = w->snakes[i]->get_size();
+    }
+    e->ticks[g] = w->tick;
+}
+
+/**
+* \fn void copy_arena(field* map, unsigned char* out);
+* \brief Copies the squares of the arena of 'map' into 'out', row after row.
+* \details A row of the arena is a row of every chunk it goes through : it is
+*          copied a chunk at a time.
+*/
+static void copy_arena(field* map, unsigned char* out){
+    int x, cy;
+
+    for(x = 0; x < map->height; x++){
+        field_chunk** row = map->chunks + ((x >> CHUNK_BITS) + 1)*map->chunk_cols + 1;
+        const int offset = (x & CHUNK_MASK) << CHUNK_BITS;
+        for(cy = 0; cy*CHUNK_SIZE < map->width; cy++){
+            int n = map->width - cy*CHUNK_SIZE;
+            if(n > CHUNK_SIZE) n = CHUNK_SIZE;
+            memcpy(out + x*map->width + cy*CHUNK_SIZE, row[cy]->squares + offset, n);
+        }
+    }
+}
+
+/**
+* \fn void observe(snake_env* e, int g, unsigned char* out);
+* \brief Writes the observation of game 'g' into 'out', see 'env.h'.
+*/
+static void observe(snake_env* e, int g, unsigned char* out){
+    world* w = e->games[g];
+    switch(e->cfg.obs){
+        case ENV_OBS_PLANES: encode_planes(w->map, w->snakes[0], out); break;
+        case ENV_OBS_CROP: encode_crop(w->map, w->snakes[0], e->cfg.crop_radius, out); break;
+        default: copy_arena(w->map, out); break;
+    }
+}
+
+/**
+* \fn void start_game(snake_env* e, int g);
+* \brief Starts game 'g' again, from the first state with a new seed.
+*/
+static void start_game(snake_env* e, int g){
+    world* w = e->games[g];
+    world_restore(w, e->start);
+    w->map->seed = rand_r(&e->rng);
+    e->episodes++;
+    mirror(e, g);
+}
+
+/**
+* \fn bool is_done(snake_env* e, world* w);
+* \returns true if the game 'w' is over for the agent : it died, it is the last
+*          one alive, or the game is as long as the config lets it be
+*/
+static bool is_done(snake_env* e, world* w){
+    if(w->dirs[0] == DEAD_DIR) return true;
+    if(e->cfg.nb_snakes > 1 && w->nb_alive == 1) return true;
+    return e->cfg.max_steps > 0 && w->tick >= e->cfg.max_steps;
+}
+
+// Environment =========================================================
+/**
+* \fn snake_env* env_create(const env_config* cfg);
+* \brief Creates an environment as 'cfg' tells, every game started.
+* \returns a pointer to the newly created environment, NULL if 'cfg' does not make sense
+*/
+snake_env* env_create(const env_config* cfg){
+    snake_env* e;
+    int n, g;
+
+    if(cfg->nb_games < 1 || cfg->width < 5 || cfg->height < 5
+       || cfg->nb_snakes < 1 || cfg->nb_snakes > ENV_MAX_SNAKES
+       || cfg->opponent < 0 || cfg->opponent > NB_AI_VERSIONS || cfg->max_steps < 0
+       || cfg->obs < ENV_OBS_SQUARES || cfg->obs > ENV_OBS_CROP
+       || (cfg->obs == ENV_OBS_CROP && (cfg->crop_radius < 0 || cfg->crop_radius > ENC_MAX_RADIUS))){
+        fprintf(stderr, "In 'env_create()' : bad config.\n");
+        return NULL;
+    }
+
+    //1 - let's make the games, all in one arena
+    e = new snake_env;
+    e->cfg = *cfg;
+    e->arena = new_session_arena();
+    e->games = (world**)malloc(cfg->nb_games*sizeof(world*));
+    for(g = 0; g < cfg->nb_games; g++){
+        e->games[g] = new_world(cfg->width, cfg->height, ENV_TIMESTEP, cfg->nb_snakes, e->arena);
+    }
+    e->start = new_world_snapshot(e->games[0], false);
+    world_save(e->games[0], e->start);
+    e->play = ai_engine(cfg->width, cfg->height);
+    e->rng = cfg->seed;
+    e->episodes = 0;
+
+    //2 - let's make the state, then start every game
+    n = cfg->nb_games*cfg->nb_snakes;
+    e->head_x = (int*)malloc(n*sizeof(int));
+    e->head_y = (int*)malloc(n*sizeof(int));
+    e->dirs = (unsigned char*)malloc(n);
+    e->alive = (unsigned char*)malloc(n);
+    e->sizes = (int*)malloc(n*sizeof(int));
+    e->ticks = (int*)malloc(cfg->nb_games*sizeof(int));
+    env_reset(e, NULL);
+
+    return e;
+}
+
+/**
+* \fn void env_destroy(snake_env* e);
+* \brief Used to free memory used by 'e' and all its games.
+*/
+void env_destroy(snake_env* e){
+    int g;
+
+    free_world_snapshot(e->start);
+    for(g = 0; g < e->cfg.nb_games; g++){
+        free_world(e->games[g]);
+    }
+    free_session_arena(e->arena);
+    free(e->games);
+    free(e->head_x);
+    free(e->head_y);
+    free(e->dirs);
+    free(e->alive);
+    free(e->sizes);
+    free(e->ticks);
+    delete e;
+}
+
+/**
+* \fn void env_reset(snake_env* e, unsigned char* obs);
+* \brief Starts every game of 'e' again.
+* \param obs where the first observation of every game is written, one after
+*        the other, NULL for none
+*/
+void env_reset(snake_env* e, unsigned char* obs){
+    int size = env_obs_size(e);
+    int g;
+
+    for(g = 0; g < e->cfg.nb_games; g++){
+        start_game(e, g);
+        if(obs != NULL) observe(e, g, obs + g*size);
+    }
+}
+
+/**
+* \fn void env_step(snake_env* e, const int* actions, float* rewards, unsigned char* dones, unsigned char* obs);
+* \brief Steps every game of 'e' once, see the file.
+* \param actions the action of the agent of every game
+* \param rewards where the reward of the agent of every game is written, NULL for none
+* \param dones where 1 is written for every game that ended, 0 for the others, NULL for none
+* \param obs where the observation of every game is written, one after the other, NULL for none
+*/
+void env_step(snake_env* e, const int* actions, float* rewards, unsigned char* dones, unsigned char* obs){
+    int size = env_obs_size(e);
+    int g, i;
+
+    for(g = 0; g < e->cfg.nb_games; g++){
+        world* w = e->games[g];
+        int before = w->snakes[0]->get_size();
+        float reward;
+        bool done;
+
+        //1 - let's take the direction of every snake
+        if(actions[g] >= UP && actions[g] <= RIGHT && w->dirs[0] != DEAD_DIR) w->dirs[0] = (direction)actions[g];
+        for(i = 1; i < w->nb_snakes; i++){
+            if(w->dirs[i] == DEAD_DIR || e->cfg.opponent == 0) continue;
+            w->dirs[i] = e->play(e->cfg.opponent, w->snakes[i], w->map, w->snakes[0]);
+        }
+
+        //2 - let's step, and see what it brought the agent
+        world_step(w);
+        reward = ENV_FOOD_REWARD*(w->snakes[0]->get_size() - before);
+        if(w->dirs[0] == DEAD_DIR) reward += ENV_DEATH_REWARD;
+        done = is_done(e, w);
+
+        //3 - let's start the game again if it ended
+        if(done) start_game(e, g);
+        else mirror(e, g);
+        if(rewards != NULL) rewards[g] = reward;
+        if(dones != NULL) dones[g] = done;
+        if(obs != NULL) observe(e, g, obs + g*size);
+    }
+}
+
+// State ===============================================================
+int env_nb_games(const snake_env* e){return e->cfg.nb_games;}
+int env_nb_snakes(const snake_env* e){return e->cfg.nb_snakes;}
+
+/**
+* \fn int env_obs_size(const snake_env* e);
+* \returns the bytes of the observation of a game
+*/
+int env_obs_size(const snake_env* e){
+    int side = 2*e->cfg.crop_radius + 1;
+    switch(e->cfg.obs){
+        case ENV_OBS_PLANES: return ENC_PLANES*e->cfg.width*e->cfg.height;
+        case ENV_OBS_CROP: return ENC_PLANES*side*side;
+        default: return e->cfg.width*e->cfg.height;
+    }
+}
+
+const int* env_head_x(const snake_env* e){return e->head_x;}               /**< row of the head of every snake */
+const int* env_head_y(const snake_env* e){return e->head_y;}               /**< column of the head of every snake */
+const unsigned char* env_dirs(const snake_env* e){return e->dirs;}
+const unsigned char* env_alive(const snake_env* e){return e->alive;}
+const int* env_sizes(const snake_env* e){return e->sizes;}
+const int* env_ticks(const snake_env* e){return e->ticks;}
+long env_episodes(const snake_env* e){return e->episodes;}
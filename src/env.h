@@ -0,0 +1,89 @@
+/**
+* \file env.h
+* \brief Many games stepped together, for the training of bots, with a C interface.
+* \details An environment holds 'nb_games' independent games of the same size,
+*          played on the engine of the server, 'world.h', without any display.
+*          In every game, snake 0 is the agent : the caller plays it. The other
+*          snakes are played by the AI, or go straight if 'opponent' is 0.
+*          'env_step()' steps every game at once : it takes one action per game,
+*          and gives back one reward, one done flag and one observation per game.
+*          A game that is done starts again at once, with a new seed : what
+*          'env_step()' gives back for it is the first observation of the next one.
+*
+*          The state of the snakes is kept structure of arrays : every head, every
+*          direction, every alive flag one after the other, snake 'i' of game 'g'
+*          at index g*nb_snakes + i. The arrays are updated by 'env_step()' and
+*          'env_reset()', and can be read between the calls.
+*
+*          Actions are directions, see 'direction' in 'types.h' : 0 up, 1 down,
+*          2 left, 3 right. Any other value keeps the direction of the agent.
+*          An observation is, as 'obs' in the config tells :
+*          - ENV_OBS_SQUARES : the arena of a game, 'width' x 'height' squares,
+*            row after row, one 'square' per byte
+*          - ENV_OBS_PLANES : the arena encoded for the agent by 'encode_planes()'
+*          - ENV_OBS_CROP : the squares around the head of the agent, encoded by
+*            'encode_crop()' with the radius 'crop_radius'
+*/
+
+#ifndef H_ENV
+#define H_ENV
+
+// CONSTANTS ============================================================
+#define ENV_MAX_SNAKES 12       /**< snakes of a game, at most : the places 'new_snake()' knows */
+#define ENV_TIMESTEP 100        /**< timestep of the fields, unused by the engine */
+#define ENV_FOOD_REWARD 1.0f    /**< reward of the agent for each square it grows */
+#define ENV_DEATH_REWARD -1.0f  /**< reward of the agent when it dies */
+#define ENV_OBS_SQUARES 0       /**< kinds of observation, see the file */
+#define ENV_OBS_PLANES 1
+#define ENV_OBS_CROP 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// STRUCTURES ==========================================================
+/**
+* \typedef env_config
+* \brief What an environment is made of.
+*/
+typedef struct env_config {
+    int nb_games;       /**< games stepped together */
+    int width;          /**< width of the arena of every game */
+    int height;         /**< height of the arena of every game */
+    int nb_snakes;      /**< snakes of every game, the agent included, from 1 to ENV_MAX_SNAKES */
+    int opponent;       /**< version of the AI playing the other snakes, 0 to let them go straight */
+    int max_steps;      /**< steps after which a game is done, 0 for no limit */
+    int obs;            /**< kind of observation, ENV_OBS_SQUARES, ENV_OBS_PLANES or ENV_OBS_CROP */
+    int crop_radius;    /**< for ENV_OBS_CROP, squares seen from the head along each axis, up to ENC_MAX_RADIUS */
+    unsigned int seed;  /**< seed of the first games, those after it come from it */
+} env_config;
+
+/**
+* \typedef snake_env
+* \brief An environment, see the file. Only used through the functions below.
+*/
+typedef struct snake_env snake_env;
+
+// PROTOTYPES ==========================================================
+snake_env* env_create(const env_config* cfg);
+void env_destroy(snake_env* e);
+void env_reset(snake_env* e, unsigned char* obs);
+void env_step(snake_env* e, const int* actions, float* rewards, unsigned char* dones, unsigned char* obs);
+
+// State ===============================================================
+int env_nb_games(const snake_env* e);
+int env_nb_snakes(const snake_env* e);
+int env_obs_size(const snake_env* e);
+const int* env_head_x(const snake_env* e);
+const int* env_head_y(const snake_env* e);
+const unsigned char* env_dirs(const snake_env* e);
+const unsigned char* env_alive(const snake_env* e);
+const int* env_sizes(const snake_env* e);
+const int* env_ticks(const snake_env* e);
+long env_episodes(const snake_env* e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+/**
+* \file envbench.cpp
+* \brief Measures how many steps per second an environment of 'env.h' takes.
+* \details The agents play at random. Steps are counted per game : an
+*          environment of 100 games stepped once counts 100 steps.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>         //for 'atoi()'
+#include <time.h>           //for 'clock_gettime()'
+#include <getopt.h>         //for 'getopt()'
+
+#include "env.h"
+
+/**
+* \fn double now_s();
+* \returns the time of the monotonic clock, in seconds
+*/
+static double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void usage(char* name){
+    printf("Usage : %s [-n games] [-W width] [-H height] [-s snakes] [-a version] [-m steps] [-d seconds] [-o kind] [-r radius]\n", name);
+    printf("  -n  games stepped together (default : 256)\n");
+    printf("  -W  width of the arena (default : 60)\n");
+    printf("  -H  height of the arena (default : 25)\n");
+    printf("  -s  snakes per game, the agent included (default : 2)\n");
+    printf("  -a  version of the AI of the other snakes, 0 to let them go straight (default : 0)\n");
+    printf("  -m  steps after which a game is done, 0 for no limit (default : 500)\n");
+    printf("  -d  duration of the run (default : 3)\n");
+    printf("  -o  ask for observations : 0 squares, 1 planes, 2 crop (default : none)\n");
+    printf("  -r  radius of the crop (default : 5)\n");
+}
+
+int main(int argc, char** argv){
+    env_config cfg = {256, 60, 25, 2, 0, 500, ENV_OBS_SQUARES, 5, 1};
+    double duration = 3;
+    bool with_obs = false;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:W:H:s:a:m:d:o:r:h")) != -1){
+        switch(opt){
+            case 'n': cfg.nb_games = atoi(optarg); break;
+            case 'W': cfg.width = atoi(optarg); break;
+            case 'H': cfg.height = atoi(optarg); break;
+            case 's': cfg.nb_snakes = atoi(optarg); break;
+            case 'a': cfg.opponent = atoi(optarg); break;
+            case 'm': cfg.max_steps = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'o': cfg.obs = atoi(optarg); with_obs = true; break;
+            case 'r': cfg.crop_radius = atoi(optarg); break;
+            default: usage(argv[0]); exit(1);
+        }
+    }
+
+    snake_env* e = env_create(&cfg);
+    if(e == NULL) exit(1);
+
+    int* actions = (int*)malloc(cfg.nb_games*sizeof(int));
+    float* rewards = (float*)malloc(cfg.nb_games*sizeof(float));
+    unsigned char* dones = (unsigned char*)malloc(cfg.nb_games);
+    unsigned char* obs = with_obs ? (unsigned char*)malloc((size_t)cfg.nb_games*env_obs_size(e)) : NULL;
+    unsigned int seed = cfg.seed;
+    long steps = 0;
+    double reward = 0;
+    int g;
+
+    //1 - let's step with random actions, mostly keeping on
+    double start = now_s(), end = start;
+    while(end - start < duration){
+        for(g = 0; g < cfg.nb_games; g++){
+            int r = rand_r(&seed) % 8;
+            actions[g] = (r < 4) ? r : -1;
+        }
+        env_step(e, actions, rewards, dones, obs);
+        for(g = 0; g < cfg.nb_games; g++){
+            reward += rewards[g];
+        }
+        steps += cfg.nb_games;
+        if((steps / cfg.nb_games) % 64 == 0) end = now_s();
+    }
+
+    //2 - let's tell how it went
+    printf("%i games of %ix%i, %i snakes, AI %i", cfg.nb_games, cfg.width, cfg.height, cfg.nb_snakes, cfg.opponent);
+    if(with_obs) printf(", observations of kind %i, %i bytes", cfg.obs, env_obs_size(e));
+    printf(".\n");
+    printf("%li steps in %.2f s : %.0f steps/s.\n", steps, end - start, steps / (end - start));
+    printf("%li games played, mean reward %.3f per game.\n", env_episodes(e), reward / env_episodes(e));
+
+    env_destroy(e);
+    free(actions);
+    free(rewards);
+    free(dones);
+    free(obs);
+    return 0;
+}
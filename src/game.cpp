@@ -10,17 +10,52 @@
 #include <stdbool.h>        //for 'bool' type
 #include <stdio.h>          //for 'printf()'
 #include <stdlib.h>         //for 'exit()'
+#include <errno.h>          //for 'errno'
+#include <fcntl.h>          //for 'fcntl()'
+#include <poll.h>           //for 'poll()'
+#include <sched.h>          //for 'sched_yield()'
 #include <termios.h>        //for 'struct termios'
 #include <unistd.h>         //for 'usleep()'
 #include <sys/ioctl.h>      //for 'ioctl()'
 
 #include "types.h"
 #include "AI.h"
-#include "queue.h"
+#include "stats.h"          //before game.h, whose 'clear' macro breaks <atomic>
+#include "trace.h"
+#include "timer_wheel.h"
 
 #include "game.h"
 
+/**
+* \typedef game_phase
+* \brief Phases of a time step of 'play()', timed by its 'phase_timer'.
+*/
+typedef enum {
+    GAME_PH_SLEEP,      /**< passing time */
+    GAME_PH_INPUT,      /**< taking the keys read since the last step */
+    GAME_PH_MOVE,       /**< moving the snakes */
+    GAME_PH_AI,         /**< the AI choosing the schlanga's direction */
+    GAME_PH_ITEMS,      /**< popping items */
+    GAME_PH_RENDER,     /**< handing what changed to the renderer */
+    NB_GAME_PHASES
+} game_phase;
+
+static const char* game_phase_names[NB_GAME_PHASES] = {"sleep", "input", "move", "ai", "items", "render"};
+
 //Game ================================================================
+/**
+* \fn void freeze(timer_wheel* effects, int* frozen, int id);
+* \brief Freezes snake 'id' of the local game for FREEZING_TIME steps.
+*/
+static void freeze(timer_wheel* effects, int* frozen, int id) {
+    timed_effect e;
+    e.due = effects->now + FREEZING_TIME;
+    e.kind = EFFECT_UNFREEZE;
+    e.target = id;
+    frozen[id]++;
+    timer_add(effects, e);
+}
+
 /**
 * \fn void play(config cfg);
 * \brief Function that launches a game and makes it run.
@@ -35,7 +70,7 @@ void play(config cfg) {
     //creating field
     struct winsize sz; // Struct containing size of window
     ioctl(0, TIOCGWINSZ, &sz); // Calculate size of window
-    field* map = new_field(sz.ws_col, sz.ws_row, cfg.timestep);
+    field* map = new_field(sz.ws_col, sz.ws_row, cfg.timestep, new_session_arena());   //freed by 'free_all()'
 
     //creating snakes
     const int snake_pos = 0;
@@ -43,15 +78,23 @@ void play(config cfg) {
     snake* s = new_snake(T_SNAKE, snake_pos, map);            //Create snake with size 10 at start_pos on map
     snake* schlanga = new_snake(T_SCHLANGA, shlanga_pos, map); //Create snake with size 10 at start_pos on map
 
-    myqueue p1_queue = new_queue(MAX_INPUT_STACK);    //queue used to stack p1 input
-    myqueue p2_queue = new_queue(MAX_INPUT_STACK);    //queue used to stack p2 input
+    key_reader keys;      //thread stacking the inputs of the players as they come
+    key_event key;        //input a snake is moved by
+    histogram key_to_step;    //time from a key being read to the step it is played at, in us
+    init_histogram(&key_to_step);
 
-    char c;               //key that is pressed
-    int ret;              //value returned by 'read()', 0 if no new key was pressed
-    bool snake_dead;      //True if the snake is dead.
-    bool schlanga_dead;   //True if the schlanga died.
+    bool snake_dead = false;      //True if the snake is dead.
+    bool schlanga_dead = false;   //True if the schlanga died.
     int random_item;      //Random integer deciding if an item pops or not
     direction cur_dir;
+    timer_wheel effects;  //freezes, until they wear off
+    int frozen[2] = {0, 0};   //freezes the snake and the schlanga are under
+    init_timer_wheel(&effects, 0, NULL);     //outlives the arena of the field
+    phase_timer timer;    //time spent in each phase, shown when the game ends
+    init_phase_timer(&timer, "game", game_phase_names, NB_GAME_PHASES);
+    renderer screen;      //thread drawing the field, see 'start_renderer()'
+    start_renderer(&screen, map);
+    start_key_reader(&keys, cfg.mode);
 
     //Main loop
     //1 - pass time
@@ -59,121 +102,118 @@ void play(config cfg) {
     //3 - make snakes move
     //4 - check if someone died
     //5 - handle items
+    //6 - let freezes wear off
+    //7 - hand the field to the renderer
     while(1){
         //1 - let's pass time
+        TRACE_BEGIN(sleep_start);
         usleep(map->timestep * 1000 - map->speed);
-
-        //2 - let's retrieve and sort every input.
-        while((ret = read(0, &c, sizeof(char))) != 0){
-            if(ret == -1){
-                perror("read in 'play()'");
-                exit(1);
-            }
-
-            if(c == C_QUIT){
-                mode_raw(0);
-                clear();
-                myfree_queue(&p1_queue);
-                myfree_queue(&p2_queue);
-                free_all(map, s, schlanga);
-                return;
-            }
-            else if(key_is_p1_dir(c)){
-                //if the key is a move key for player 1:
-                if(! myqueue_full(&p1_queue)){
-                    myenqueue(&p1_queue, key_to_dir(c));
-                }
-            }
-            else if(cfg.mode == 2 && key_is_p2_dir(c)){
-                if(! myqueue_full(&p2_queue)){
-                    myenqueue(&p2_queue, key_to_dir(c));
-                }
-            }
-            else{
-                //key pressed was a useless key. Do nothing.
-            }
+        TRACE_END(sleep_start, "sleep", "sleep");
+        phase_end(&timer, GAME_PH_SLEEP);
+        TRACE_BEGIN(tick_start);
+
+        //2 - let's see if the game was quitted : the keys were read as they came
+        if(keys.quit.load(memory_order_acquire)){
+            stop_key_reader(&keys);
+            stop_renderer(&screen);
+            mode_raw(0);
+            clear();
+            free_all(map, s, schlanga);
+            print_phase_timer(stdout, &timer);
+            print_histogram(stdout, "key to step", &key_to_step);
+            printf("%li frames drawn, %li skipped.\n", screen.drawn.load(), screen.skipped.load());
+            return;
         }
+        phase_end(&timer, GAME_PH_INPUT);
 
         //3 - let's make snakes move
         //snake
-        if (map->freeze_snake > 0) {
-            map->freeze_snake--;
-        }
-        else{
-            cur_dir = (! myqueue_empty(&p1_queue)) ? mydequeue(&p1_queue) : s->dir;
+        if (frozen[snake_pos] == 0) {
+            cur_dir = s->dir;
+            if(ring_try_pop(&keys.p1, &key)){
+                cur_dir = key.dir;
+                histogram_add(&key_to_step, (trace_now() - key.time) / 1000);
+            }
             cur_dir = (cur_dir == opposite(s->dir)) ? s->dir : cur_dir;
+            if (get_square_at(map, coord_after_dir(get_head_coord(s), cur_dir)) == FREEZE) {
+                freeze(&effects, frozen, shlanga_pos);
+            }
             snake_dead = move(s, cur_dir, map);
         }
+        phase_end(&timer, GAME_PH_MOVE);
 
         //schlanga
-        if (map->freeze_schlanga > 0) {
-            map->freeze_schlanga--;
-        }
-        else{
+        if (frozen[shlanga_pos] == 0) {
             if(cfg.mode == 2){
-                cur_dir = (! myqueue_empty(&p2_queue)) ? mydequeue(&p2_queue) : schlanga->dir;
+                cur_dir = schlanga->dir;
+                if(ring_try_pop(&keys.p2, &key)){
+                    cur_dir = key.dir;
+                    histogram_add(&key_to_step, (trace_now() - key.time) / 1000);
+                }
                 cur_dir = (cur_dir == opposite(schlanga->dir)) ? schlanga->dir : cur_dir;
             }
             else{
-                switch(cfg.AI_version){
-                    case 1:
-                        cur_dir = rngesus(schlanga);
-                        break;
-                    case 2:
-                        cur_dir = rngesus2(schlanga, map);
-                        break;
-                    case 3:
-                        cur_dir = spread(schlanga, map);
-                        break;
-                    case 4:
-                        cur_dir = aggro_dist(schlanga, map, s);
-                        break;
-                    case 5 :
-                        cur_dir = defensif_dist(schlanga, map, s);
-                        break;
-                    case 6 :
-                        cur_dir = heat_map(schlanga, map);
-                        break;
-                    default:
-                        myfree_queue(&p1_queue);
-                        myfree_queue(&p2_queue);
-                        free_all(map, s, schlanga); mode_raw(0); clear();
-                        printf("In 'move()' : AI_version not recognized.\n");
-                        exit(1);
-                        break;
+                if(cfg.AI_version < 1 || cfg.AI_version > NB_AI_VERSIONS){
+                    stop_key_reader(&keys);
+                    stop_renderer(&screen);
+                    free_all(map, s, schlanga); mode_raw(0); clear();
+                    printf("In 'move()' : AI_version not recognized.\n");
+                    exit(1);
                 }
+                cur_dir = ai_play(cfg.AI_version, schlanga, map, s);
+                phase_end(&timer, GAME_PH_AI);
+            }
+            if (get_square_at(map, coord_after_dir(get_head_coord(schlanga), cur_dir)) == FREEZE) {
+                freeze(&effects, frozen, snake_pos);
             }
             schlanga_dead = move(schlanga, cur_dir, map);
         }
+        phase_end(&timer, GAME_PH_MOVE);
 
         //4 - let's check if someone has died
         if(schlanga_dead){
-            myfree_queue(&p1_queue);
-            myfree_queue(&p2_queue);
+			stop_key_reader(&keys);
+			stop_renderer(&screen);
 			free_all(map, s, schlanga);
 			mode_raw(0);
 			clear();
 			print_msg("     SCHLANGA DIED      ");
+			print_phase_timer(stdout, &timer);
+			print_histogram(stdout, "key to step", &key_to_step);
+			printf("%li frames drawn, %li skipped.\n", screen.drawn.load(), screen.skipped.load());
 			return;
 		}
         else if(snake_dead){
-            myfree_queue(&p1_queue);
-            myfree_queue(&p2_queue);
+            stop_key_reader(&keys);
+            stop_renderer(&screen);
             free_all(map, s, schlanga);
             mode_raw(0);
             clear();
             print_msg("       SNAKE DIED       ");
+            print_phase_timer(stdout, &timer);
+            print_histogram(stdout, "key to step", &key_to_step);
+            printf("%li frames drawn, %li skipped.\n", screen.drawn.load(), screen.skipped.load());
             return;
         }
 
         //5 - let's gereate (or not) items
-		random_item = rand() % 10;
+		random_item = field_rand(map) % 10;
 		if (random_item == 0) {
             coord item_loc;
 			pop_item(map, true, item_loc);
 		}
+        phase_end(&timer, GAME_PH_ITEMS);
 
-        fflush(stdout);
+        //6 - let's let the freezes due wear off
+        timer_advance(&effects);
+        for (size_t i = 0; i < effects.fired.size(); i++) {
+            frozen[effects.fired[i].target]--;
+        }
+
+        //7 - let's hand what changed to the renderer, without waiting for the terminal
+        publish_frame(&screen, map);
+        phase_end(&timer, GAME_PH_RENDER);
+        TRACE_END(tick_start, "tick", "tick");
     }//end while(1)
 }
 
@@ -181,12 +221,14 @@ void play(config cfg) {
 * \fn int move(snake* s, direction d, field* map);
 * \brief operates on a snake structure to make it move one step with the 'd'
 *        direction. This function does not protect the snake from going into its neck.
-*        This function also cares for collision management and display update.
+*        This function also cares for collision management. What it changes on
+*        the field is drawn by the 'renderer' of the game.
 * \return Number corresponding to an event : 0 if snake/schlanga moves peacefully
 *                                            1 if snake/schlanga dies
 */
 int move(snake* s, direction d, field* map) {
     static int iter = 0;
+    TRACE_BEGIN(start);
     //MOVING SNAKE
 
     //Updating snake's head coordinates
@@ -203,14 +245,6 @@ int move(snake* s, direction d, field* map) {
         c_newhead = new_coord(c_oldhead.x + 1, c_oldhead.y);
     }
 
-    // DISPLAY    
-    if(s->type == T_SNAKE){
-        print_to_pos_colored(c_newhead, 's', BLUE);
-    }
-    if(s->type == T_SCHLANGA){
-        print_to_pos_colored(c_newhead, '$', YELLOW);
-    }
-
     //COLLISIONS
     square temp_square = get_square_at(map, c_newhead);
 
@@ -234,19 +268,9 @@ int move(snake* s, direction d, field* map) {
             s->add_size = true;
 			break;
 		case POPWALL:
-			{
-				int popwall;
-				int nbwalls = map->width*map->height/(100+rand()%50);
-				for (popwall = 0; popwall < nbwalls; popwall++) {
-					coord pos_wall = new_coord(1 + rand() % (map->height-1), 1 + rand() % (map->width-1));
-					if (get_square_at(map, pos_wall) == EMPTY) {
-						set_square_at(map, pos_wall, WALL);
-						print_to_pos_colored(pos_wall, '#', RED);
-					}
-				}
-				collision = 0;
-				break;
-			}
+			pop_walls(map);
+			collision = 0;
+			break;
 		case HIGHSPEED:
 			collision = 0;
 			map->speed += ADD_SPEED;
@@ -256,12 +280,7 @@ int move(snake* s, direction d, field* map) {
 			map->speed -= ADD_SPEED;
 			break;
 		case FREEZE:
-			collision = 0;
-			if(s->type == T_SNAKE){
-				map->freeze_schlanga = FREEZING_TIME;
-			} else if(s->type == T_SCHLANGA){
-				map->freeze_snake = FREEZING_TIME;
-			}
+			collision = 0;     //freezing the others is up to the game, see 'play()'
 			break;
 		case EMPTY:
 			//~ write(2, "hit ???\n", 7*sizeof(char));
@@ -284,9 +303,25 @@ int move(snake* s, direction d, field* map) {
         }
     }
     
+    TRACE_END(start, "move", "game");
     return collision;
 }
 
+/**
+* \fn void pop_walls(field* map);
+* \brief adds walls at random empty squares of the field, what a POPWALL does.
+*/
+void pop_walls(field* map) {
+    int popwall;
+    int nbwalls = map->width*map->height/(100+field_rand(map)%50);
+    for (popwall = 0; popwall < nbwalls; popwall++) {
+        coord pos_wall = new_coord(1 + field_rand(map) % (map->height-1), 1 + field_rand(map) % (map->width-1));
+        if (get_square_at(map, pos_wall) == EMPTY) {
+            set_square_at(map, pos_wall, WALL);
+        }
+    }
+}
+
 /**
 * \fn void pop_item(field* map);
 * \brief adds a random item to the field.
@@ -294,24 +329,21 @@ int move(snake* s, direction d, field* map) {
 square pop_item(field* map, bool generate_freeze, coord& item_loc) {
     coord pos_item;
     square item;
-    char item_char;
-    int dir = generate_freeze + rand() % 7;
+    int dir = generate_freeze + field_rand(map) % 7;
 
     do {
-        pos_item = new_coord(1 + rand() % (map->height-1), 1 + rand() % (map->width-1));
+        pos_item = new_coord(1 + field_rand(map) % (map->height-1), 1 + field_rand(map) % (map->width-1));
     } while (get_square_at(map, pos_item) != EMPTY);
 
     switch (dir) {
         case 0:
             item = FREEZE;
-            item_char = '*';
             break;
         case 1:
 			if (map->speed >= 5*ADD_SPEED) {
 				item = (square)-1;
 			} else {
 				item = HIGHSPEED;
-				item_char = '>';
 			}
             break;
         case 2:
@@ -319,16 +351,13 @@ square pop_item(field* map, bool generate_freeze, coord& item_loc) {
 				item = (square)-1;
 			} else {
 				item = LOWSPEED;
-				item_char = '<';
 			}
             break;
         case 3:
 			item = POPWALL;
-			item_char = 'W';
             break;
         case 4: case 5: case 6: case 7:
             item = FOOD;
-            item_char = 'x';
             break;
         default:
             item = (square)-1;
@@ -337,7 +366,6 @@ square pop_item(field* map, bool generate_freeze, coord& item_loc) {
 
     if (item > 0) {
         set_square_at(map, pos_item, item);
-        print_to_pos(pos_item, item_char);
     }
 
     item_loc = pos_item;
@@ -345,6 +373,89 @@ square pop_item(field* map, bool generate_freeze, coord& item_loc) {
 }
 
 //Input/Output ========================================================
+/**
+* \fn void* read_keys(void* arg);
+* \brief Body of the thread of a 'key_reader' : waits for keys, and stacks the
+*        direction keys in the ring of their player with the time they came.
+* \details A player can have MAX_INPUT_STACK keys waiting, the next ones are
+*          dropped. The thread ends when it is woken up by 'stop_key_reader()'.
+*/
+static void* read_keys(void* arg){
+    key_reader* in = (key_reader*)arg;
+    struct pollfd fds[2];
+    char keys[32];
+    ssize_t n, i;
+
+    trace_thread_name("keys");
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = in->wake_fd[0];
+    fds[1].events = POLLIN;
+    while(1){
+        //1 - let's wait for keys, or to be stopped
+        if(poll(fds, 2, -1) == -1){
+            if(errno == EINTR) continue;
+            perror("poll in 'read_keys()'");
+            return NULL;
+        }
+        if(fds[1].revents != 0) return NULL;
+        if(fds[0].revents == 0) continue;
+
+        //2 - let's stack them, all read at the same time
+        long now = trace_now();
+        n = read(STDIN_FILENO, keys, sizeof(keys));
+        if(n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+        if(n <= 0) return NULL;     //no keyboard anymore
+        for(i = 0; i < n; i++){
+            key_event e;
+            e.time = now;
+            if(keys[i] == C_QUIT){
+                in->quit.store(true, memory_order_release);
+            }
+            else if(key_is_p1_dir(keys[i])){
+                e.dir = key_to_dir(keys[i]);
+                if(ring_count(&in->p1) < MAX_INPUT_STACK) ring_try_push(&in->p1, e);
+            }
+            else if(in->mode == 2 && key_is_p2_dir(keys[i])){
+                e.dir = key_to_dir(keys[i]);
+                if(ring_count(&in->p2) < MAX_INPUT_STACK) ring_try_push(&in->p2, e);
+            }
+        }
+    }
+}
+
+/**
+* \fn void start_key_reader(key_reader* in, int mode);
+* \brief Starts the thread of 'in', reading the keys of a game of mode 'mode'.
+*        The terminal must be in raw mode already.
+*/
+void start_key_reader(key_reader* in, int mode){
+    in->mode = mode;
+    in->quit.store(false);
+    init_ring(&in->p1);
+    init_ring(&in->p2);
+    if(pipe(in->wake_fd) == -1){
+        perror("pipe in 'start_key_reader()'");
+        exit(1);
+    }
+    if(pthread_create(&in->thread, NULL, read_keys, in) != 0){
+        printf("In 'start_key_reader()' : can't create the thread.\n");
+        exit(1);
+    }
+}
+
+/**
+* \fn void stop_key_reader(key_reader* in);
+* \brief Stops the thread of 'in' and waits for it. Keys not taken are lost.
+*/
+void stop_key_reader(key_reader* in){
+    char c = 0;
+    if(write(in->wake_fd[1], &c, 1) == -1) perror("write in 'stop_key_reader()'");
+    pthread_join(in->thread, NULL);
+    close(in->wake_fd[0]);
+    close(in->wake_fd[1]);
+}
+
 /**
 * \fn bool key_is_p1_dir(char c);
 * \return 1 if the given char 'c' corresponds to a direction key for player 1.
@@ -402,6 +513,129 @@ direction key_to_dir(char c){
 }
 
 //Display =============================================================
+/**
+* \fn void* draw_frames(void* arg);
+* \brief Body of the thread of a 'renderer' : draws the last frame published
+*        each time it is woken up, until 'stop_renderer()'.
+*/
+static void* draw_frames(void* arg){
+    renderer* r = (renderer*)arg;
+    int nb_squares = r->width*r->height;
+    unsigned last = 0;      //'seq' of the last frame drawn
+    unsigned seq;
+    char wakes[64];
+    int i;
+
+    trace_thread_name("render");
+    while(1){
+        //1 - let's wait for frames : the wake-ups of several are taken at once
+        if(read(r->wake_fd[0], wakes, sizeof(wakes)) == -1 && errno == EINTR) continue;
+        if(r->stop.load(memory_order_acquire)) return NULL;
+
+        //2 - let's copy the last one, again if a step wrote it meanwhile
+        while(1){
+            seq = r->seq.load(memory_order_acquire);
+            if(seq & 1){
+                sched_yield();
+                continue;
+            }
+            for(i = 0; i < nb_squares; i++){
+                r->frame[i] = r->squares[i].load(memory_order_relaxed);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if(r->seq.load(memory_order_relaxed) == seq) break;
+        }
+        if(seq == last) continue;
+        r->skipped.fetch_add((seq - last)/2 - 1, memory_order_relaxed);
+        last = seq;
+
+        //3 - let's draw what differs from the screen
+        TRACE_BEGIN(draw_start);
+        for(i = 0; i < nb_squares; i++){
+            if(r->frame[i] != r->shown[i]){
+                print_square(new_coord(i / r->width, i % r->width), (square)r->frame[i]);
+                r->shown[i] = r->frame[i];
+            }
+        }
+        fflush(stdout);     //blocks as long as the terminal takes, the steps go on
+        r->drawn.fetch_add(1, memory_order_relaxed);
+        TRACE_END(draw_start, "draw", "render");
+    }
+}
+
+/**
+* \fn void start_renderer(renderer* r, field* map);
+* \brief Starts the thread of 'r', drawing 'map' on a cleared screen. From
+*        then on, the squares set on 'map' are logged in 'map->changes'.
+*/
+void start_renderer(renderer* r, field* map){
+    int x, y;
+
+    r->width = map->width;
+    r->height = map->height;
+    r->squares = new std::atomic<unsigned char>[r->width*r->height];
+    r->frame = (unsigned char*)malloc(r->width*r->height);
+    r->shown = (unsigned char*)calloc(r->width*r->height, 1);     //the screen is cleared : EMPTY everywhere
+    for(x = 0; x < r->height; x++){
+        for(y = 0; y < r->width; y++){
+            r->squares[x*r->width + y].store(get_square_at(map, new_coord(x, y)), memory_order_relaxed);
+        }
+    }
+    r->seq.store(2);        //the field as it is is the first frame
+    r->stop.store(false);
+    r->drawn.store(0);
+    r->skipped.store(0);
+    map->changes = new vector<coord>;
+
+    if(pipe(r->wake_fd) == -1){
+        perror("pipe in 'start_renderer()'");
+        exit(1);
+    }
+    fcntl(r->wake_fd[1], F_SETFL, O_NONBLOCK);     //a full pipe already wakes the thread up
+    if(write(r->wake_fd[1], "", 1) == -1) perror("write in 'start_renderer()'");
+    if(pthread_create(&r->thread, NULL, draw_frames, r) != 0){
+        printf("In 'start_renderer()' : can't create the thread.\n");
+        exit(1);
+    }
+}
+
+/**
+* \fn void publish_frame(renderer* r, field* map);
+* \brief Hands the squares set on 'map' since the last call to the thread of
+*        'r', and wakes it up. Never waits for the thread, nor for the terminal.
+*/
+void publish_frame(renderer* r, field* map){
+    unsigned seq = r->seq.load(memory_order_relaxed);
+    size_t i;
+
+    r->seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for(i = 0; i < map->changes->size(); i++){
+        coord c = (*map->changes)[i];
+        if(c.x < 0 || c.y < 0 || c.x >= r->height || c.y >= r->width) continue;
+        r->squares[c.x*r->width + c.y].store(get_square_at(map, c), memory_order_relaxed);
+    }
+    r->seq.store(seq + 2, memory_order_release);
+    map->changes->resize(0);    //"clear" is a macro here
+
+    if(write(r->wake_fd[1], "", 1) == -1 && errno != EAGAIN) perror("write in 'publish_frame()'");
+}
+
+/**
+* \fn void stop_renderer(renderer* r);
+* \brief Stops the thread of 'r', waits for it, and frees what 'start_renderer()' made.
+*/
+void stop_renderer(renderer* r){
+    r->stop.store(true, memory_order_release);
+    if(write(r->wake_fd[1], "", 1) == -1 && errno != EAGAIN) perror("write in 'stop_renderer()'");
+    pthread_join(r->thread, NULL);
+    close(r->wake_fd[0]);
+    close(r->wake_fd[1]);
+    delete[] r->squares;
+    free(r->frame);
+    free(r->shown);
+}
+
 /**
 * \fn void print_to_pos(coord pos, char c);
 * \brief prints the character 'c' at the given position
@@ -430,6 +664,43 @@ void print_to_pos_colored(coord pos, char c, char* color) {
     #endif
 }
 
+/**
+* \fn void print_square(coord pos, square sq);
+* \brief prints the content 'sq' of a square at the given position, the
+*        same way 'move()' and 'pop_item()' print it.
+*/
+void print_square(coord pos, square sq) {
+    switch(sq){
+        case WALL:
+            print_to_pos_colored(pos, '#', RED);
+            break;
+        case SNAKE:
+            print_to_pos_colored(pos, 's', BLUE);
+            break;
+        case SCHLANGA:
+            print_to_pos_colored(pos, '$', YELLOW);
+            break;
+        case FOOD:
+            print_to_pos(pos, 'x');
+            break;
+        case POPWALL:
+            print_to_pos(pos, 'W');
+            break;
+        case HIGHSPEED:
+            print_to_pos(pos, '>');
+            break;
+        case LOWSPEED:
+            print_to_pos(pos, '<');
+            break;
+        case FREEZE:
+            print_to_pos(pos, '*');
+            break;
+        default:
+            print_to_pos(pos, ' ');
+            break;
+    }
+}
+
 /**
 * \fn void mode_raw(int activate);
 * \brief Use mode_raw(1) to enable raw mode, mode_raw(0) to disable.
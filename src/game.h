@@ -5,7 +5,11 @@
 #ifndef H_GAME
 #define H_GAME
 
+#include <pthread.h>
+#include <atomic>
+
 #include "types.h"
+#include "spsc_ring.h"
 
 // CONSTANTS ============================================================
 // OPTIONS
@@ -30,6 +34,7 @@
 #define FREEZING_TIME 10  /**< number of iterations during which a snake will be frozen */
 #define ADD_SPEED 25000   /**< add x seconds to usleep */
 #define MAX_INPUT_STACK 5 /**< maximum inputs that can stack for a player */
+#define INPUT_RING 8      /**< size of the ring of inputs of a player, a power of 2 not below MAX_INPUT_STACK */
 
 // UTILITY
 #define RED     "\033[1m\033[31m"      /* Red */
@@ -54,20 +59,81 @@ typedef struct config{
     int timestep;
 } config;
 
+/**
+* \typedef input_ring
+* \brief Inputs of a player, waiting for the tick that plays them.
+*/
+typedef spsc_ring<direction, INPUT_RING> input_ring;
+
+/**
+* \typedef key_event
+* \brief A direction key, and when it was read.
+*/
+struct key_event {
+    direction dir;
+    long time;      /**< in ns, on the monotonic clock */
+};
+
+/**
+* \typedef key_reader
+* \brief Thread reading the keys of the local game as soon as they are pressed.
+* \details The thread blocks on the keyboard, and hands every direction key to
+*          the ticks of the game through the ring of its player.
+*/
+struct key_reader {
+    pthread_t thread;
+    int wake_fd[2];                 /**< pipe telling the thread to stop */
+    int mode;                       /**< 'mode' of the game : the keys of player 2 are only read in mode 2 */
+    spsc_ring<key_event, INPUT_RING> p1;    /**< direction keys of player 1 */
+    spsc_ring<key_event, INPUT_RING> p2;    /**< direction keys of player 2 */
+    std::atomic<bool> quit;         /**< true once C_QUIT was pressed */
+};
+
+/**
+* \typedef renderer
+* \brief Thread drawing the field of the local game, apart from its steps.
+* \details After each step, the game writes the squares it changed in
+*          'squares', under a seqlock : 'seq' is odd while it writes. The
+*          thread copies 'squares' again if 'seq' changed meanwhile, and only
+*          draws what differs from the screen. When the terminal is slow, the
+*          steps do not wait : the thread draws the last frame and skips the
+*          ones in between.
+*/
+struct renderer {
+    pthread_t thread;
+    int wake_fd[2];                 /**< pipe telling the thread a frame was published */
+    int width;
+    int height;
+    std::atomic<unsigned> seq;      /**< twice the frames published, plus one while one is */
+    std::atomic<unsigned char>* squares;    /**< field after the last step, row after row */
+    unsigned char* frame;           /**< copy of 'squares' being drawn, thread only */
+    unsigned char* shown;           /**< what is on the screen, thread only */
+    std::atomic<bool> stop;
+    std::atomic<long> drawn;        /**< frames drawn */
+    std::atomic<long> skipped;      /**< frames published and never drawn */
+};
+
 // PROTOTYPES ==========================================================
 // Game ================================================================
 void play(config cfg);
 int move(snake* s, direction d, field* map);
+void pop_walls(field* map);
 square pop_item(field* map, bool generate_freeze, coord& loc);
 
 // Input/Output ========================================================
+void start_key_reader(key_reader* in, int mode);
+void stop_key_reader(key_reader* in);
 bool key_is_p1_dir(char c);
 bool key_is_p2_dir(char c);
 direction key_to_dir(char c);
 
 // Display =============================================================
+void start_renderer(renderer* r, field* map);
+void publish_frame(renderer* r, field* map);
+void stop_renderer(renderer* r);
 void print_to_pos(coord pos, char c);
 void print_to_pos_colored(coord pos, char c, char* color);
+void print_square(coord pos, square sq);
 void mode_raw(int activate);
 void print_msg(char* msg);
 
@@ -0,0 +1,60 @@
+/**
+* \file grid.h
+* \brief Read-only views of a field, for the code that reads it the most.
+* \details Both views answer 'at()' like 'get_square_at()'. 'runtime_grid' works
+*          on any field. 'fixed_grid' knows the size of the arena when it is
+*          compiled : its strides are constants, and an arena fitting in one
+*          chunk is read without going through the table of chunks.
+*          Code templated on the view is compiled once for each of them.
+*          Both give the index of the items of the field, 'items'.
+*/
+
+#ifndef H_GRID
+#define H_GRID
+
+#include "types.h"
+#include "item_index.h"
+
+// STRUCTURES ==========================================================
+/**
+* \typedef runtime_grid
+* \brief View of a field of any size.
+*/
+struct runtime_grid {
+    field* map;
+    item_index* items;
+
+    runtime_grid(field* m) : map(m), items(m->items) {}
+    int width() const {return map->width;}
+    int height() const {return map->height;}
+    square at(coord c) const {return get_square_at(map, c);}
+};
+
+/**
+* \typedef fixed_grid
+* \brief View of a field whose arena is W squares wide and H squares high.
+* \details Squares out of the arena are read as 'get_square_at()' reads them,
+*          from the ring of walls.
+*/
+template<int W, int H>
+struct fixed_grid {
+    static const int COLS = (W + CHUNK_MASK) / CHUNK_SIZE + 2;     /**< chunks per row, the ring included */
+    static const bool ONE_CHUNK = (W <= CHUNK_SIZE && H <= CHUNK_SIZE);
+
+    field_chunk* const* chunks;
+    const unsigned char* arena;     /**< squares of the first chunk of the arena */
+    item_index* items;
+
+    fixed_grid(field* m) : chunks(m->chunks), arena(m->chunks[COLS + 1]->squares), items(m->items) {}
+    static int width() {return W;}
+    static int height() {return H;}
+    square at(coord c) const {
+        if(ONE_CHUNK && (unsigned)c.x < CHUNK_SIZE && (unsigned)c.y < CHUNK_SIZE){
+            return (square)arena[(c.x << CHUNK_BITS) | c.y];
+        }
+        const field_chunk* ch = chunks[((c.x >> CHUNK_BITS) + 1)*COLS + (c.y >> CHUNK_BITS) + 1];
+        return (square)ch->squares[((c.x & CHUNK_MASK) << CHUNK_BITS) | (c.y & CHUNK_MASK)];
+    }
+};
+
+#endif
@@ -0,0 +1,271 @@
+/**
+* \file interest.cpp
+* \brief Interest management : what each client of a room needs to receive.
+* \details This file is separated in 2 parts :
+*          1 - functions operating on areas of the arena
+*          2 - the interest grid, sorting changes and heads by position
+*/
+
+#include <stdlib.h>     //for 'abs()'
+#include <algorithm>    //for 'min()' and 'max()'
+
+#include "types.h"
+#include "AI.h"
+#include "world.h"
+#include "net.h"
+
+#include "interest.h"
+
+// Areas ===============================================================
+/**
+* \fn area new_area(int x0, int y0, int x1, int y1);
+* \returns the area going from row 'x0' to 'x1' and from column 'y0' to 'y1', ends excluded.
+*/
+area new_area(int x0, int y0, int x1, int y1){
+    area a;
+    a.x0 = x0;
+    a.y0 = y0;
+    a.x1 = x1;
+    a.y1 = y1;
+    return a;
+}
+
+/**
+* \fn area clip_area(area a, field* map);
+* \returns the part of 'a' that is inside 'map'. Can be empty.
+*/
+area clip_area(area a, field* map){
+    if(a.x0 < 0) a.x0 = 0;
+    if(a.y0 < 0) a.y0 = 0;
+    if(a.x1 > map->height) a.x1 = map->height;
+    if(a.y1 > map->width) a.y1 = map->width;
+    if(a.x1 < a.x0) a.x1 = a.x0;
+    if(a.y1 < a.y0) a.y1 = a.y0;
+    return a;
+}
+
+/**
+* \fn bool in_area(area a, coord c);
+* \return true if 'c' is inside 'a'
+*/
+bool in_area(area a, coord c){
+    return c.x >= a.x0 && c.x < a.x1 && c.y >= a.y0 && c.y < a.y1;
+}
+
+/**
+* \fn area inter_area(area a, area b);
+* \returns the squares that are both in 'a' and in 'b'. Can be empty.
+*/
+area inter_area(area a, area b){
+    return new_area(max(a.x0, b.x0), max(a.y0, b.y0), min(a.x1, b.x1), min(a.y1, b.y1));
+}
+
+/**
+* \fn bool is_empty_area(area a);
+* \returns true if there is no square in 'a'
+*/
+bool is_empty_area(area a){
+    return a.x0 >= a.x1 || a.y0 >= a.y1;
+}
+
+// Interest grid =======================================================
+/**
+* \fn int bucket_of(interest_grid* g, coord c);
+* \returns the index of the bucket containing 'c'
+*/
+static int bucket_of(interest_grid* g, coord c){
+    return (c.x / AOI_BUCKET) * g->cols + c.y / AOI_BUCKET;
+}
+
+/**
+* \fn interest_grid* new_interest_grid(world* w);
+* \brief Creates the interest grid of 'w', and starts logging the squares
+*        that change on its field.
+* \returns a pointer to the newly created 'interest_grid'
+*/
+interest_grid* new_interest_grid(world* w){
+    interest_grid* g = new interest_grid;
+    g->rows = (w->map->height + AOI_BUCKET - 1) / AOI_BUCKET;
+    g->cols = (w->map->width + AOI_BUCKET - 1) / AOI_BUCKET;
+    g->cells = new vector<coord>[g->rows * g->cols];
+    g->bufs = new net_buffer*[g->rows * g->cols];
+    for(int b = 0; b < g->rows * g->cols; b++){
+        g->bufs[b] = NULL;
+    }
+    g->heads = new vector<int>[g->rows * g->cols];
+    g->head_bucket.assign(w->nb_snakes, -1);
+
+    if(w->map->changes == NULL){
+        w->map->changes = new vector<coord>();
+    }
+    interest_update(g, w);
+
+    return g;
+}
+
+/**
+* \fn void free_interest_grid(interest_grid* g);
+* \brief Used to free memory used by the 'g' interest grid
+*/
+void free_interest_grid(interest_grid* g){
+    for(size_t i = 0; i < g->touched.size(); i++){
+        net_buffer_unref(g->bufs[g->touched[i]]);
+    }
+    delete[] g->bufs;
+    delete[] g->cells;
+    delete[] g->heads;
+    delete g;
+}
+
+/**
+* \fn void interest_update(interest_grid* g, world* w);
+* \brief Sorts the squares that changed since the last call, and the heads of
+*        the snakes, into the buckets of 'g'. Empties the change log of the field.
+* \details The buffers of the previous tick are released : send queues that
+*          still hold them keep them alive.
+*/
+void interest_update(interest_grid* g, world* w){
+    size_t i;
+    int id;
+
+    //1 - forget the changes of the previous tick
+    for(i = 0; i < g->touched.size(); i++){
+        g->cells[g->touched[i]].clear();
+        net_buffer_unref(g->bufs[g->touched[i]]);
+        g->bufs[g->touched[i]] = NULL;
+    }
+    g->touched.clear();
+
+    //2 - sort the changes of this tick
+    vector<coord>* changes = w->map->changes;
+    for(i = 0; i < changes->size(); i++){
+        int b = bucket_of(g, (*changes)[i]);
+        if(g->cells[b].empty()) g->touched.push_back(b);
+        g->cells[b].push_back((*changes)[i]);
+    }
+    changes->clear();
+
+    //3 - serialize them once for every client
+    for(i = 0; i < g->touched.size(); i++){
+        vector<coord>& cells = g->cells[g->touched[i]];
+        net_buffer* buf = new_net_buffer(cells.size() * sizeof(cell_update));
+        cell_update* u = (cell_update*)buf->data;
+        for(size_t j = 0; j < cells.size(); j++){
+            u[j].x = cells[j].x;
+            u[j].y = cells[j].y;
+            u[j].content = get_square_at(w->map, cells[j]);
+        }
+        g->bufs[g->touched[i]] = buf;
+    }
+
+    //4 - move the heads that changed bucket
+    for(id = 0; id < w->nb_snakes; id++){
+        int b = (w->dirs[id] == DEAD_DIR) ? -1 : bucket_of(g, get_head_coord(w->snakes[id]));
+        int old_b = g->head_bucket[id];
+        if(b == old_b) continue;
+
+        if(old_b != -1){
+            vector<int>& v = g->heads[old_b];
+            for(i = 0; i < v.size(); i++){
+                if(v[i] == id){
+                    v[i] = v.back();
+                    v.pop_back();
+                    break;
+                }
+            }
+        }
+        if(b != -1) g->heads[b].push_back(id);
+        g->head_bucket[id] = b;
+    }
+}
+
+/**
+* \fn void interest_collect(field* map, area old_win, area new_win, vector<cell_update>& out);
+* \brief Appends to 'out' every square a client whose window moved from 'old_win'
+*        to 'new_win' did not see yet.
+* \param old_win window the client had at the previous tick, empty if none
+* \param new_win window of the client, both clipped to the arena
+* \details What changed in the part the client already saw is given by 'interest_shared()'.
+*/
+void interest_collect(field* map, area old_win, area new_win, vector<cell_update>& out){
+    cell_update u;
+    coord c;
+
+    for(c.x = new_win.x0; c.x < new_win.x1; c.x++){
+        bool row_seen = c.x >= old_win.x0 && c.x < old_win.x1;
+        for(c.y = new_win.y0; c.y < new_win.y1; c.y++){
+            if(row_seen && c.y >= old_win.y0 && c.y < old_win.y1){
+                c.y = old_win.y1 - 1;
+                continue;
+            }
+            u.x = c.x;
+            u.y = c.y;
+            u.content = get_square_at(map, c);
+            out.push_back(u);
+        }
+    }
+}
+
+/**
+* \fn int interest_shared(interest_grid* g, area seen, vector<net_buffer*>& out);
+* \brief Appends to 'out' the buffers of the buckets that changed during the last
+*        tick and overlap 'seen'. They can hold squares outside of 'seen'.
+* \details The cost only depends on the size of 'seen', not on what is in it.
+* \returns the number of 'cell_update' in the buffers appended
+*/
+int interest_shared(interest_grid* g, area seen, vector<net_buffer*>& out){
+    int nb = 0;
+    int bx, by;
+
+    if(is_empty_area(seen)) return 0;
+    for(bx = seen.x0 / AOI_BUCKET; bx <= (seen.x1 - 1) / AOI_BUCKET; bx++){
+        for(by = seen.y0 / AOI_BUCKET; by <= (seen.y1 - 1) / AOI_BUCKET; by++){
+            net_buffer* buf = g->bufs[bx * g->cols + by];
+            if(buf == NULL) continue;
+            out.push_back(buf);
+            nb += buf->len / sizeof(cell_update);
+        }
+    }
+    return nb;
+}
+
+/**
+* \fn int interest_nearest_snake(interest_grid* g, world* w, int id);
+* \brief Looks for the living snake whose head is the closest to the head of snake 'id'.
+* \details Buckets are searched in rings of growing size around the head, and the
+*          search stops as soon as no further ring can hold a closer head.
+* \returns the id of the closest snake, -1 if 'id' is the only one alive.
+*/
+int interest_nearest_snake(interest_grid* g, world* w, int id){
+    coord head = get_head_coord(w->snakes[id]);
+    int hx = head.x / AOI_BUCKET;
+    int hy = head.y / AOI_BUCKET;
+    int max_r = max(g->rows, g->cols);
+    int best = -1;
+    float best_dist = 0;
+    int r, bx, by;
+    size_t i;
+
+    for(r = 0; r <= max_r; r++){
+        if(best != -1 && best_dist <= (r - 1) * AOI_BUCKET) break;
+
+        for(bx = hx - r; bx <= hx + r; bx++){
+            if(bx < 0 || bx >= g->rows) continue;
+            for(by = hy - r; by <= hy + r; by++){
+                if(by < 0 || by >= g->cols) continue;
+                if(abs(bx - hx) != r && abs(by - hy) != r) continue;   //inside the ring
+
+                vector<int>& heads = g->heads[bx * g->cols + by];
+                for(i = 0; i < heads.size(); i++){
+                    if(heads[i] == id) continue;
+                    float d = dist(head, get_head_coord(w->snakes[heads[i]]));
+                    if(best == -1 || d < best_dist){
+                        best = heads[i];
+                        best_dist = d;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
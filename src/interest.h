@@ -0,0 +1,62 @@
+/**
+* \file interest.h
+*/
+
+#ifndef H_INTEREST
+#define H_INTEREST
+
+#include <vector>
+
+#include "types.h"
+#include "world.h"
+#include "net.h"
+
+// CONSTANTS ============================================================
+#define AOI_BUCKET 16   /**< width and height of a bucket of the interest grid, in squares */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef area
+* \brief Rows from 'x0' to 'x1' and columns from 'y0' to 'y1', ends excluded.
+*/
+struct area {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+/**
+* \typedef interest_grid
+* \brief Spatial grid of the arena of a world, cut into AOI_BUCKET x AOI_BUCKET buckets.
+* \details Every tick, the squares that changed and the heads of the snakes are
+*          sorted into the buckets, so that finding what happened around a
+*          position only costs what happened there. The changes of every bucket
+*          are serialized once, and the same buffer is sent to every client
+*          that can see the bucket.
+*/
+struct interest_grid {
+    int rows;                   /**< number of buckets on a column */
+    int cols;                   /**< number of buckets on a row */
+    vector<coord>* cells;       /**< squares changed during the last tick, per bucket */
+    net_buffer** bufs;          /**< 'cell_update' of the squares of 'cells', NULL if there are none */
+    vector<int>* heads;         /**< ids of the snakes whose head is in the bucket */
+    vector<int> touched;        /**< buckets in which squares changed during the last tick */
+    vector<int> head_bucket;    /**< bucket of the head of every snake, -1 once dead */
+};
+
+// PROTOTYPES ==========================================================
+area new_area(int x0, int y0, int x1, int y1);
+area clip_area(area a, field* map);
+bool in_area(area a, coord c);
+area inter_area(area a, area b);
+bool is_empty_area(area a);
+
+interest_grid* new_interest_grid(world* w);
+void free_interest_grid(interest_grid* g);
+void interest_update(interest_grid* g, world* w);
+void interest_collect(field* map, area old_win, area new_win, vector<cell_update>& out);
+int interest_shared(interest_grid* g, area seen, vector<net_buffer*>& out);
+int interest_nearest_snake(interest_grid* g, world* w, int id);
+
+#endif
@@ -0,0 +1,350 @@
+/**
+* \file item_index.cpp
+* \brief Spatial index of the items of a field, see 'item_index.h'.
+*/
+
+#include <string.h>     //for 'memcpy()'
+
+#include "types.h"
+#include "item_index.h"
+
+/**
+* \fn long list_key(square item, int bx, int by);
+* \returns the key of the list of the items 'item' of bucket (bx, by)
+*/
+static long list_key(square item, int bx, int by){
+    return ((long)(item - FOOD) << 58) | ((long)bx << 29) | by;
+}
+
+/**
+* \fn unsigned int list_slot(item_index* ix, long key);
+* \returns the slot of 'lists' holding the list 'key', or the free slot it goes in
+*/
+static unsigned int list_slot(item_index* ix, long key){
+    unsigned int mask = ix->lists.size() - 1;
+    unsigned int i = (unsigned int)(((unsigned long)key * 0x9E3779B97F4A7C15ul) >> 32) & mask;
+    while(ix->lists[i].key != -1 && ix->lists[i].key != key){
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+* \fn void grow_lists(item_index* ix);
+* \brief Doubles the slots of 'lists', putting every list back in its slot.
+*/
+static void grow_lists(item_index* ix){
+    vector<item_list, arena_allocator<item_list> > old(ix->lists.get_allocator());
+    item_list empty = {-1, -1};
+    size_t i;
+
+    old.swap(ix->lists);
+    ix->lists.assign(2*old.size(), empty);
+    for(i = 0; i < old.size(); i++){
+        if(old[i].key != -1) ix->lists[list_slot(ix, old[i].key)] = old[i];
+    }
+}
+
+/**
+* \fn void drop_list(item_index* ix, unsigned int i);
+* \brief Frees slot 'i' of 'lists', moving back the lists after it that were
+*        probed past it, so that no search stops at it too soon.
+*/
+static void drop_list(item_index* ix, unsigned int i){
+    unsigned int mask = ix->lists.size() - 1;
+    unsigned int j = i;
+
+    while(true){
+        j = (j + 1) & mask;
+        if(ix->lists[j].key == -1) break;
+        unsigned int home = (unsigned int)(((unsigned long)ix->lists[j].key * 0x9E3779B97F4A7C15ul) >> 32) & mask;
+        //a list whose home is between 'i' excluded and 'j' stays where it is
+        if((i <= j) ? (i < home && home <= j) : (i < home || home <= j)) continue;
+        ix->lists[i] = ix->lists[j];
+        i = j;
+    }
+    ix->lists[i].key = -1;
+    ix->nb_lists--;
+}
+
+/**
+* \fn int first_of(item_index* ix, square item, int bx, int by);
+* \returns the first entry of the list of the items 'item' of bucket (bx, by), -1 if none
+*/
+static int first_of(item_index* ix, square item, int bx, int by){
+    item_list& l = ix->lists[list_slot(ix, list_key(item, bx, by))];
+    return (l.key == -1) ? -1 : l.head;
+}
+
+/**
+* \fn int dist2(coord a, coord b);
+* \returns the square of the euclidian distance between 'a' and 'b'
+*/
+static int dist2(coord a, coord b){
+    return (a.x - b.x)*(a.x - b.x) + (a.y - b.y)*(a.y - b.y);
+}
+
+/**
+* \fn bool closer(coord c, coord a, coord b);
+* \returns true if 'a' comes before 'b' from 'c' : it is closer, or as close and
+*          first row after row. Queries do not depend on the order of the lists.
+*/
+static bool closer(coord c, coord a, coord b){
+    int da = dist2(c, a), db = dist2(c, b);
+    if(da != db) return da < db;
+    return (a.x != b.x) ? a.x < b.x : a.y < b.y;
+}
+
+/**
+* \fn item_index* new_item_index(int width, int height, session_arena* arena);
+* \param arena where the lists and the entries are made, NULL for the heap
+* \returns a new index, empty, for an arena of 'width' x 'height' squares
+*/
+item_index* new_item_index(int width, int height, session_arena* arena){
+    item_index* ix = new item_index;
+    item_list empty = {-1, -1};
+    int i;
+
+    ix->lists = vector<item_list, arena_allocator<item_list> >(ITEM_MIN_SLOTS, empty, arena_allocator<item_list>(arena));
+    ix->nb_lists = 0;
+    ix->entries = vector<indexed_item, arena_allocator<indexed_item> >(arena_allocator<indexed_item>(arena));
+    ix->rows = (height + ITEM_BUCKET - 1) >> ITEM_BUCKET_BITS;
+    ix->cols = (width + ITEM_BUCKET - 1) >> ITEM_BUCKET_BITS;
+    ix->free_entry = -1;
+    for(i = 0; i < NB_ITEM_TYPES; i++){
+        ix->counts[i] = 0;
+    }
+    return ix;
+}
+
+/**
+* \fn void free_item_index(item_index* ix);
+* \brief Frees 'ix' and what it holds.
+*/
+void free_item_index(item_index* ix){
+    delete ix;
+}
+
+/**
+* \fn void copy_item_index(item_index* to, item_index* from);
+* \brief Makes 'to' hold the items of 'from'. Both index the same arena.
+*/
+void copy_item_index(item_index* to, item_index* from){
+    to->lists = from->lists;
+    to->nb_lists = from->nb_lists;
+    to->entries = from->entries;
+    to->free_entry = from->free_entry;
+    memcpy(to->counts, from->counts, sizeof(from->counts));
+}
+
+/**
+* \fn bool is_item(square q);
+* \returns true if 'q' is an item
+*/
+bool is_item(square q){
+    return q >= FOOD && q <= FREEZE;
+}
+
+/**
+* \fn void item_index_add(item_index* ix, coord c, square item);
+* \brief Adds the item 'item' at 'c'. Squares out of the arena are not indexed.
+*/
+void item_index_add(item_index* ix, coord c, square item){
+    int bx = c.x >> ITEM_BUCKET_BITS, by = c.y >> ITEM_BUCKET_BITS;
+    int e;
+    if(c.x < 0 || c.y < 0 || bx >= ix->rows || by >= ix->cols) return;
+
+    if(ix->free_entry != -1){
+        e = ix->free_entry;
+        ix->free_entry = ix->entries[e].next;
+    }
+    else{
+        e = ix->entries.size();
+        ix->entries.push_back(indexed_item());
+    }
+    if(2*(ix->nb_lists + 1) > (int)ix->lists.size()) grow_lists(ix);
+    long key = list_key(item, bx, by);
+    item_list& l = ix->lists[list_slot(ix, key)];
+    if(l.key == -1){
+        l.key = key;
+        l.head = -1;
+        ix->nb_lists++;
+    }
+    ix->entries[e].loc = c;
+    ix->entries[e].tag = -1;
+    ix->entries[e].next = l.head;
+    l.head = e;
+    ix->counts[item - FOOD]++;
+}
+
+/**
+* \fn void item_index_remove(item_index* ix, coord c, square item);
+* \brief Removes the item 'item' at 'c', if it is indexed.
+*/
+void item_index_remove(item_index* ix, coord c, square item){
+    int bx = c.x >> ITEM_BUCKET_BITS, by = c.y >> ITEM_BUCKET_BITS;
+    if(c.x < 0 || c.y < 0 || bx >= ix->rows || by >= ix->cols) return;
+
+    unsigned int slot = list_slot(ix, list_key(item, bx, by));
+    if(ix->lists[slot].key == -1) return;
+    int* link = &ix->lists[slot].head;
+    while(*link != -1){
+        int e = *link;
+        if(are_equal(ix->entries[e].loc, c)){
+            *link = ix->entries[e].next;
+            ix->entries[e].next = ix->free_entry;
+            ix->free_entry = e;
+            ix->counts[item - FOOD]--;
+            if(ix->lists[slot].head == -1) drop_list(ix, slot);
+            return;
+        }
+        link = &ix->entries[e].next;
+    }
+}
+
+/**
+* \fn int find_entry(item_index* ix, coord c, square item);
+* \returns the entry of the item 'item' at 'c', -1 if there is none
+*/
+static int find_entry(item_index* ix, coord c, square item){
+    int bx = c.x >> ITEM_BUCKET_BITS, by = c.y >> ITEM_BUCKET_BITS;
+    int e;
+    if(c.x < 0 || c.y < 0 || bx >= ix->rows || by >= ix->cols) return -1;
+
+    for(e = first_of(ix, item, bx, by); e != -1; e = ix->entries[e].next){
+        if(are_equal(ix->entries[e].loc, c)) return e;
+    }
+    return -1;
+}
+
+/**
+* \fn void item_index_set_tag(item_index* ix, coord c, square item, int tag);
+* \brief Tags the item 'item' at 'c' with 'tag', telling it from the items that
+*        were there before it. An item is tagged with -1 when it is added.
+*/
+void item_index_set_tag(item_index* ix, coord c, square item, int tag){
+    int e = find_entry(ix, c, item);
+    if(e != -1) ix->entries[e].tag = tag;
+}
+
+/**
+* \fn int item_index_tag(item_index* ix, coord c, square item);
+* \returns the tag of the item 'item' at 'c', -1 if it has none or is not there
+*/
+int item_index_tag(item_index* ix, coord c, square item){
+    int e = find_entry(ix, c, item);
+    return (e == -1) ? -1 : ix->entries[e].tag;
+}
+
+/**
+* \fn void keep_nearest(coord c, coord loc, int k, int* found, coord* out);
+* \brief Puts 'loc' in 'out', the '*found' closest items to 'c' so far, if it is
+*        one of the 'k' closest.
+*/
+static void keep_nearest(coord c, coord loc, int k, int* found, coord* out){
+    int i;
+
+    if(*found == k && !closer(c, loc, out[k - 1])) return;
+    i = (*found == k) ? k - 1 : (*found)++;
+    while(i > 0 && closer(c, loc, out[i - 1])){
+        out[i] = out[i - 1];
+        i--;
+    }
+    out[i] = loc;
+}
+
+/**
+* \fn int items_nearest(item_index* ix, square item, coord c, int k, coord* out);
+* \brief Finds the 'k' items 'item' closest to 'c'.
+* \details Buckets are looked at by rings around the one of 'c'. The squares of
+*          ring r are at least (r - 1)*ITEM_BUCKET + 1 away from 'c' : the search
+*          stops at the first ring that can not hold anything closer, or once
+*          every item was seen. A ring with more buckets than the table has
+*          slots is not worth it : every list of the table is looked at instead.
+* \param out filled with the items found, the closest first
+* \returns the number of items found, 'k' unless there are fewer
+*/
+int items_nearest(item_index* ix, square item, coord c, int k, coord* out){
+    int bx = c.x >> ITEM_BUCKET_BITS, by = c.y >> ITEM_BUCKET_BITS;
+    int rmax = (ix->rows > ix->cols) ? ix->rows : ix->cols;
+    int count = ix->counts[item - FOOD];
+    int found = 0, seen = 0;
+    int r, dx, dy, e;
+    size_t s;
+
+    if(k <= 0 || count == 0) return 0;
+    for(r = 0; r <= rmax && seen < count; r++){
+        int reach = (r - 1)*ITEM_BUCKET + 1;
+        if(found == k && r > 0 && dist2(c, out[k - 1]) < reach*reach) return found;
+        if(8*r > (int)ix->lists.size()) break;
+
+        for(dx = -r; dx <= r; dx++){
+            int x = bx + dx;
+            if(x < 0 || x >= ix->rows) continue;
+            //only the edges of the ring : its first and last rows, the ends of the others
+            for(dy = -r; dy <= r; dy += (dx == -r || dx == r || r == 0) ? 1 : 2*r){
+                int y = by + dy;
+                if(y < 0 || y >= ix->cols) continue;
+
+                for(e = first_of(ix, item, x, y); e != -1; e = ix->entries[e].next){
+                    keep_nearest(c, ix->entries[e].loc, k, &found, out);
+                    seen++;
+                }
+            }
+        }
+    }
+    if(r > rmax || seen == count) return found;
+
+    //the items are too few for the rings : let's look at all of them
+    found = 0;
+    for(s = 0; s < ix->lists.size(); s++){
+        if(ix->lists[s].key == -1 || (ix->lists[s].key >> 58) != item - FOOD) continue;
+        for(e = ix->lists[s].head; e != -1; e = ix->entries[e].next){
+            keep_nearest(c, ix->entries[e].loc, k, &found, out);
+        }
+    }
+    return found;
+}
+
+/**
+* \fn int items_within(item_index* ix, square item, coord c, int radius, coord* out, int max);
+* \brief Finds the items 'item' at most 'radius' squares away from 'c'.
+* \details When the buckets around 'c' outnumber the slots of the table, its
+*          lists are looked at instead.
+* \param out filled with at most 'max' of them, in no particular order
+* \returns the number of items put in 'out'
+*/
+int items_within(item_index* ix, square item, coord c, int radius, coord* out, int max){
+    int x0 = (c.x - radius) >> ITEM_BUCKET_BITS, x1 = (c.x + radius) >> ITEM_BUCKET_BITS;
+    int y0 = (c.y - radius) >> ITEM_BUCKET_BITS, y1 = (c.y + radius) >> ITEM_BUCKET_BITS;
+    int found = 0;
+    int x, y, e;
+    size_t s;
+
+    if(ix->counts[item - FOOD] == 0) return 0;
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 >= ix->rows) x1 = ix->rows - 1;
+    if(y1 >= ix->cols) y1 = ix->cols - 1;
+
+    if((long)(x1 - x0 + 1)*(y1 - y0 + 1) > (long)ix->lists.size()){
+        for(s = 0; s < ix->lists.size(); s++){
+            if(ix->lists[s].key == -1 || (ix->lists[s].key >> 58) != item - FOOD) continue;
+            for(e = ix->lists[s].head; e != -1; e = ix->entries[e].next){
+                if(found == max) return found;
+                if(dist2(c, ix->entries[e].loc) <= radius*radius) out[found++] = ix->entries[e].loc;
+            }
+        }
+        return found;
+    }
+
+    for(x = x0; x <= x1; x++){
+        for(y = y0; y <= y1; y++){
+            for(e = first_of(ix, item, x, y); e != -1; e = ix->entries[e].next){
+                if(found == max) return found;
+                if(dist2(c, ix->entries[e].loc) <= radius*radius) out[found++] = ix->entries[e].loc;
+            }
+        }
+    }
+    return found;
+}
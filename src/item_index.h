@@ -0,0 +1,78 @@
+/**
+* \file item_index.h
+* \brief Where the items of a field are, to find the nearest ones without scanning it.
+* \details The arena is cut into buckets of ITEM_BUCKET x ITEM_BUCKET squares.
+*          For every type of item, every bucket holds the list of the items of
+*          that type in it. 'set_square_at()' keeps the index of a field up to
+*          date : whatever pops, is eaten or vanishes goes through it.
+*          A query only looks at the buckets around where it is asked.
+*          Only the lists that hold items are kept, in a hash table : an index
+*          costs what its items do, however big the arena.
+*/
+
+#ifndef H_ITEM_INDEX
+#define H_ITEM_INDEX
+
+#include <vector>
+
+#include "types.h"
+
+// CONSTANTS ============================================================
+#define ITEM_BUCKET_BITS 3
+#define ITEM_BUCKET (1 << ITEM_BUCKET_BITS)     /**< height and width of a bucket */
+#define NB_ITEM_TYPES 5                         /**< FOOD, POPWALL, HIGHSPEED, LOWSPEED, FREEZE */
+#define ITEM_MIN_SLOTS 16                       /**< slots of the table of lists, at least : a power of 2 */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef indexed_item
+* \brief An item in the list of its bucket.
+*/
+struct indexed_item {
+    coord loc;
+    int next;       /**< next item of the list, or next free entry, -1 if none */
+    int tag;        /**< what the item was tagged with, -1 if nothing, see 'item_index_set_tag()' */
+};
+
+/**
+* \typedef item_list
+* \brief A slot of the table of lists of an index.
+*/
+struct item_list {
+    long key;       /**< type and bucket of the list, -1 for a free slot */
+    int head;       /**< first entry of the list */
+};
+
+/**
+* \typedef item_index
+* \brief Items of a field, sorted by type and bucket.
+* \details The lists are chained through 'entries', whose unused entries are
+*          chained from 'free_entry'. The lists holding items are found from
+*          their type and bucket in 'lists', an open addressing table probed
+*          linearly, at most half full : a list that empties leaves it.
+*          Adding and removing items allocates nothing once both grew. They
+*          grow in the session arena given to 'new_item_index()'.
+*/
+struct item_index {
+    int rows;               /**< buckets along the height of the arena */
+    int cols;               /**< buckets along its width */
+    vector<item_list, arena_allocator<item_list> > lists;   /**< every list holding items, a power of 2 slots */
+    int nb_lists;           /**< slots of 'lists' in use */
+    vector<indexed_item, arena_allocator<indexed_item> > entries;
+    int free_entry;         /**< first unused entry, -1 if none */
+    int counts[NB_ITEM_TYPES];  /**< items of every type */
+};
+
+// PROTOTYPES ==========================================================
+item_index* new_item_index(int width, int height, session_arena* arena);
+void free_item_index(item_index* ix);
+void copy_item_index(item_index* to, item_index* from);
+bool is_item(square q);
+void item_index_add(item_index* ix, coord c, square item);
+void item_index_remove(item_index* ix, coord c, square item);
+void item_index_set_tag(item_index* ix, coord c, square item, int tag);
+int item_index_tag(item_index* ix, coord c, square item);
+int items_nearest(item_index* ix, square item, coord c, int k, coord* out);
+int items_within(item_index* ix, square item, coord c, int radius, coord* out, int max);
+
+#endif
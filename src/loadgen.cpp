@@ -0,0 +1,417 @@
+/**
+* \file loadgen.cpp
+* \brief Load generator : many bots playing on the server from a single process.
+* \details Every bot speaks the protocol of 'client.cpp' : it reads the handshake,
+*          then every frame, and sends its turns. Bots steer with an AI of 'AI.cpp'
+*          playing on what the bot sees of the arena. A single thread runs every
+*          bot with 'epoll_wait()'. When its room ends, a bot connects again, so
+*          that the load stays the same during the whole run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>         //for 'atoi()'
+#include <string.h>         //for 'memcpy()'
+#include <strings.h>        //for 'bzero()'
+#include <unistd.h>         //for 'read()'
+#include <errno.h>          //for 'errno'
+#include <time.h>           //for 'clock_gettime()'
+#include <getopt.h>         //for 'getopt()'
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>      //for 'epoll_wait()'
+#include <arpa/inet.h>      //for 'struct sockaddr_in'
+#include <netinet/tcp.h>    //for 'TCP_NODELAY'
+#include <vector>
+
+#include "types.h"
+#include "AI.h"
+#include "world.h"
+#include "net.h"
+#include "stats.h"
+
+#define SERV_ADDR "127.0.0.1"
+#define PORT 3490
+#define NB_BOTS 100         //default number of bots
+#define DURATION 30         //default length of the run, in seconds
+#define AI_VERSION 2        //default AI of the bots
+#define HANDSHAKE_LEN 6     //ints sent by the server before the first frame
+#define READ_CHUNK 65536    //bytes read from a socket at once
+#define MAX_EVENTS 256      //maximum events handled per 'epoll_wait()'
+
+/**
+* \typedef bot
+* \brief A simulated client.
+* \details 'map' is the window of the bot : its viewport plus AOI_MARGIN squares on
+*          every side, surrounded by walls so that the AI never looks further.
+*          Coordinates in 'map' and in 's' are relative to the top left wall.
+*/
+struct bot {
+    int fd;                 /**< socket of the bot, -1 while not connected */
+    vector<char> in;        /**< bytes received and not parsed yet */
+    bool started;           /**< true once the handshake was received */
+    int view_width;         /**< viewport sent in the handshake */
+    int view_height;
+    field* map;             /**< what the bot knows of the arena */
+    coord origin;           /**< top left square of the viewport, in the arena */
+    snake s;                /**< head and direction of the bot's snake, for the AI */
+    int first_tick;         /**< first tick received in this room, -1 if none */
+    int last_tick;          /**< last tick received */
+    long first_frame;       /**< time the first and last frames came, in us */
+    long last_frame;
+    int sent_tick;          /**< tick of the input waiting for its frame, -1 if none */
+    long sent_at;           /**< time the input was sent, in us */
+    histogram rtt;          /**< time between an input and the frame of its tick */
+};
+
+int ai_version = AI_VERSION;
+long nb_frames = 0;         //frames received by every bot
+long nb_bytes = 0;          //bytes received by every bot
+long nb_inputs = 0;         //inputs sent by every bot
+long nb_rooms = 0;          //rooms joined by every bot
+double tick_time = 0;       //sum over rooms of the time between their first and last frames, in s
+long nb_ticks = 0;          //sum over rooms of the ticks received
+volatile bool running = true;
+
+/**
+* \fn long now_us();
+* \returns the time in us given by the monotonic clock
+*/
+long now_us(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/**
+* \fn void stop(int sig);
+* \brief Ends the run early, the report is still printed.
+*/
+void stop(int sig){
+    (void)sig;
+    running = false;
+}
+
+/**
+* \fn long process_cpu(int pid);
+* \returns the cpu time used so far by the process 'pid', in clock ticks. -1 if unknown.
+*/
+long process_cpu(int pid){
+    char path[64];
+    unsigned long utime, stime;
+    FILE* f;
+
+    if(pid <= 0) return -1;
+    snprintf(path, sizeof(path), "/proc/%i/stat", pid);
+    if((f = fopen(path, "r")) == NULL) return -1;
+    //fields 14 and 15 are the user and system times
+    int ret = fscanf(f, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    fclose(f);
+    return (ret == 2) ? (long)(utime + stime) : -1;
+}
+
+/**
+* \fn void end_room(bot* b);
+* \brief Records how fast the room of 'b' ticked, and forgets it.
+*/
+void end_room(bot* b){
+    if(b->first_tick != -1 && b->last_tick > b->first_tick){
+        nb_ticks += b->last_tick - b->first_tick;
+        tick_time += (b->last_frame - b->first_frame) / 1e6;
+    }
+    if(b->map != NULL){
+        free_field(b->map);
+        b->map = NULL;
+    }
+    while(!b->s.body.empty()) b->s.body.pop();
+}
+
+/**
+* \fn bool connect_bot(bot* b, int epfd);
+* \brief Connects 'b' to the server and registers it in 'epfd'.
+* \returns true on success
+*/
+bool connect_bot(bot* b, int epfd){
+    struct sockaddr_in serv;
+    int yes = 1;
+
+    if((b->fd = socket(AF_INET, SOCK_STREAM, 0)) == -1){
+        perror("socket"); return false;
+    }
+    serv.sin_family = AF_INET;
+    serv.sin_port = htons(PORT);
+    inet_aton(SERV_ADDR, (struct in_addr*) &serv.sin_addr.s_addr);
+    bzero(&(serv.sin_zero), 8);
+    if(connect(b->fd, (struct sockaddr*) &serv, sizeof(serv)) == -1){
+        perror("connect");
+        close(b->fd);
+        b->fd = -1;
+        return false;
+    }
+    setsockopt(b->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+    set_nonblocking(b->fd);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = b;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, b->fd, &ev);
+
+    b->in.clear();
+    b->started = false;
+    b->map = NULL;
+    b->first_tick = -1;
+    b->sent_tick = -1;
+    nb_rooms++;
+    return true;
+}
+
+/**
+* \fn void disconnect_bot(bot* b, int epfd);
+* \brief Closes the socket of 'b'.
+*/
+void disconnect_bot(bot* b, int epfd){
+    if(b->fd == -1) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, b->fd, NULL);
+    close(b->fd);
+    b->fd = -1;
+    end_room(b);
+}
+
+/**
+* \fn void scroll(bot* b, coord origin);
+* \brief Moves the window of 'b' so that its viewport starts at 'origin', keeping
+*        what is still inside.
+*/
+void scroll(bot* b, coord origin){
+    int dx = origin.x - b->origin.x;
+    int dy = origin.y - b->origin.y;
+    int x, y;
+
+    if(dx == 0 && dy == 0) return;
+    field* old = new_field(b->map->width, b->map->height, 0, NULL);
+    for(x = 0; x < old->height; x++){
+        for(y = 0; y < old->width; y++){
+            set_square_at(old, new_coord(x, y), get_square_at(b->map, new_coord(x, y)));
+        }
+    }
+    for(x = 1; x < old->height - 1; x++){
+        for(y = 1; y < old->width - 1; y++){
+            bool kept = x + dx >= 1 && x + dx < old->height - 1 && y + dy >= 1 && y + dy < old->width - 1;
+            set_square_at(b->map, new_coord(x, y), kept ? get_square_at(old, new_coord(x + dx, y + dy)) : EMPTY);
+        }
+    }
+    free_field(old);
+    b->origin = origin;
+}
+
+/**
+* \fn void play_frame(bot* b, frame_header* hdr, cell_update* cells);
+* \brief Applies a frame to the window of 'b', and sends the server where the AI
+*        wants to go, if it turns.
+*/
+void play_frame(bot* b, frame_header* hdr, cell_update* cells){
+    long now = now_us();
+    int i;
+
+    //1 - let's measure the time the last input took to be played
+    if(b->sent_tick != -1 && hdr->tick >= b->sent_tick){
+        histogram_add(&b->rtt, now - b->sent_at);
+        b->sent_tick = -1;
+    }
+    if(b->first_tick == -1){
+        b->first_tick = hdr->tick;
+        b->first_frame = now;
+    }
+    b->last_tick = hdr->tick;
+    b->last_frame = now;
+
+    //2 - let's update the window
+    scroll(b, hdr->origin);
+    for(i = 0; i < hdr->nb_cells; i++){
+        int x = cells[i].x - b->origin.x + AOI_MARGIN + 1;
+        int y = cells[i].y - b->origin.y + AOI_MARGIN + 1;
+        if(x < 1 || x >= b->map->height - 1 || y < 1 || y >= b->map->width - 1) continue;
+        set_square_at(b->map, new_coord(x, y), (square)cells[i].content);
+    }
+    if(hdr->dir == DEAD_DIR) return;
+
+    //3 - let's ask the AI where to go
+    while(!b->s.body.empty()) b->s.body.pop();
+    b->s.body.push(new_coord(hdr->head.x - b->origin.x + AOI_MARGIN + 1, hdr->head.y - b->origin.y + AOI_MARGIN + 1));
+    b->s.dir = hdr->dir;
+    direction d = ai_play(ai_version, &b->s, b->map, &b->s);
+    if(d == hdr->dir || d == opposite(hdr->dir) || b->sent_tick != -1) return;
+
+    input_msg msg;
+    msg.tick = hdr->tick + 1;
+    msg.dir = d;
+    if(write(b->fd, &msg, sizeof(input_msg)) == sizeof(input_msg)){
+        b->sent_tick = msg.tick;
+        b->sent_at = now;
+        nb_inputs++;
+    }
+}
+
+/**
+* \fn bool parse(bot* b);
+* \brief Handles every complete message in the bytes received by 'b'.
+* \returns false if the server sent something wrong
+*/
+bool parse(bot* b){
+    size_t pos = 0;
+
+    if(!b->started){
+        if(b->in.size() < HANDSHAKE_LEN*sizeof(int)) return true;
+        int info[HANDSHAKE_LEN];
+        memcpy(info, b->in.data(), sizeof(info));
+        if(info[5] != 1) return false;
+        b->view_width = info[3];
+        b->view_height = info[4];
+        b->map = new_field(b->view_width + 2*AOI_MARGIN + 2, b->view_height + 2*AOI_MARGIN + 2, 0, NULL);
+        for(int x = 0; x < b->map->height; x++){
+            for(int y = 0; y < b->map->width; y++){
+                bool edge = x == 0 || y == 0 || x == b->map->height - 1 || y == b->map->width - 1;
+                set_square_at(b->map, new_coord(x, y), edge ? WALL : EMPTY);
+            }
+        }
+        b->origin = new_coord(0, 0);
+        b->started = true;
+        pos = sizeof(info);
+    }
+
+    while(b->in.size() - pos >= sizeof(frame_header)){
+        frame_header hdr;
+        memcpy(&hdr, b->in.data() + pos, sizeof(frame_header));
+        size_t len = sizeof(frame_header) + hdr.nb_cells*sizeof(cell_update);
+        if(hdr.nb_cells < 0) return false;
+        if(b->in.size() - pos < len) break;
+
+        play_frame(b, &hdr, (cell_update*)(b->in.data() + pos + sizeof(frame_header)));
+        nb_frames++;
+        pos += len;
+    }
+    b->in.erase(b->in.begin(), b->in.begin() + pos);
+    return true;
+}
+
+/**
+* \fn void read_bot(bot* b, int epfd);
+* \brief Reads what the server sent to 'b'. A bot whose room ended joins another one.
+*/
+void read_bot(bot* b, int epfd){
+    char buf[READ_CHUNK];
+    int ret;
+
+    while(b->fd != -1){
+        ret = read(b->fd, buf, sizeof(buf));
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if(ret <= 0 || (b->in.insert(b->in.end(), buf, buf + ret), !parse(b))){
+            disconnect_bot(b, epfd);
+            if(running) connect_bot(b, epfd);
+            return;
+        }
+        nb_bytes += ret;
+    }
+}
+
+void usage(char* name){
+    printf("Usage : %s [-n bots] [-d duration] [-a AI version] [-s server pid]\n", name);
+    printf("  -n  number of bots (default : %i)\n", NB_BOTS);
+    printf("  -d  length of the run in seconds (default : %i)\n", DURATION);
+    printf("  -a  AI steering the bots, between 1 and %i (default : %i)\n", NB_AI_VERSIONS, AI_VERSION);
+    printf("  -s  pid of the server, to report the cpu it uses\n");
+}
+
+int main(int argc, char** argv){
+    int nb_bots = NB_BOTS;
+    int duration = DURATION;
+    int server_pid = -1;
+    int opt, i, e;
+
+    while((opt = getopt(argc, argv, "n:d:a:s:h")) != -1){
+        switch(opt){
+            case 'n': nb_bots = atoi(optarg); break;
+            case 'd': duration = atoi(optarg); break;
+            case 'a': ai_version = atoi(optarg); break;
+            case 's': server_pid = atoi(optarg); break;
+            default: usage(argv[0]); exit(1);
+        }
+    }
+    if(nb_bots < 1 || duration < 1 || ai_version < 1 || ai_version > NB_AI_VERSIONS){
+        usage(argv[0]);
+        exit(1);
+    }
+    signal(SIGINT, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    int epfd = epoll_create1(0);
+    if(epfd == -1){
+        perror("epoll_create1"); exit(1);
+    }
+
+    //1 - let's connect every bot
+    bot* bots = new bot[nb_bots];
+    for(i = 0; i < nb_bots; i++){
+        bots[i].fd = -1;
+        bots[i].map = NULL;
+        init_histogram(&bots[i].rtt);
+        if(!connect_bot(&bots[i], epfd)){
+            printf("Only %i bots could connect.\n", i);
+            nb_bots = i;
+            break;
+        }
+    }
+    printf("%i bots connected, running for %i s.\n", nb_bots, duration);
+
+    //2 - let's play until the end of the run
+    struct epoll_event events[MAX_EVENTS];
+    long start = now_us();
+    long end = start + duration * 1000000L;
+    long cpu_start = process_cpu(server_pid);
+    long own_cpu_start = process_cpu(getpid());
+    long now;
+
+    while(running && (now = now_us()) < end){
+        int nb_events = epoll_wait(epfd, events, MAX_EVENTS, (end - now) / 1000 + 1);
+        if(nb_events == -1){
+            if(errno != EINTR) perror("epoll_wait");
+            continue;
+        }
+        for(e = 0; e < nb_events; e++){
+            read_bot((bot*)events[e].data.ptr, epfd);
+        }
+    }
+    double elapsed = (now_us() - start) / 1e6;
+    long cpu_end = process_cpu(server_pid);
+    long own_cpu_end = process_cpu(getpid());
+
+    //3 - let's report
+    histogram rtt;
+    long worst_p99 = 0;
+    init_histogram(&rtt);
+    for(i = 0; i < nb_bots; i++){
+        bot* b = &bots[i];
+        histogram_merge(&rtt, &b->rtt);
+        if(histogram_percentile(&b->rtt, 0.99) > worst_p99) worst_p99 = histogram_percentile(&b->rtt, 0.99);
+        disconnect_bot(b, epfd);
+    }
+
+    printf("Run of %.1f s with %i bots, %li rooms joined.\n", elapsed, nb_bots, nb_rooms);
+    printf("Tick rate : %.1f ticks/s per room.\n", tick_time > 0 ? nb_ticks / tick_time : 0);
+    printf("Frames : %li, %.0f per second.\n", nb_frames, nb_frames / elapsed);
+    printf("Bytes per tick : %.1f per bot, %.0f for every bot.\n",
+        nb_frames ? (double)nb_bytes / nb_frames : 0, nb_frames ? (double)nb_bytes / nb_frames * nb_bots : 0);
+    printf("Inputs sent : %li.\n", nb_inputs);
+    print_histogram(stdout, "Input to frame", &rtt);
+    printf("Input to frame p90 <= %li us, worst bot p99 <= %li us.\n", histogram_percentile(&rtt, 0.9), worst_p99);
+    if(cpu_start != -1 && cpu_end != -1){
+        printf("Server cpu : %.1f %%.\n", 100.0 * (cpu_end - cpu_start) / sysconf(_SC_CLK_TCK) / elapsed);
+    }
+    double own_cpu = 100.0 * (own_cpu_end - own_cpu_start) / sysconf(_SC_CLK_TCK) / elapsed;
+    printf("Load generator cpu : %.1f %%.%s\n", own_cpu,
+        own_cpu > 80 ? " The bots can't keep up : try fewer bots or a cheaper AI." : "");
+
+    delete[] bots;
+    close(epfd);
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <time.h>           //for 'time()'
 #include <signal.h>         //for 'SIGINT' and 'signal()'
 
+#include "trace.h"          //before game.h, whose 'clear' macro breaks <atomic>
 #include "game.h"
 #include "AI.h"
 
@@ -31,6 +32,7 @@ void instructions(){
 void quit(int sig){
     clear();
     mode_raw(0);
+    trace_stop();
     exit(1);
 }
 
@@ -40,6 +42,7 @@ void quit(int sig){
 */
 int main(){
     signal(SIGINT, quit);
+    trace_start("snake");
 
     clear();
     srand(time(NULL));
@@ -81,12 +84,12 @@ int main(){
                     cfg.timestep = REC_TIME_STEP;
                 }
 
-                printf("Select the version of the AI : between 1 and 6.\n");
+                printf("Select the version of the AI : between 1 and %i.\n", NB_AI_VERSIONS);
                 if(scanf("%i", &(cfg.AI_version)) == 0){
                     printf("Menu error\n");
                     exit(1);
                 }
-                if(cfg.AI_version >= 1 && cfg.AI_version <= 6){
+                if(cfg.AI_version >= 1 && cfg.AI_version <= NB_AI_VERSIONS){
                     play(cfg);
                 }
                 else{
@@ -120,6 +123,7 @@ int main(){
         }
     }
 
+    trace_stop();
     return 0;
 }
 
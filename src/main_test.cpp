@@ -0,0 +1,399 @@
+/**
+* \file main_test.cpp
+* \brief Tests of the timer wheel, of the ring, of the snapshots of a world,
+*        of the items vanishing and of the prediction of the client.
+* \details Every test is deterministic : the games are seeded, the moves come
+*          from 'rand_r()'. The program tells which tests failed, and exits
+*          with 1 if any did.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>         //for 'rand_r()'
+#include <pthread.h>        //for 'pthread_create()'
+#include <sched.h>          //for 'sched_yield()'
+#include <algorithm>        //for 'equal()'
+
+#include "types.h"
+#include "world.h"
+#include "timer_wheel.h"
+#include "spsc_ring.h"
+#include "net.h"
+#include "predict.h"
+
+#define TEST_RING_VALUES 100000     /**< values handed from a thread to another by 'test_ring_threads()' */
+#define TEST_STEPS 30               /**< steps played between a save and a restore */
+#define TEST_GROWTH 10              /**< steps a snake grows for before its prediction starts */
+
+static int nb_failed = 0;
+
+/**
+* \fn void check(bool ok, const char* what);
+* \brief Tells that 'what' failed if 'ok' is false.
+*/
+static void check(bool ok, const char* what){
+    if(ok) return;
+    printf("  FAILED : %s\n", what);
+    nb_failed++;
+}
+
+// Timer wheel =========================================================
+/**
+* \fn void test_wheel();
+* \brief Effects at every level of the wheel, and beyond, fire on their tick
+*        and only then.
+*/
+static void test_wheel(){
+    const int dues[] = {1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 70000, 262143, 262144, 300000};
+    const int nb = sizeof(dues)/sizeof(dues[0]);
+    int fired_at[nb];
+    timer_wheel tw;
+    timed_effect e;
+    int i, t;
+    size_t j;
+
+    printf("Timer wheel :\n");
+    init_timer_wheel(&tw, 0, NULL);
+    for(i = 0; i < nb; i++){
+        e.due = dues[i];
+        e.kind = EFFECT_UNFREEZE;
+        e.target = i;
+        e.value = 0;
+        e.loc = new_coord(0, 0);
+        timer_add(&tw, e);
+        fired_at[i] = -1;
+    }
+
+    vector<timed_effect> waiting;
+    timer_list(&tw, waiting);
+    check((int)waiting.size() == nb, "every effect added is waiting");
+
+    for(t = 1; t <= dues[nb - 1] + 1; t++){
+        int n = timer_advance(&tw);
+        check(n == (int)tw.fired.size(), "'timer_advance()' counts what fired");
+        for(j = 0; j < tw.fired.size(); j++){
+            check(fired_at[tw.fired[j].target] == -1, "an effect fires once");
+            fired_at[tw.fired[j].target] = t;
+        }
+    }
+    for(i = 0; i < nb; i++){
+        check(fired_at[i] == dues[i], "an effect fires on its tick");
+    }
+    check(tw.nb_waiting == 0, "nothing waits once every effect fired");
+
+    //an effect added for the past fires on the next tick
+    e.due = tw.now - 5;
+    e.target = 0;
+    timer_add(&tw, e);
+    check(timer_advance(&tw) == 1 && tw.fired[0].due == tw.now, "a late effect fires on the next tick");
+}
+
+// Ring ================================================================
+/**
+* \fn void test_ring();
+* \brief Values go out of a ring as they went in, across its end, and a full
+*        or empty ring tells it.
+*/
+static void test_ring(){
+    spsc_ring<int, 8> r;
+    int in[12], out[12];
+    int i, round, n;
+
+    printf("Ring :\n");
+    init_ring(&r);
+    check(!ring_try_pop(&r, out), "an empty ring pops nothing");
+    for(i = 0; i < 12; i++){
+        in[i] = i;
+    }
+    check(ring_push_batch(&r, in, 12) == 8, "a ring takes as many values as it holds");
+    check(!ring_try_push(&r, in[0]), "a full ring takes nothing");
+    check(ring_count(&r) == 8, "a full ring counts its values");
+    n = ring_pop_batch(&r, out, 12);
+    check(n == 8, "every value pushed is popped");
+    for(i = 0; i < n; i++){
+        check(out[i] == i, "values are popped in order");
+    }
+
+    //'head' and 'tail' go round the ring many times
+    for(round = 0; round < 100; round++){
+        for(i = 0; i < 5; i++){
+            in[i] = round*5 + i;
+        }
+        check(ring_push_batch(&r, in, 5) == 5, "pushes across the end of the ring");
+        check(ring_pop_batch(&r, out, 3) == 3 && ring_pop_batch(&r, out + 3, 3) == 2, "pops across the end of the ring");
+        for(i = 0; i < 5; i++){
+            check(out[i] == round*5 + i, "values are popped in order across the end of the ring");
+        }
+    }
+}
+
+/**
+* \fn void* ring_producer(void* r_p);
+* \brief Pushes 0 to TEST_RING_VALUES - 1 in the ring 'r_p', by batches of
+*        every size up to 7.
+*/
+static void* ring_producer(void* r_p){
+    spsc_ring<int, 64>* r = (spsc_ring<int, 64>*)r_p;
+    int batch[7];
+    int next = 0, size = 1;
+    int i, n;
+
+    while(next < TEST_RING_VALUES){
+        n = (TEST_RING_VALUES - next < size) ? TEST_RING_VALUES - next : size;
+        for(i = 0; i < n; i++){
+            batch[i] = next + i;
+        }
+        n = ring_push_batch(r, batch, n);
+        if(n == 0) sched_yield();     //the ring is full : let the consumer run
+        next += n;
+        size = size % 7 + 1;
+    }
+    return NULL;
+}
+
+/**
+* \fn void test_ring_threads();
+* \brief Values handed from a thread to another come out in order, none lost.
+*/
+static void test_ring_threads(){
+    static spsc_ring<int, 64> r;
+    pthread_t producer;
+    int out[16];
+    int expected = 0;
+    bool in_order = true;
+    int i, n;
+
+    printf("Ring between two threads :\n");
+    init_ring(&r);
+    pthread_create(&producer, NULL, ring_producer, &r);
+    while(expected < TEST_RING_VALUES){
+        n = ring_pop_batch(&r, out, 16);
+        if(n == 0) sched_yield();
+        for(i = 0; i < n; i++){
+            if(out[i] != expected + i) in_order = false;
+        }
+        expected += n;
+    }
+    pthread_join(producer, NULL);
+    check(in_order, "values come out in the order they went in");
+    check(ring_count(&r) == 0, "the ring is empty once every value came out");
+}
+
+// Snapshots ===========================================================
+/**
+* \fn unsigned long world_hash(world* w);
+* \returns a hash of the arena, of the snakes and of the tick of 'w'
+*/
+static unsigned long world_hash(world* w){
+    unsigned long h = w->tick;
+    int x, y, i;
+
+    for(x = 0; x < w->map->height; x++){
+        for(y = 0; y < w->map->width; y++){
+            h = h*131 + get_square_at(w->map, new_coord(x, y));
+        }
+    }
+    for(i = 0; i < w->nb_snakes; i++){
+        coord head = get_head_coord(w->snakes[i]);
+        h = h*31 + head.x*1000 + head.y + w->dirs[i] + w->snakes[i]->get_size()*7;
+    }
+    return h;
+}
+
+/**
+* \fn void play(world* w, unsigned int* seed, int steps);
+* \brief Plays 'steps' steps of 'w', the snakes turning at random.
+*/
+static void play(world* w, unsigned int* seed, int steps){
+    int t, i;
+
+    for(t = 0; t < steps; t++){
+        for(i = 0; i < w->nb_snakes; i++){
+            if(w->dirs[i] != DEAD_DIR && rand_r(seed) % 3 == 0) w->dirs[i] = (direction)(rand_r(seed) % 4);
+        }
+        world_step(w);
+    }
+}
+
+/**
+* \fn void test_snapshots(int width, int height, int nb_snakes, bool cow);
+* \brief A game goes back to a save, then plays the same steps again : it must
+*        get to the same state. The save is also restored into another world,
+*        out of the copy-on-write mode.
+*/
+static void test_snapshots(int width, int height, int nb_snakes, bool cow){
+    int game, round;
+
+    printf("Snapshots of %ix%i, %i snakes%s :\n", width, height, nb_snakes, cow ? ", copy-on-write" : "");
+    for(game = 0; game < 10; game++){
+        world* w = new_world(width, height, 100, nb_snakes, NULL);
+        world* other = new_world(width, height, 100, nb_snakes, NULL);
+        world_snapshot* snap = new_world_snapshot(w, cow);
+        unsigned int seed = game;
+        w->map->seed = game;
+
+        for(round = 0; round < 8 && w->nb_alive > 0; round++){
+            unsigned int saved_seed = seed;
+            unsigned long before, after;
+
+            world_save(w, snap);
+            before = world_hash(w);
+            play(w, &seed, TEST_STEPS);
+            after = world_hash(w);
+
+            if(!cow){
+                world_restore(other, snap);
+                check(world_hash(other) == before, "another world restored is the world saved");
+            }
+            world_restore(w, snap);
+            check(world_hash(w) == before, "a world restored is the world saved");
+            seed = saved_seed;
+            play(w, &seed, TEST_STEPS);
+            check(world_hash(w) == after, "a world restored plays the same steps again");
+        }
+        free_world_snapshot(snap);
+        free_world(other);
+        free_world(w);
+    }
+}
+
+/**
+* \fn void test_despawn();
+* \brief An item eaten, then replaced by another of the same kind on the same
+*        square, is not taken away when the first one should have vanished.
+*/
+static void test_despawn(){
+    world* w = new_world(60, 25, 100, 1, NULL);
+    coord c = new_coord(12, 30);
+    timed_effect e;
+    int t;
+
+    printf("Items vanishing :\n");
+    e.kind = EFFECT_DESPAWN;
+    e.value = FOOD;
+    e.loc = c;
+
+    //1 - a food pops, then is taken
+    set_square_at(w->map, c, FOOD);
+    item_index_set_tag(w->map->items, c, FOOD, w->tick);
+    e.target = w->tick;
+    e.due = w->tick + 10;
+    timer_add(&w->effects, e);
+    set_square_at(w->map, c, POPWALL);     //nothing else pops there meanwhile
+
+    //2 - another one pops there, a few ticks later
+    for(t = 0; t < 5; t++) world_items(w);
+    set_square_at(w->map, c, FOOD);
+    item_index_set_tag(w->map->items, c, FOOD, w->tick);
+    e.target = w->tick;
+    e.due = w->tick + 10;
+    timer_add(&w->effects, e);
+
+    for(t = 0; t < 5; t++) world_items(w);
+    check(get_square_at(w->map, c) == FOOD, "the second food outlives the first one");
+    for(t = 0; t < 5; t++) world_items(w);
+    check(get_square_at(w->map, c) == EMPTY, "the second food vanishes in its time");
+    free_world(w);
+}
+
+// Prediction ==========================================================
+/**
+* \fn void test_prediction();
+* \brief A client predicting its snake one tick ahead of the frames, the snake
+*        moving twice a tick, knows its real body and never rolls back. The
+*        snake first grows, so that its body is more than its head.
+*/
+static void test_prediction(){
+    const int width = 200, height = 60;
+    int win_width = width + 2*AOI_MARGIN, win_height = height + 2*AOI_MARGIN;
+    bool same_body = true;
+    int nb_rollbacks = 0, nb_frames = 0;
+    int game, x, y;
+
+    printf("Prediction of a snake moving twice a tick :\n");
+    for(game = 0; game < 10; game++){
+        world* w = new_world(width, height, 100, 1, NULL);
+        client_window win;
+        prediction p;
+        unsigned int seed = game;
+        int seen = 0;
+        w->map->seed = game;
+        w->boosts[0] = WORLD_SUBSTEPS - MIN_PERIOD;     //as if it took speed-ups
+        w->periods[0] = MIN_PERIOD;
+        for(x = 0; x < TEST_GROWTH; x++){
+            w->snakes[0]->add_size = true;
+            world_step(w);
+        }
+        win.squares = (square*)malloc(win_width*win_height*sizeof(square));
+        win.origin = new_coord(0, 0);
+        win.view_width = width;
+        win.view_height = height;
+        new_prediction(&p);
+
+        while(w->dirs[0] != DEAD_DIR && w->tick < 200){
+            //1 - the frame of the tick, the window holding the whole arena
+            frame_header hdr;
+            for(x = 0; x < win_height; x++){
+                for(y = 0; y < win_width; y++){
+                    coord c = new_coord(x - AOI_MARGIN, y - AOI_MARGIN);
+                    bool inside = c.x >= 0 && c.y >= 0 && c.x < height && c.y < width;
+                    win.squares[x*win_width + y] = inside ? get_square_at(w->map, c) : EMPTY;
+                }
+            }
+            hdr.tick = w->tick;
+            hdr.flags = 0;
+            hdr.origin = win.origin;
+            hdr.head = get_head_coord(w->snakes[0]);
+            hdr.dir = w->dirs[0];
+            hdr.size = w->snakes[0]->get_size();
+            hdr.period = w->periods[0];
+            hdr.next_move = w->next_moves[0];
+            hdr.nb_cells = 0;
+            bool rolled_back = reconcile(&p, &win, &hdr);
+
+            //the first frame only shows the head : the client sees the rest of
+            //the body as the snake moves on
+            if(++seen > TEST_GROWTH){
+                body_deque& body = body_access::of(w->snakes[0]->body);
+                if(body.size() != p.auth.size() || !equal(body.begin(), body.end(), p.auth.begin(), are_equal)) same_body = false;
+                if(rolled_back) nb_rollbacks++;
+                nb_frames++;
+            }
+
+            //2 - the player turns now and then, the client predicts, then the server steps
+            direction d = w->dirs[0];
+            if(rand_r(&seed) % 6 == 0) d = (direction)(rand_r(&seed) % 4);
+            if(d == opposite(w->snakes[0]->dir)) d = w->snakes[0]->dir;
+            predict_step(&p, &win, d);
+            w->dirs[0] = d;
+            world_step(w);
+        }
+        free(win.squares);
+        free_world(w);
+    }
+    check(nb_frames > 100, "the snakes live long enough to tell");
+    check(same_body, "the real body is every square the snake is on");
+    check(nb_rollbacks == 0, "the prediction agrees with every frame");
+}
+
+/**
+* \fn int main();
+* \brief Runs every test.
+*/
+int main(){
+    test_wheel();
+    test_ring();
+    test_ring_threads();
+    test_snapshots(60, 25, 6, false);
+    test_snapshots(60, 25, 6, true);
+    test_snapshots(300, 200, 12, false);
+    test_snapshots(300, 200, 12, true);
+    test_despawn();
+    test_prediction();
+
+    if(nb_failed > 0){
+        printf("%i checks failed.\n", nb_failed);
+        return 1;
+    }
+    printf("Every test passed.\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/**
+* \file metrics.cpp
+* \brief Serves the measures of a program on a Unix-domain socket.
+*/
+
+#include <stdio.h>          //for 'open_memstream()'
+#include <stdlib.h>         //for 'free()'
+#include <string.h>         //for 'strncpy()'
+#include <unistd.h>         //for 'unlink()'
+#include <poll.h>           //for 'poll()'
+#include <sys/socket.h>     //for 'socket()'
+
+#include "net.h"
+#include "metrics.h"
+
+/**
+* \fn void answer(metrics_endpoint* e, int fd);
+* \brief Sends the measures to the client connected on 'fd'. An HTTP request gets
+*        an HTTP answer, anything else the measures alone.
+*/
+static void answer(metrics_endpoint* e, int fd){
+    struct pollfd pfd;
+    char request[256];
+    int len = 0;
+    char* body = NULL;
+    size_t body_len = 0;
+
+    //1 - let's see if the client says something
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, METRICS_REQUEST_WAIT) == 1){
+        len = read(fd, request, sizeof(request) - 1);
+        if(len < 0) len = 0;
+    }
+    request[len] = '\0';
+
+    //2 - let's write the measures
+    FILE* f = open_memstream(&body, &body_len);
+    if(f == NULL){
+        perror("open_memstream in 'answer()'");
+        return;
+    }
+    e->write(f, e->arg);
+    fclose(f);
+
+    if(strncmp(request, "GET ", 4) == 0){
+        char header[128];
+        int header_len = snprintf(header, sizeof(header),
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", body_len);
+        write_full(fd, header, header_len);
+    }
+    write_full(fd, body, body_len);
+    free(body);
+}
+
+/**
+* \fn void* run_endpoint(void* e_p);
+* \brief Main loop of the endpoint : answers connections one at a time.
+*/
+static void* run_endpoint(void* e_p){
+    metrics_endpoint* e = (metrics_endpoint*)e_p;
+    struct pollfd pfd;
+    int fd;
+
+    pfd.fd = e->fd;
+    pfd.events = POLLIN;
+    while(e->running){
+        if(poll(&pfd, 1, METRICS_POLL) != 1) continue;
+        if((fd = accept(e->fd, NULL, NULL)) == -1){
+            perror("accept in 'run_endpoint()'");
+            continue;
+        }
+        answer(e, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+* \fn metrics_endpoint* new_metrics_endpoint(const char* path, void (*write)(FILE* f, void* arg), void* arg);
+* \brief Creates the socket 'path', replacing any file there, and launches the thread answering on it.
+* \param write called by the endpoint's thread to write the measures, with 'arg'
+* \returns a pointer to the newly created 'metrics_endpoint', NULL if the socket could not be created
+*/
+metrics_endpoint* new_metrics_endpoint(const char* path, void (*write)(FILE* f, void* arg), void* arg){
+    metrics_endpoint* e = new metrics_endpoint;
+    struct sockaddr_un addr;
+
+    if(strlen(path) >= sizeof(e->path)){
+        printf("Metrics socket path too long : %s\n", path);
+        delete e;
+        return NULL;
+    }
+    strncpy(e->path, path, sizeof(e->path));
+    e->write = write;
+    e->arg = arg;
+    e->running = true;
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path));
+    unlink(path);
+    if((e->fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+        || bind(e->fd, (struct sockaddr*)&addr, sizeof(addr)) == -1
+        || listen(e->fd, 16) == -1){
+        perror("creating metrics socket");
+        if(e->fd != -1) close(e->fd);
+        delete e;
+        return NULL;
+    }
+
+    if(pthread_create(&e->thread, 0, run_endpoint, e) != 0){
+        printf("error : could not create thread for the metrics endpoint\n");
+        close(e->fd);
+        unlink(path);
+        delete e;
+        return NULL;
+    }
+    return e;
+}
+
+/**
+* \fn void free_metrics_endpoint(metrics_endpoint* e);
+* \brief Stops the endpoint, removes its socket and frees it.
+*/
+void free_metrics_endpoint(metrics_endpoint* e){
+    e->running = false;
+    pthread_join(e->thread, NULL);
+    close(e->fd);
+    unlink(e->path);
+    delete e;
+}
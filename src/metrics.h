@@ -0,0 +1,39 @@
+/**
+* \file metrics.h
+* \brief Local endpoint serving measures of a running program, in the Prometheus text format.
+* \details The endpoint is a Unix-domain socket. Every connection gets the
+*          measures and is closed : 'curl --unix-socket path http://x/metrics'
+*          gets them over HTTP, 'nc -U path' gets the raw text.
+*/
+
+#ifndef H_METRICS
+#define H_METRICS
+
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include <sys/un.h>         //for 'struct sockaddr_un'
+
+// CONSTANTS ============================================================
+#define METRICS_POLL 200            /**< time in ms the endpoint waits for a connection before checking if it must stop */
+#define METRICS_REQUEST_WAIT 100    /**< time in ms a connection has to send its request */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef metrics_endpoint
+* \brief Thread answering every connection to a Unix-domain socket with the measures.
+*/
+struct metrics_endpoint {
+    pthread_t thread;
+    int fd;                                 /**< listening socket */
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];   /**< where the socket is */
+    void (*write)(FILE* f, void* arg);      /**< writes the measures on 'f' */
+    void* arg;                              /**< given to 'write' */
+    std::atomic<bool> running;              /**< cleared to stop the endpoint */
+};
+
+// PROTOTYPES ==========================================================
+metrics_endpoint* new_metrics_endpoint(const char* path, void (*write)(FILE* f, void* arg), void* arg);
+void free_metrics_endpoint(metrics_endpoint* e);
+
+#endif
@@ -0,0 +1,166 @@
+/**
+* \file net.cpp
+* \brief Helpers used by the server and its clients to talk to each other.
+* \details This file is separated in 2 parts :
+*          1 - functions reading and writing sockets
+*          2 - buffers shared between send queues
+*/
+
+#include <errno.h>      //for 'errno'
+#include <unistd.h>     //for 'read()'
+#include <stdlib.h>     //for 'malloc()'
+#include <fcntl.h>      //for 'fcntl()'
+#include <sys/uio.h>    //for 'writev()'
+
+#include "trace.h"
+#include "net.h"
+
+// Sockets =============================================================
+/**
+* \fn int read_full(int fd, void* buf, int len);
+* \brief Reads exactly 'len' bytes from 'fd', even if they come in several parts.
+* \returns 'len' on success, 0 if 'fd' was closed, -1 on error.
+*/
+int read_full(int fd, void* buf, int len){
+    char* p = (char*)buf;
+    int done = 0;
+    int ret;
+
+    while(done < len){
+        TRACE_BEGIN(start);
+        ret = read(fd, p + done, len - done);
+        TRACE_END_ARG(start, "read", "net", "bytes", ret);
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret <= 0) return ret;
+        done += ret;
+    }
+    return done;
+}
+
+/**
+* \fn int write_full(int fd, const void* buf, int len);
+* \brief Writes exactly 'len' bytes to 'fd', even if the kernel takes them in several parts.
+* \returns 'len' on success, -1 on error.
+*/
+int write_full(int fd, const void* buf, int len){
+    const char* p = (const char*)buf;
+    int done = 0;
+    int ret;
+
+    while(done < len){
+        TRACE_BEGIN(start);
+        ret = write(fd, p + done, len - done);
+        TRACE_END_ARG(start, "write", "net", "bytes", ret);
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret <= 0) return -1;
+        done += ret;
+    }
+    return done;
+}
+
+/**
+* \fn int set_nonblocking(int fd);
+* \brief Makes reads and writes on 'fd' return instead of waiting.
+* \returns 0 on success, -1 on error.
+*/
+int set_nonblocking(int fd){
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags == -1) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Buffers =============================================================
+/**
+* \fn net_buffer* new_net_buffer(int len);
+* \brief Allocates a buffer of 'len' bytes, owned by the caller.
+* \returns a pointer to the newly created 'net_buffer'
+*/
+net_buffer* new_net_buffer(int len){
+    net_buffer* b = (net_buffer*)malloc(sizeof(net_buffer) + len);
+    b->refs = 1;
+    b->len = len;
+    b->data = (char*)(b + 1);
+    return b;
+}
+
+/**
+* \fn void net_buffer_unref(net_buffer* b);
+* \brief Drops a reference to 'b', and frees it if it was the last one.
+*/
+void net_buffer_unref(net_buffer* b){
+    if(--b->refs == 0){
+        free(b);
+    }
+}
+
+/**
+* \fn void new_send_queue(send_queue* q);
+* \brief Initialises 'q' as empty.
+*/
+void new_send_queue(send_queue* q){
+    q->bufs.clear();
+    q->offset = 0;
+    q->bytes = 0;
+}
+
+/**
+* \fn void send_queue_push(send_queue* q, net_buffer* b);
+* \brief Queues 'b' after what 'q' already holds. 'q' takes a reference to 'b'.
+*/
+void send_queue_push(send_queue* q, net_buffer* b){
+    if(b->len == 0) return;
+    b->refs++;
+    q->bufs.push_back(b);
+    q->bytes += b->len;
+}
+
+/**
+* \fn int send_queue_flush(send_queue* q, int fd);
+* \brief Writes as much of 'q' as the non-blocking socket 'fd' takes.
+* \details Buffers are gathered by SEND_IOV in a single 'writev()'. Buffers that
+*          were entirely sent leave the queue, a partly sent one stays first.
+* \returns 1 if 'q' is empty, 0 if the socket is full, -1 on error.
+*/
+int send_queue_flush(send_queue* q, int fd){
+    struct iovec iov[SEND_IOV];
+    int nb, ret;
+
+    while(!q->bufs.empty()){
+        for(nb = 0; nb < SEND_IOV && nb < (int)q->bufs.size(); nb++){
+            iov[nb].iov_base = q->bufs[nb]->data;
+            iov[nb].iov_len = q->bufs[nb]->len;
+        }
+        iov[0].iov_base = (char*)iov[0].iov_base + q->offset;
+        iov[0].iov_len -= q->offset;
+
+        TRACE_BEGIN(start);
+        ret = writev(fd, iov, nb);
+        TRACE_END_ARG(start, "writev", "net", "bytes", ret);
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if(ret <= 0) return -1;
+
+        q->bytes -= ret;
+        ret += q->offset;
+        while(!q->bufs.empty() && ret >= q->bufs.front()->len){
+            ret -= q->bufs.front()->len;
+            net_buffer_unref(q->bufs.front());
+            q->bufs.pop_front();
+        }
+        q->offset = ret;
+    }
+    return 1;
+}
+
+/**
+* \fn void send_queue_clear(send_queue* q);
+* \brief Forgets what is left to send in 'q'.
+*/
+void send_queue_clear(send_queue* q){
+    while(!q->bufs.empty()){
+        net_buffer_unref(q->bufs.front());
+        q->bufs.pop_front();
+    }
+    q->offset = 0;
+    q->bytes = 0;
+}
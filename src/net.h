@@ -0,0 +1,100 @@
+/**
+* \file net.h
+* \brief What the server and its clients send each other during a game.
+*/
+
+#ifndef H_NET
+#define H_NET
+
+#include <deque>
+#include <limits.h>     //for 'SHRT_MAX'
+
+#include "types.h"
+
+// CONSTANTS ============================================================
+#define AOI_MARGIN 4    /**< squares a client receives around its viewport */
+#define MAX_INPUT_LEAD 8    /**< how many ticks ahead of the server an input can be meant for */
+#define FRAME_KEYFRAME 1    /**< flag of a frame describing the whole window, not only what changed */
+#define SEND_IOV 64         /**< maximum buffers given to a single 'writev()' */
+#define NET_MAX_SIDE SHRT_MAX   /**< widest and tallest arena a 'cell_update' can tell a square of */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef frame_header
+* \brief First part of the frame a client receives every tick.
+* \details The client only knows about its window : its viewport plus AOI_MARGIN
+*          squares on every side. The viewport has the size sent in the handshake.
+*          Some of the updates following the header can be outside of the window :
+*          the client ignores them.
+*/
+struct frame_header {
+    int tick;           /**< tick the frame describes */
+    int flags;          /**< FRAME_KEYFRAME or 0 */
+    coord origin;       /**< top left square of the viewport, in the arena */
+    coord head;         /**< head of the client's snake, in the arena */
+    direction dir;      /**< direction of the client's snake, DEAD_DIR once dead */
+    int size;           /**< size of the client's snake */
+    int period;         /**< sub-steps between two moves of the client's snake, see 'world' */
+    int next_move;      /**< sub-step the client's snake moves next at */
+    int nb_cells;       /**< number of 'cell_update' following the header */
+};
+
+/**
+* \typedef cell_update
+* \brief New content of a square of the arena.
+* \details Squares are told on shorts : an arena played over network is at
+*          most NET_MAX_SIDE wide and tall.
+*/
+struct cell_update {
+    short x;            /**< row, in the arena */
+    short y;            /**< column, in the arena */
+    char content;       /**< new 'square' */
+};
+
+/**
+* \typedef input_msg
+* \brief What a client sends when its player turns.
+* \details 'tick' is the tick at which the player wants to turn : the client
+*          runs ahead of the server and already displays the turn.
+*/
+struct input_msg {
+    int tick;           /**< tick whose step must use 'dir' */
+    direction dir;      /**< new direction of the player's snake */
+};
+
+/**
+* \typedef net_buffer
+* \brief Bytes ready to be sent, shared by every send queue they were pushed to.
+* \details The buffer is freed when the last reference is dropped. References
+*          are not atomic : a buffer belongs to a single thread.
+*/
+struct net_buffer {
+    int refs;           /**< number of owners of the buffer */
+    int len;            /**< size of 'data' */
+    char* data;         /**< bytes to send, allocated with the buffer */
+};
+
+/**
+* \typedef send_queue
+* \brief Buffers waiting to be written to a non-blocking socket.
+*/
+struct send_queue {
+    deque<net_buffer*> bufs;    /**< buffers to send, in order */
+    int offset;                 /**< bytes of the first buffer already sent */
+    long bytes;                 /**< bytes waiting to be sent */
+};
+
+// PROTOTYPES ==========================================================
+int read_full(int fd, void* buf, int len);
+int write_full(int fd, const void* buf, int len);
+int set_nonblocking(int fd);
+
+net_buffer* new_net_buffer(int len);
+void net_buffer_unref(net_buffer* b);
+
+void new_send_queue(send_queue* q);
+void send_queue_push(send_queue* q, net_buffer* b);
+int send_queue_flush(send_queue* q, int fd);
+void send_queue_clear(send_queue* q);
+
+#endif
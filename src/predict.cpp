@@ -0,0 +1,263 @@
+/**
+* \file predict.cpp
+* \brief Client-side prediction of the player's own snake.
+* \details This file is separated in 2 parts :
+*          1 - functions operating on the window of the client
+*          2 - functions predicting the snake and reconciling with the server
+*/
+
+#include <stdlib.h>         //for 'abs()'
+#include <unordered_set>
+
+#include "types.h"
+#include "game.h"
+#include "world.h"
+#include "net.h"
+
+#include "predict.h"
+
+#undef clear    //game.h's screen clearing macro hides the containers' 'clear()'
+
+// Window ==============================================================
+/**
+* \fn int window_index(client_window* w, coord c);
+* \returns the index of the square 'c' of the arena in 'w->squares', -1 if it is outside the window
+*/
+static int window_index(client_window* w, coord c){
+    int win_width = w->view_width + 2*AOI_MARGIN;
+    int x = c.x - w->origin.x + AOI_MARGIN;
+    int y = c.y - w->origin.y + AOI_MARGIN;
+    if(x < 0 || x >= w->view_height + 2*AOI_MARGIN || y < 0 || y >= win_width) return -1;
+    return x*win_width + y;
+}
+
+/**
+* \fn square window_square(client_window* w, coord c);
+* \returns the content of the square 'c' of the arena as last sent by the server.
+*          Squares outside the window are considered EMPTY.
+*/
+square window_square(client_window* w, coord c){
+    int i = window_index(w, c);
+    return (i == -1) ? EMPTY : w->squares[i];
+}
+
+/**
+* \fn void window_draw(client_window* w, coord c, square sq);
+* \brief Displays 'sq' on the square 'c' of the arena, if it is inside the viewport.
+*/
+void window_draw(client_window* w, coord c, square sq){
+    int x = c.x - w->origin.x;
+    int y = c.y - w->origin.y;
+    if(x < 0 || x >= w->view_height || y < 0 || y >= w->view_width) return;
+    print_square(new_coord(x, y), sq);
+}
+
+// Prediction ==========================================================
+/**
+* \fn long long key(coord c);
+* \returns a key identifying 'c', to put coordinates in a hash set
+*/
+static long long key(coord c){
+    return ((long long)c.x << 32) | (unsigned int)c.y;
+}
+
+/**
+* \fn void new_prediction(prediction* p);
+* \brief Initialises 'p'. Nothing is predicted before the first frame.
+*/
+void new_prediction(prediction* p){
+    p->auth.clear();
+    p->pred.clear();
+    p->auth_tick = -1;
+    p->tick = -1;
+    p->dir = DEAD_DIR;
+    p->period = WORLD_SUBSTEPS;
+    p->next_move = -1;
+    p->own = SNAKE;
+    p->overlay.clear();
+    p->nb_rollbacks = 0;
+}
+
+/**
+* \fn void forget_prediction(prediction* p);
+* \brief Forgets our snake, when frames were missed. The next frame restarts the
+*        prediction. What is drawn and the count of rollbacks are kept.
+*/
+void forget_prediction(prediction* p){
+    p->auth.clear();
+    p->pred.clear();
+    p->auth_tick = -1;
+    p->tick = -1;
+    p->dir = DEAD_DIR;
+    p->period = WORLD_SUBSTEPS;
+    p->next_move = -1;
+}
+
+/**
+* \fn bool is_free(prediction* p, client_window* w, coord c);
+* \returns true if the predicted snake can move onto 'c' without dying.
+* \details Our own body is known from the prediction, the rest from the window.
+*          The tail is free since it moves away during the step.
+*/
+static bool is_free(prediction* p, client_window* w, coord c){
+    square sq = window_square(w, c);
+    size_t i;
+
+    if(sq == WALL) return false;
+    for(i = 1; i < p->pred.size(); i++){
+        if(are_equal(p->pred[i], c)) return false;
+    }
+    if(sq == SNAKE || sq == SCHLANGA){
+        for(i = 0; i < p->auth.size(); i++){
+            if(are_equal(p->auth[i], c)) return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+* \fn void predict_step(prediction* p, client_window* w, direction d);
+* \brief Predicts one more tick, our snake taking the 'd' direction.
+* \details Like on the server, the snake moves on every sub-step of the tick it
+*          is due at, and can't turn back into its neck. A snake that would die
+*          is predicted to stay where it is : the server will tell. HIGHSPEED
+*          and LOWSPEED change the pace as they would alone : the next frame
+*          tells the real one.
+*/
+void predict_step(prediction* p, client_window* w, direction d){
+    int sub;
+
+    if(p->dir != DEAD_DIR && !p->pred.empty()){
+        if(d == opposite(p->dir)) d = p->dir;
+
+        for(sub = 1; sub <= WORLD_SUBSTEPS; sub++){
+            int now = p->tick*WORLD_SUBSTEPS + sub;
+            if(now != p->next_move) continue;
+            p->next_move = now + p->period;
+
+            coord head = coord_after_dir(p->pred.back(), d);
+            if(!is_free(p, w, head)) continue;
+            square ahead = window_square(w, head);
+            p->pred.push_back(head);
+            if(ahead != FOOD) p->pred.pop_front();
+            if(ahead == HIGHSPEED && p->period > MIN_PERIOD) p->period--;
+            if(ahead == LOWSPEED && p->period < MAX_PERIOD) p->period++;
+        }
+        p->dir = d;
+    }
+
+    p->tick++;
+    int i = p->tick % PRED_HISTORY;
+    p->inputs[i] = d;
+    p->heads[i] = p->pred.empty() ? new_coord(-1, -1) : p->pred.back();
+    p->sizes[i] = p->pred.size();
+    p->next_moves[i] = p->next_move;
+}
+
+/**
+* \fn void add_moves(prediction* p, coord head);
+* \brief Adds to the real body of our snake every square it moved onto since
+*        the previous frame, to get to 'head'.
+* \details A snake moves up to WORLD_SUBSTEPS times in a tick, always in the
+*          same direction : the squares between the old head and the new one
+*          are in a straight line. A head anywhere else, after frames were
+*          missed, is added alone.
+*/
+static void add_moves(prediction* p, coord head){
+    if(p->auth.empty()){
+        p->auth.push_back(head);
+        return;
+    }
+
+    coord c = p->auth.back();
+    int dx = head.x - c.x, dy = head.y - c.y;
+    int n = abs(dx) + abs(dy);
+    if((dx != 0 && dy != 0) || n > WORLD_SUBSTEPS){
+        p->auth.push_back(head);
+        return;
+    }
+    while(n-- > 0){
+        c.x += (dx > 0) - (dx < 0);
+        c.y += (dy > 0) - (dy < 0);
+        p->auth.push_back(c);
+    }
+}
+
+/**
+* \fn bool reconcile(prediction* p, client_window* w, frame_header* hdr);
+* \brief Takes into account the frame 'hdr', once it is applied to the window.
+* \details If what we predicted for the tick of the frame is what happened,
+*          down to when the snake moves next, the prediction goes on. Otherwise,
+*          the prediction restarts from the frame and the ticks that were
+*          already predicted are played again with the same inputs.
+* \returns true if the prediction had to be rolled back
+*/
+bool reconcile(prediction* p, client_window* w, frame_header* hdr){
+    int i = hdr->tick % PRED_HISTORY;
+    int target = p->tick;
+    int t;
+
+    //1 - let's update the real body of our snake
+    if(p->auth.empty()) p->own = window_square(w, hdr->head);
+    add_moves(p, hdr->head);
+    while((int)p->auth.size() > hdr->size){
+        p->auth.pop_front();
+    }
+    p->auth_tick = hdr->tick;
+
+    //2 - let's check what we predicted for this tick
+    bool predicted = p->tick >= hdr->tick && p->tick - hdr->tick < PRED_HISTORY;
+    if(predicted && hdr->dir != DEAD_DIR
+        && are_equal(p->heads[i], hdr->head) && p->sizes[i] == hdr->size
+        && p->next_moves[i] == hdr->next_move){
+        return false;
+    }
+
+    //3 - let's restart from the frame and play the next ticks again
+    p->pred = p->auth;
+    p->tick = hdr->tick;
+    p->dir = hdr->dir;
+    p->period = hdr->period;
+    p->next_move = hdr->next_move;
+    p->inputs[i] = hdr->dir;
+    p->heads[i] = hdr->head;
+    p->sizes[i] = hdr->size;
+    p->next_moves[i] = hdr->next_move;
+    for(t = hdr->tick + 1; t <= target; t++){
+        predict_step(p, w, p->inputs[t % PRED_HISTORY]);
+    }
+
+    if(predicted && hdr->dir != DEAD_DIR) p->nb_rollbacks++;
+    return predicted;
+}
+
+/**
+* \fn void draw_prediction(prediction* p, client_window* w);
+* \brief Displays our predicted snake over what the server sent.
+* \details The squares drawn by the previous call are drawn back as in the window first.
+*/
+void draw_prediction(prediction* p, client_window* w){
+    unordered_set<long long> predicted;
+    size_t i;
+
+    for(i = 0; i < p->overlay.size(); i++){
+        window_draw(w, p->overlay[i], window_square(w, p->overlay[i]));
+    }
+    p->overlay.clear();
+    if(p->dir == DEAD_DIR) return;
+
+    for(i = 0; i < p->pred.size(); i++){
+        predicted.insert(key(p->pred[i]));
+        if(window_square(w, p->pred[i]) != p->own){
+            window_draw(w, p->pred[i], p->own);
+            p->overlay.push_back(p->pred[i]);
+        }
+    }
+    for(i = 0; i < p->auth.size(); i++){
+        if(predicted.count(key(p->auth[i])) == 0){
+            window_draw(w, p->auth[i], EMPTY);
+            p->overlay.push_back(p->auth[i]);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+* \file predict.h
+*/
+
+#ifndef H_PREDICT
+#define H_PREDICT
+
+#include <deque>
+#include <vector>
+
+#include "types.h"
+#include "net.h"
+
+// CONSTANTS ============================================================
+#define PRED_HISTORY 32     /**< ticks of inputs and predicted states kept by the client.
+                                 Has to be more than MAX_INPUT_LEAD. */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef client_window
+* \brief What a client knows of the arena : its viewport plus AOI_MARGIN squares
+*        on every side, as last sent by the server.
+*/
+struct client_window {
+    square* squares;    /**< content of the window, row after row */
+    coord origin;       /**< top left square of the viewport, in the arena */
+    int view_width;     /**< size of the viewport */
+    int view_height;
+};
+
+/**
+* \typedef prediction
+* \brief The client's guess of where its own snake is, ahead of the server.
+* \details The client moves its snake as soon as its player turns. When a frame
+*          comes, the predicted head for that tick is checked against the real one.
+*          If they differ, the prediction restarts from the frame and the inputs
+*          of the following ticks are played again.
+*          Like on the server, the snake moves on the sub-step clock : once every
+*          'period' sub-steps, WORLD_SUBSTEPS of them a tick. The frames tell
+*          when it moves next.
+*/
+struct prediction {
+    deque<coord> auth;              /**< body of the snake in the last frame, tail first */
+    deque<coord> pred;              /**< predicted body of the snake at 'tick', tail first */
+    int auth_tick;                  /**< tick of the last frame */
+    int tick;                       /**< tick the prediction is at */
+    direction dir;                  /**< predicted direction at 'tick' */
+    int period;                     /**< predicted sub-steps between two moves */
+    int next_move;                  /**< predicted sub-step of the next move */
+    square own;                     /**< square our snake is made of */
+    direction inputs[PRED_HISTORY]; /**< direction used for every tick */
+    coord heads[PRED_HISTORY];      /**< predicted head for every tick */
+    int sizes[PRED_HISTORY];        /**< predicted size for every tick */
+    int next_moves[PRED_HISTORY];   /**< predicted next move for every tick */
+    vector<coord> overlay;          /**< squares drawn differently from the window */
+    int nb_rollbacks;               /**< number of frames that disagreed with the prediction */
+};
+
+// PROTOTYPES ==========================================================
+square window_square(client_window* w, coord c);
+void window_draw(client_window* w, coord c, square sq);
+
+void new_prediction(prediction* p);
+void forget_prediction(prediction* p);
+void predict_step(prediction* p, client_window* w, direction d);
+bool reconcile(prediction* p, client_window* w, frame_header* hdr);
+void draw_prediction(prediction* p, client_window* w);
+
+#endif
@@ -0,0 +1,481 @@
+/**
+* \file replay.cpp
+* \brief Recordings of multiplayer games, and how to play them back.
+* \details This file is separated in 3 parts :
+*          1 - keyframes and packed directions, shared by both sides
+*          2 - functions recording a game
+*          3 - functions playing a recording back
+*
+*          A keyframe is made of a 'keyframe_head', the squares of the field
+*          compressed as (count, square) byte pairs, then for every snake a
+*          'snake_head' followed by its body, tail first, as pairs of shorts,
+*          and the 'timed_effect's still waiting.
+*          The chunk goes on with the number of bits of packed directions,
+*          and the bytes holding them.
+*
+*          For every tick after the keyframe, each snake that was alive at the
+*          previous tick takes 1 bit : 0 if it kept its direction. Otherwise 2
+*          more bits tell its new direction, or that it died.
+*/
+
+#include <stdio.h>          //for 'fopen()'
+#include <stdlib.h>         //for 'malloc()'
+#include <string.h>         //for 'memcpy()'
+#include <unistd.h>         //for 'close()'
+#include <fcntl.h>          //for 'open()'
+#include <sys/mman.h>       //for 'mmap()'
+#include <sys/stat.h>       //for 'fstat()'
+
+#include "types.h"
+#include "world.h"
+
+#include "replay.h"
+
+// Keyframes ===========================================================
+/**
+* \typedef keyframe_head
+* \brief Everything a keyframe holds about the world, but the squares and the snakes.
+*/
+struct keyframe_head {
+    int tick;
+    int nb_alive;
+    unsigned int seed;
+    int speed;
+    int map_len;            /**< bytes of compressed squares following */
+    int nb_effects;         /**< effects following the snakes */
+};
+
+/**
+* \typedef snake_head
+* \brief What a keyframe holds about a snake, before its body.
+*/
+struct snake_head {
+    char type;
+    char dir;               /**< direction the snake last moved in */
+    char next_dir;          /**< direction of the world for the coming step, DEAD_DIR if dead */
+    char add_size;
+    char period;            /**< sub-steps between two of its moves */
+    int next_move;          /**< sub-step it moves next at */
+    char frozen;
+    char boost;
+    int size;               /**< number of coords following */
+};
+
+/**
+* \fn int code_of(direction last, direction d);
+* \returns the 2 bits telling that a snake going 'last' now goes 'd' (different
+*          from 'last'), or died.
+*/
+static int code_of(direction last, direction d){
+    if(d == DEAD_DIR) return 3;
+    return (d > last) ? d - 1 : d;
+}
+
+/**
+* \fn direction dir_of(direction last, int code);
+* \returns the direction told by 'code' for a snake going 'last'.
+*/
+static direction dir_of(direction last, int code){
+    if(code == 3) return DEAD_DIR;
+    return (direction)((code >= last) ? code + 1 : code);
+}
+
+// Recording ===========================================================
+/**
+* \fn void put_bits(replay_writer* rw, int value, int n);
+* \brief Appends the 'n' lowest bits of 'value' to the packed directions.
+*/
+static void put_bits(replay_writer* rw, int value, int n){
+    int i;
+    for(i = 0; i < n; i++){
+        if(rw->nb_bits % 8 == 0) rw->bits.push_back(0);
+        if(value & (1 << i)) rw->bits.back() |= 1 << (rw->nb_bits % 8);
+        rw->nb_bits++;
+    }
+}
+
+/**
+* \fn void end_chunk(replay_writer* rw);
+* \brief Writes the packed directions of the current chunk, if there is one.
+*/
+static void end_chunk(replay_writer* rw){
+    if(rw->index.empty()) return;
+    fwrite(&rw->nb_bits, sizeof(int), 1, rw->f);
+    fwrite(rw->bits.data(), 1, rw->bits.size(), rw->f);
+    rw->bits.clear();
+    rw->nb_bits = 0;
+}
+
+/**
+* \fn void write_keyframe(replay_writer* rw, world* w);
+* \brief Starts a new chunk with the state of 'w'.
+*/
+static void write_keyframe(replay_writer* rw, world* w){
+    field* map = w->map;
+    vector<unsigned char> squares;
+    vector<timed_effect> effects;
+    keyframe_head kh;
+    replay_index_entry e;
+    int x, y, i;
+
+    end_chunk(rw);
+    e.offset = ftell(rw->f);
+    e.tick = w->tick;
+    e.nb_ticks = 0;
+    rw->index.push_back(e);
+
+    //1 - the squares, as runs of the same square
+    for(x = 0; x < map->height; x++){
+        for(y = 0; y < map->width; y++){
+            unsigned char sq = get_square_at(map, new_coord(x, y));
+            size_t n = squares.size();
+            if(n > 0 && squares[n - 1] == sq && squares[n - 2] < 255){
+                squares[n - 2]++;
+            }
+            else{
+                squares.push_back(1);
+                squares.push_back(sq);
+            }
+        }
+    }
+    kh.tick = w->tick;
+    kh.nb_alive = w->nb_alive;
+    kh.seed = map->seed;
+    kh.speed = map->speed;
+    kh.map_len = squares.size();
+    timer_list(&w->effects, effects);
+    kh.nb_effects = effects.size();
+    fwrite(&kh, sizeof(keyframe_head), 1, rw->f);
+    fwrite(squares.data(), 1, squares.size(), rw->f);
+
+    //2 - the snakes
+    for(i = 0; i < w->nb_snakes; i++){
+        snake* s = w->snakes[i];
+        snake_head sh;
+        sh.type = s->type;
+        sh.dir = s->dir;
+        sh.next_dir = w->dirs[i];
+        sh.add_size = s->add_size;
+        sh.period = w->periods[i];
+        sh.next_move = w->next_moves[i];
+        sh.frozen = w->frozen[i];
+        sh.boost = w->boosts[i];
+        sh.size = s->get_size();
+        fwrite(&sh, sizeof(snake_head), 1, rw->f);
+
+        snake_body body = s->body;
+        while(!body.empty()){
+            short c[2] = {(short)body.front().x, (short)body.front().y};
+            fwrite(c, sizeof(short), 2, rw->f);
+            body.pop();
+        }
+        rw->last[i] = w->dirs[i];
+    }
+
+    //3 - what wears off later
+    fwrite(effects.data(), sizeof(timed_effect), effects.size(), rw->f);
+}
+
+/**
+* \fn replay_writer* new_replay_writer(const char* path, world* w, int keyframe_interval);
+* \brief Creates the file 'path' to record the game of 'w', which must not have started.
+* \returns a pointer to the newly created 'replay_writer', NULL if the file can't be
+*          created or the arena is wider or taller than REPLAY_MAX_SIDE
+*/
+replay_writer* new_replay_writer(const char* path, world* w, int keyframe_interval){
+    if(w->map->width > REPLAY_MAX_SIDE || w->map->height > REPLAY_MAX_SIDE){
+        printf("In 'new_replay_writer()' : the arena is too big to be recorded.\n");
+        return NULL;
+    }
+    FILE* f = fopen(path, "wb");
+    if(f == NULL){
+        perror("fopen in 'new_replay_writer()'");
+        return NULL;
+    }
+
+    replay_writer* rw = new replay_writer;
+    rw->f = f;
+    rw->nb_snakes = w->nb_snakes;
+    rw->keyframe_interval = keyframe_interval;
+    rw->last = (direction*)malloc(w->nb_snakes*sizeof(direction));
+    rw->nb_bits = 0;
+
+    replay_header hdr;
+    hdr.magic = REPLAY_MAGIC;
+    hdr.version = REPLAY_VERSION;
+    hdr.width = w->map->width;
+    hdr.height = w->map->height;
+    hdr.timestep = w->map->timestep;
+    hdr.nb_snakes = w->nb_snakes;
+    hdr.keyframe_interval = keyframe_interval;
+    hdr.reserved = 0;
+    fwrite(&hdr, sizeof(replay_header), 1, f);
+
+    return rw;
+}
+
+/**
+* \fn void replay_record(replay_writer* rw, world* w);
+* \brief Records the directions the snakes of 'w' are about to take.
+* \details Has to be called on every tick, once the directions are chosen and
+*          before 'world_step()'.
+*/
+void replay_record(replay_writer* rw, world* w){
+    int i;
+
+    if(rw->index.empty() || w->tick % rw->keyframe_interval == 0){
+        write_keyframe(rw, w);
+    }
+    else{
+        for(i = 0; i < rw->nb_snakes; i++){
+            if(rw->last[i] == DEAD_DIR) continue;
+            if(w->dirs[i] == rw->last[i]){
+                put_bits(rw, 0, 1);
+            }
+            else{
+                put_bits(rw, 1, 1);
+                put_bits(rw, code_of(rw->last[i], w->dirs[i]), 2);
+                rw->last[i] = w->dirs[i];
+            }
+        }
+    }
+    rw->index.back().nb_ticks++;
+}
+
+/**
+* \fn long free_replay_writer(replay_writer* rw);
+* \brief Ends the recording : writes the index and closes the file.
+* \returns the size of the recording, in bytes
+*/
+long free_replay_writer(replay_writer* rw){
+    replay_trailer t;
+
+    end_chunk(rw);
+    t.index_offset = ftell(rw->f);
+    t.nb_entries = rw->index.size();
+    t.magic = REPLAY_MAGIC;
+    fwrite(rw->index.data(), sizeof(replay_index_entry), rw->index.size(), rw->f);
+    fwrite(&t, sizeof(replay_trailer), 1, rw->f);
+
+    long len = ftell(rw->f);
+    fclose(rw->f);
+    free(rw->last);
+    delete rw;
+    return len;
+}
+
+// Playback ============================================================
+/**
+* \fn int get_bits(replay* r, int n);
+* \returns the next 'n' bits of the packed directions of the current chunk
+*/
+static int get_bits(replay* r, int n){
+    int value = 0;
+    int i;
+    for(i = 0; i < n && r->bit < r->nb_bits; i++, r->bit++){
+        if(r->bits[r->bit / 8] & (1 << (r->bit % 8))) value |= 1 << i;
+    }
+    return value;
+}
+
+/**
+* \fn void load_keyframe(replay* r, int chunk);
+* \brief Puts the world of 'r' in the state of the keyframe of 'chunk'.
+*/
+static void load_keyframe(replay* r, int chunk){
+    const char* p = r->data + r->index[chunk].offset;
+    world* w = r->w;
+    field* map = w->map;
+    keyframe_head kh;
+    int x = 0, y = 0, i, j;
+
+    //1 - the world and the squares
+    memcpy(&kh, p, sizeof(keyframe_head));
+    p += sizeof(keyframe_head);
+    w->tick = kh.tick;
+    w->nb_alive = kh.nb_alive;
+    map->seed = kh.seed;
+    map->speed = kh.speed;
+    for(i = 0; i < kh.map_len; i += 2){
+        for(j = 0; j < (unsigned char)p[i] && x < map->height; j++){
+            set_square_at(map, new_coord(x, y), (square)p[i + 1]);
+            if(++y == map->width){
+                y = 0;
+                x++;
+            }
+        }
+    }
+    p += kh.map_len;
+
+    //2 - the snakes
+    for(i = 0; i < w->nb_snakes; i++){
+        snake* s = w->snakes[i];
+        snake_head sh;
+        memcpy(&sh, p, sizeof(snake_head));
+        p += sizeof(snake_head);
+
+        s->type = (t_type)sh.type;
+        s->dir = (direction)sh.dir;
+        s->add_size = sh.add_size;
+        w->dirs[i] = (direction)sh.next_dir;
+        w->periods[i] = sh.period;
+        w->next_moves[i] = sh.next_move;
+        w->frozen[i] = sh.frozen;
+        w->boosts[i] = sh.boost;
+        r->last[i] = w->dirs[i];
+        while(!s->body.empty()) s->body.pop();
+        for(j = 0; j < sh.size; j++){
+            short c[2];
+            memcpy(c, p, sizeof(c));
+            p += sizeof(c);
+            s->body.push(new_coord(c[0], c[1]));
+        }
+    }
+    world_schedule(w);
+
+    //3 - what wears off later, and the tags of the items that will vanish :
+    //the item on a square is the last one that popped there
+    init_timer_wheel(&w->effects, kh.tick, w->map->arena);
+    for(i = 0; i < kh.nb_effects; i++){
+        timed_effect e;
+        memcpy(&e, p, sizeof(timed_effect));
+        p += sizeof(timed_effect);
+        timer_add(&w->effects, e);
+        if(e.kind == EFFECT_DESPAWN && get_square_at(map, e.loc) == e.value
+           && item_index_tag(map->items, e.loc, (square)e.value) < e.target){
+            item_index_set_tag(map->items, e.loc, (square)e.value, e.target);
+        }
+    }
+
+    //4 - the packed directions that follow
+    memcpy(&r->nb_bits, p, sizeof(int));
+    r->bits = (const unsigned char*)p + sizeof(int);
+    r->bit = 0;
+    r->chunk = chunk;
+}
+
+/**
+* \fn void next_tick(replay* r);
+* \brief Steps the world of 'r', then gives its snakes the directions recorded for the new tick.
+* \details A snake the game killed outside of 'world_step()', because its
+*          player left, is killed here too.
+*/
+static void next_tick(replay* r){
+    world* w = r->w;
+    const replay_index_entry* e = &r->index[r->chunk];
+    int i;
+
+    world_step(w);
+    if(w->tick >= e->tick + e->nb_ticks){
+        //end of the chunk : the next one starts with this tick
+        if(r->chunk + 1 < r->nb_entries) load_keyframe(r, r->chunk + 1);
+        return;
+    }
+
+    for(i = 0; i < w->nb_snakes; i++){
+        if(r->last[i] == DEAD_DIR) continue;
+        if(get_bits(r, 1)) r->last[i] = dir_of(r->last[i], get_bits(r, 2));
+
+        if(w->dirs[i] == DEAD_DIR) continue;
+        if(r->last[i] == DEAD_DIR){
+            w->nb_alive--;
+        }
+        w->dirs[i] = r->last[i];
+    }
+}
+
+/**
+* \fn replay* open_replay(const char* path);
+* \brief Maps the recording 'path' in memory.
+* \returns a pointer to the newly created 'replay', NULL if 'path' is not a complete recording
+*/
+replay* open_replay(const char* path){
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd == -1){
+        perror("open in 'open_replay()'");
+        return NULL;
+    }
+    if(fstat(fd, &st) == -1 || st.st_size < (long)(sizeof(replay_header) + sizeof(replay_trailer))){
+        printf("'%s' is not a recording.\n", path);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        perror("mmap in 'open_replay()'");
+        return NULL;
+    }
+
+    replay* r = new replay;
+    r->data = (const char*)data;
+    r->len = st.st_size;
+    r->hdr = (const replay_header*)data;
+
+    replay_trailer t;
+    memcpy(&t, r->data + r->len - sizeof(replay_trailer), sizeof(replay_trailer));
+    if(r->hdr->magic != REPLAY_MAGIC || r->hdr->version != REPLAY_VERSION || t.magic != REPLAY_MAGIC
+        || t.nb_entries < 1 || t.index_offset + t.nb_entries*(long)sizeof(replay_index_entry) > r->len){
+        printf("'%s' is not a complete recording.\n", path);
+        munmap(data, r->len);
+        delete r;
+        return NULL;
+    }
+    r->index = (const replay_index_entry*)(r->data + t.index_offset);
+    r->nb_entries = t.nb_entries;
+    r->first_tick = r->index[0].tick;
+    r->last_tick = r->index[r->nb_entries - 1].tick + r->index[r->nb_entries - 1].nb_ticks;
+    r->w = NULL;
+    r->last = (direction*)malloc(r->hdr->nb_snakes*sizeof(direction));
+    r->chunk = -1;
+    return r;
+}
+
+/**
+* \fn void close_replay(replay* r);
+* \brief Unmaps the recording and frees its world.
+*/
+void close_replay(replay* r){
+    if(r->w != NULL) free_world(r->w);
+    free(r->last);
+    munmap((void*)r->data, r->len);
+    delete r;
+}
+
+/**
+* \fn world* replay_seek(replay* r, int tick);
+* \brief Puts the world of 'r' in the state it had at 'tick', directions for
+*        the coming step included.
+* \details The closest keyframe before 'tick' is loaded, and the game is played
+*          from there. When going forward in the same chunk, the game goes on
+*          from the current tick instead.
+* \returns the world of 'r'. 'tick' is clamped between the first and the last ticks.
+*/
+world* replay_seek(replay* r, int tick){
+    int lo = 0, hi = r->nb_entries - 1;
+
+    if(tick < r->first_tick) tick = r->first_tick;
+    if(tick > r->last_tick) tick = r->last_tick;
+
+    //1 - let's find the last keyframe before 'tick'
+    while(lo < hi){
+        int mid = (lo + hi + 1) / 2;
+        if(r->index[mid].tick <= tick) lo = mid;
+        else hi = mid - 1;
+    }
+
+    //2 - let's load it, unless we are already past it
+    if(r->w == NULL){
+        r->w = new_world(r->hdr->width, r->hdr->height, r->hdr->timestep, r->hdr->nb_snakes, NULL);
+    }
+    if(r->chunk != lo || r->w->tick > tick){
+        load_keyframe(r, lo);
+    }
+
+    //3 - let's play until 'tick'
+    while(r->w->tick < tick){
+        next_tick(r);
+    }
+    return r->w;
+}
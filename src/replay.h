@@ -0,0 +1,113 @@
+/**
+* \file replay.h
+* \brief Recordings of multiplayer games, and how to play them back.
+* \details A game only depends on the seed of its field and on the directions
+*          its snakes took : a recording only stores the directions that changed,
+*          a few bits per tick, and a full keyframe every 'keyframe_interval'
+*          ticks so that any tick can be reached quickly.
+*
+*          File layout :
+*          - a 'replay_header'
+*          - chunks : a keyframe, then the packed directions of the next ticks
+*          - the index : a 'replay_index_entry' per chunk
+*          - a 'replay_trailer'
+*/
+
+#ifndef H_REPLAY
+#define H_REPLAY
+
+#include <stdio.h>
+#include <limits.h>     //for 'SHRT_MAX'
+#include <vector>
+
+#include "types.h"
+#include "world.h"
+
+// CONSTANTS ============================================================
+#define REPLAY_MAGIC 0x4c505253         /**< "SRPL" */
+#define REPLAY_VERSION 3
+#define REPLAY_KEYFRAME_INTERVAL 256    /**< default ticks between two keyframes */
+#define REPLAY_MAX_SIDE SHRT_MAX        /**< widest and tallest arena a recording holds : bodies are kept on shorts */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef replay_header
+* \brief First bytes of a recording : what is needed to create the world.
+*/
+struct replay_header {
+    int magic;              /**< REPLAY_MAGIC */
+    int version;            /**< REPLAY_VERSION */
+    int width;              /**< size of the arena */
+    int height;
+    int timestep;           /**< time between two ticks, in ms */
+    int nb_snakes;
+    int keyframe_interval;  /**< ticks between two keyframes */
+    int reserved;
+};
+
+/**
+* \typedef replay_index_entry
+* \brief Where a chunk starts, and which ticks it holds.
+*/
+struct replay_index_entry {
+    long offset;            /**< position of the keyframe of the chunk in the file */
+    int tick;               /**< tick of the keyframe */
+    int nb_ticks;           /**< ticks recorded in the chunk, the keyframe's included */
+};
+
+/**
+* \typedef replay_trailer
+* \brief Last bytes of a recording, pointing to the index.
+*/
+struct replay_trailer {
+    long index_offset;      /**< position of the index in the file */
+    int nb_entries;         /**< number of chunks */
+    int magic;              /**< REPLAY_MAGIC, absent if the recording was cut */
+};
+
+/**
+* \typedef replay_writer
+* \brief A recording being written, one tick at a time.
+*/
+struct replay_writer {
+    FILE* f;
+    int nb_snakes;
+    int keyframe_interval;
+    direction* last;                        /**< directions recorded for the previous tick */
+    vector<unsigned char> bits;             /**< packed directions of the current chunk */
+    int nb_bits;                            /**< bits used in 'bits' */
+    vector<replay_index_entry> index;       /**< every chunk written so far */
+};
+
+/**
+* \typedef replay
+* \brief A recording mapped in memory, and the world it is played in.
+*/
+struct replay {
+    const char* data;               /**< the whole file */
+    long len;                       /**< size of the file */
+    const replay_header* hdr;
+    const replay_index_entry* index;
+    int nb_entries;
+    int first_tick;                 /**< first and last ticks that can be reached */
+    int last_tick;
+    world* w;                       /**< game at the current tick, NULL before the first seek */
+    direction* last;                /**< directions decoded for the current tick */
+    int chunk;                      /**< chunk the current tick comes from */
+    const unsigned char* bits;      /**< packed directions of 'chunk' */
+    int nb_bits;
+    int bit;                        /**< next bit to decode in 'bits' */
+};
+
+// PROTOTYPES ==========================================================
+// Recording ===========================================================
+replay_writer* new_replay_writer(const char* path, world* w, int keyframe_interval);
+void replay_record(replay_writer* rw, world* w);
+long free_replay_writer(replay_writer* rw);
+
+// Playback ============================================================
+replay* open_replay(const char* path);
+void close_replay(replay* r);
+world* replay_seek(replay* r, int tick);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+* \file replayer.cpp
+* \brief Plays back a game recorded by the server.
+* \details Without option, prints what the recording holds and the arena at its
+*          last tick. '-t' seeks to another tick, '-p' plays the game from there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>         //for 'atoi()'
+#include <unistd.h>         //for 'usleep()'
+#include <getopt.h>         //for 'getopt()'
+
+#include "types.h"
+#include "world.h"
+#include "replay.h"
+
+/**
+* \fn char square_char(square sq);
+* \returns the character 'print_square()' uses to display 'sq'
+*/
+char square_char(square sq){
+    switch(sq){
+        case WALL: return '#';
+        case SNAKE: return 's';
+        case SCHLANGA: return '$';
+        case FOOD: return 'x';
+        case POPWALL: return 'W';
+        case HIGHSPEED: return '>';
+        case LOWSPEED: return '<';
+        case FREEZE: return '*';
+        default: return ' ';
+    }
+}
+
+/**
+* \fn void print_world(world* w);
+* \brief Prints the arena of 'w' and the state of its snakes, without colors.
+*/
+void print_world(world* w){
+    int x, y, i;
+
+    printf("Tick %i, %i snakes alive.\n", w->tick, w->nb_alive);
+    for(x = 0; x < w->map->height; x++){
+        for(y = 0; y < w->map->width; y++){
+            putchar(square_char(get_square_at(w->map, new_coord(x, y))));
+        }
+        putchar('\n');
+    }
+    for(i = 0; i < w->nb_snakes; i++){
+        coord head = get_head_coord(w->snakes[i]);
+        printf("Snake %i : %s, size %i, head (%i, %i).\n", i,
+            w->dirs[i] == DEAD_DIR ? "dead" : "alive", w->snakes[i]->get_size(), head.x, head.y);
+    }
+}
+
+void usage(char* name){
+    printf("Usage : %s [-t tick] [-p] file\n", name);
+    printf("  -t  tick to show (default : the last one)\n");
+    printf("  -p  play the game from this tick, at its speed\n");
+}
+
+int main(int argc, char** argv){
+    int tick = -1;
+    bool play = false;
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:ph")) != -1){
+        switch(opt){
+            case 't': tick = atoi(optarg); break;
+            case 'p': play = true; break;
+            default: usage(argv[0]); exit(1);
+        }
+    }
+    if(optind != argc - 1){
+        usage(argv[0]);
+        exit(1);
+    }
+
+    replay* r = open_replay(argv[optind]);
+    if(r == NULL) exit(1);
+
+    int nb_ticks = r->last_tick - r->first_tick;
+    printf("%ix%i arena, %i snakes, %i ms per tick.\n", r->hdr->width, r->hdr->height, r->hdr->nb_snakes, r->hdr->timestep);
+    printf("Ticks %i to %i, %i keyframes, %li bytes (%.1f per tick).\n", r->first_tick, r->last_tick,
+        r->nb_entries, r->len, nb_ticks > 0 ? (double)r->len / nb_ticks : 0);
+
+    if(tick == -1) tick = r->last_tick;
+    world* w = replay_seek(r, tick);
+    if(!play){
+        print_world(w);
+        close_replay(r);
+        return 0;
+    }
+
+    while(true){
+        printf("\e[1;1H\e[2J");
+        print_world(w);
+        fflush(stdout);
+        if(w->tick >= r->last_tick) break;
+        usleep(r->hdr->timestep * 1000);
+        w = replay_seek(r, w->tick + 1);
+    }
+    close_replay(r);
+    return 0;
+}
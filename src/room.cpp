@@ -0,0 +1,1146 @@
+/**
+* \file room.cpp
+* \brief Rooms hosting many independent games in a single server process.
+* \details This file is separated in 3 parts :
+*          1 - functions running a single room
+*          2 - the workers, each one running the ticks of its rooms
+*          3 - the manager, dispatching players into rooms and rooms onto workers
+*/
+
+#include <stdio.h>          //for 'printf()'
+#include <stdlib.h>         //for 'malloc()'
+#include <errno.h>          //for 'errno'
+#include <string.h>         //for 'memcpy()'
+#include <unistd.h>         //for 'read()'
+#include <sys/epoll.h>      //for 'epoll_wait()'
+#include <sys/eventfd.h>    //for 'eventfd()'
+#include <sys/timerfd.h>    //for 'timerfd_create()'
+
+#include "types.h"
+#include "AI.h"
+#include "world.h"
+#include "interest.h"
+#include "net.h"
+#include "stats.h"
+#include "spectate.h"
+#include "trace.h"
+
+#include "room.h"
+
+//names of the 'room_phase', as they are shown in the measures
+static const char* room_phase_names[NB_ROOM_PHASES] = {"read", "input", "ai", "record", "move", "items", "publish", "send"};
+
+// Time helpers ========================================================
+/**
+* \fn void add_ms(struct timespec* t, int ms);
+* \brief Adds 'ms' milliseconds to 't'.
+*/
+static void add_ms(struct timespec* t, int ms){
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (long)(ms % 1000) * 1000000;
+    if(t->tv_nsec >= 1000000000){
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+* \fn long us_since(struct timespec t, struct timespec now);
+* \returns The time in us between 't' and 'now'. Negative if 't' is after 'now'.
+*/
+static long us_since(struct timespec t, struct timespec now){
+    return (now.tv_sec - t.tv_sec) * 1000000L + (now.tv_nsec - t.tv_nsec) / 1000;
+}
+
+/**
+* \fn void arm_timer(room* r, int period);
+* \brief Makes the timer of 'r' expire at 'r->deadline', then every 'period' ms
+*        if 'period' is not 0.
+* \details Expirations are absolute : a late tick doesn't delay the next ones.
+*/
+static void arm_timer(room* r, int period){
+    struct itimerspec its;
+    its.it_value = r->deadline;
+    its.it_interval.tv_sec = period / 1000;
+    its.it_interval.tv_nsec = (long)(period % 1000) * 1000000;
+    if(timerfd_settime(r->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1){
+        perror("timerfd_settime in 'arm_timer()'");
+    }
+}
+
+// Rollback ============================================================
+/**
+* \fn void apply_dirs(room* r, world* w, int step, vector<chosen_dir>& dirs);
+* \brief Gives the snakes of 'w' the directions of 'dirs', before 'step'. The
+*        snakes of the players that left before 'step' die.
+* \details 'w' is the world of 'r', or a world 'r' is recorded from.
+*/
+static void apply_dirs(room* r, world* w, int step, vector<chosen_dir>& dirs){
+    size_t i;
+
+    for(i = 0; i < r->players.size(); i++){
+        room_player* p = r->players[i];
+        if(p->left_at != -1 && p->left_at <= step && w->dirs[p->id] != DEAD_DIR){
+            w->dirs[p->id] = DEAD_DIR;
+            w->nb_alive--;
+        }
+    }
+    for(i = 0; i < dirs.size(); i++){
+        if(w->dirs[dirs[i].id] != DEAD_DIR) w->dirs[dirs[i].id] = dirs[i].dir;
+    }
+}
+
+/**
+* \fn void record_final(room* r, tick_record* rec);
+* \brief Records the step of 'rec', which can't be played again anymore.
+*/
+static void record_final(room* r, tick_record* rec){
+    world_restore(r->replayed, rec->snap);
+    apply_dirs(r, r->replayed, rec->tick, rec->inputs);
+    apply_dirs(r, r->replayed, rec->tick, rec->ai);
+    replay_record(r->rec, r->replayed);
+}
+
+/**
+* \fn tick_record* save_step(room* r);
+* \brief Saves the world of 'r' before the inputs of the coming step. The
+*        step it replaces in the history is recorded if the game is.
+* \returns the record of the coming step
+*/
+static tick_record* save_step(room* r){
+    int step = r->w->tick + 1;
+    tick_record* rec = &r->history[step % r->cfg.rollback];
+
+    if(rec->tick != -1 && r->replayed != NULL){
+        record_final(r, rec);
+    }
+    rec->tick = step;
+    world_save(r->w, rec->snap);
+    rec->inputs.clear();
+    rec->ai.clear();
+    return rec;
+}
+
+/**
+* \fn void roll_back(room_worker* wk, room* r, int from);
+* \brief Plays again every step since 'from', after some of their inputs came
+*        late. What the players were already sent of the squares that changed
+*        is corrected on the next frame.
+* \details The snakes take the directions they took, or were asked to take, at
+*          every step : AI snakes do not decide again. The squares the steps
+*          set are not logged, only the squares that differ at the end are.
+*/
+static void roll_back(room_worker* wk, room* r, int from){
+    world* w = r->w;
+    vector<coord>* changes = w->map->changes;
+    int last = w->tick;
+    int step;
+
+    TRACE_BEGIN(start);
+    world_save(w, r->present);
+    w->map->changes = NULL;
+    world_restore(w, r->history[from % r->cfg.rollback].snap);
+    for(step = from; step <= last; step++){
+        tick_record* rec = &r->history[step % r->cfg.rollback];
+        if(step > from) world_save(w, rec->snap);
+        apply_dirs(r, w, step, rec->inputs);
+        apply_dirs(r, w, step, rec->ai);
+        world_step(w);
+    }
+    w->map->changes = changes;
+    int nb = world_diff(w, r->present, *changes);
+    TRACE_END_ARG(start, "rollback", "room", "steps", last - from + 1);
+
+    r->rollbacks++;
+    r->corrections += nb;
+    wk->rollbacks.store(wk->rollbacks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    wk->corrections.store(wk->corrections.load(memory_order_relaxed) + nb, memory_order_relaxed);
+}
+
+/**
+* \fn void free_history(room* r);
+* \brief Records the steps of the history of 'r' the game is not recorded up
+*        to yet, and frees it.
+*/
+static void free_history(room* r){
+    int step;
+
+    if(r->history == NULL) return;
+    if(r->replayed != NULL){
+        for(step = r->w->tick - r->cfg.rollback + 1; step <= r->w->tick; step++){
+            tick_record* rec = &r->history[step % r->cfg.rollback];
+            if(step >= 0 && rec->tick == step) record_final(r, rec);
+        }
+        free_world(r->replayed);
+        r->replayed = NULL;
+    }
+    for(int i = 0; i < r->cfg.rollback; i++){
+        free_world_snapshot(r->history[i].snap);
+    }
+    delete[] r->history;
+    free_world_snapshot(r->present);
+    r->history = NULL;
+    r->present = NULL;
+}
+
+// Rooms ===============================================================
+/**
+* \fn room* new_room(room_manager* m);
+* \brief Creates a room waiting for players, with the configuration of 'm'. Called with the lock of 'm' held.
+*/
+static room* new_room(room_manager* m){
+    room* r = new room;
+    r->id = m->next_room_id++;
+    r->cfg = m->cfg;
+    r->state = ROOM_WAITING;
+    r->bots_only = false;
+    r->w = NULL;
+    r->rec = NULL;
+    r->cast = NULL;
+    r->timer_fd = -1;
+    r->overruns = 0;
+    r->history = NULL;
+    r->present = NULL;
+    r->replayed = NULL;
+    r->arena = NULL;
+    r->rollbacks = 0;
+    r->corrections = 0;
+    init_histogram(&r->jitter);
+    init_histogram(&r->duration);
+    char name[32];
+    snprintf(name, sizeof(name), "room %i", r->id);
+    init_phase_timer(&r->phases, name, room_phase_names, NB_ROOM_PHASES);
+    return r;
+}
+
+/**
+* \fn snake* nearest_enemy(room* r, int id);
+* \returns The living snake whose head is the closest to the head of snake 'id'.
+*/
+static snake* nearest_enemy(room* r, int id){
+    int enemy = interest_nearest_snake(r->g, r->w, id);
+    return r->w->snakes[enemy == -1 ? id : enemy];
+}
+
+/**
+* \fn int ai_version_of(room* r, int id);
+* \returns the version of the AI driving snake 'id' of 'r'
+*/
+static int ai_version_of(room* r, int id){
+    if(r->cfg.ai_version != 0) return r->cfg.ai_version;
+    return 1 + id % NB_AI_VERSIONS;
+}
+
+/**
+* \fn int place_view(int origin, int head, int view, int arena);
+* \brief Moves a viewport of size 'view' starting at 'origin' on an arena of size 'arena'
+*        along one axis, so that it keeps showing 'head'.
+* \details The viewport only moves when the head gets in its outer quarters, and
+*          then recenters on it. This way, most ticks the client does not scroll.
+* \returns the new origin of the viewport
+*/
+static int place_view(int origin, int head, int view, int arena){
+    if(view >= arena) return 0;
+    if(head < origin + view / 4 || head >= origin + view - view / 4){
+        origin = head - view / 2;
+    }
+    if(origin < 0) origin = 0;
+    if(origin > arena - view) origin = arena - view;
+    return origin;
+}
+
+/**
+* \fn void kill_player(room_worker* wk, room_player* p);
+* \brief Closes the socket of 'p'. If its game is running, its snake dies. If
+*        its room is still the lobby, its place there is free again.
+*/
+static void kill_player(room_worker* wk, room_player* p){
+    if(p->fd == -1) return;
+
+    epoll_ctl(wk->epfd, EPOLL_CTL_DEL, p->fd, NULL);
+    close(p->fd);
+    p->fd = -1;
+    send_queue_clear(&p->out);
+
+    if(p->r->state == ROOM_WAITING){
+        room_manager* m = wk->m;
+        pthread_mutex_lock(&m->lock);
+        if(m->lobby == p->r) m->lobby_count--;
+        pthread_mutex_unlock(&m->lock);
+    }
+
+    world* w = p->r->w;
+    p->left_at = (w != NULL) ? w->tick + 1 : 0;
+    if(w != NULL && w->dirs[p->id] != DEAD_DIR){
+        w->dirs[p->id] = DEAD_DIR;
+        w->nb_alive--;
+    }
+}
+
+/**
+* \fn void flush_player(room_worker* wk, room_player* p);
+* \brief Sends 'p' what its socket takes of its send queue. The worker is told
+*        when the socket can take more. A player we can't write to is disconnected.
+*/
+static void flush_player(room_worker* wk, room_player* p){
+    if(p->fd == -1) return;
+
+    int ret = send_queue_flush(&p->out, p->fd);
+    if(ret == -1){
+        printf("Room %i : player %i left.\n", p->r->id, p->id);
+        kill_player(wk, p);
+        return;
+    }
+    if((ret == 0) != p->writing){
+        struct epoll_event ev;
+        p->writing = (ret == 0);
+        ev.events = p->writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.ptr = &p->src;
+        epoll_ctl(wk->epfd, EPOLL_CTL_MOD, p->fd, &ev);
+    }
+}
+
+/**
+* \fn void write_player(room_worker* wk, room_player* p, void* buf, int len);
+* \brief Queues a copy of the 'len' bytes of 'buf' for 'p', and sends what can be.
+*/
+static void write_player(room_worker* wk, room_player* p, void* buf, int len){
+    if(p->fd == -1) return;
+
+    net_buffer* b = new_net_buffer(len);
+    memcpy(b->data, buf, len);
+    send_queue_push(&p->out, b);
+    net_buffer_unref(b);
+    flush_player(wk, p);
+}
+
+/**
+* \fn void start_room(room_worker* wk, room* r, struct timespec now);
+* \brief Creates the game of 'r', fills it with AI if asked to, and sends
+*        every player the info about the game followed by the start signal.
+*/
+static void start_room(room_worker* wk, room* r, struct timespec now){
+    int nb_humans = r->players.size();
+    int nb_snakes = r->cfg.ai_fill ? r->cfg.max_players : nb_humans;
+    int info[6];
+    size_t i;
+
+    //the game is made in a session arena, one of a previous room if there is one
+    if(!wk->spare_arenas.empty()){
+        r->arena = wk->spare_arenas.back();
+        wk->spare_arenas.pop_back();
+    }
+    else{
+        r->arena = new_session_arena();
+    }
+    r->w = new_world(r->cfg.width, r->cfg.height, r->cfg.timestep, nb_snakes, r->arena);
+    r->play = ai_engine(r->cfg.width, r->cfg.height);
+    r->g = new_interest_grid(r->w);
+    r->rec = NULL;
+    if(r->cfg.record_dir != NULL){
+        char path[256];
+        snprintf(path, sizeof(path), "%s/room-%li-%i.rpl", r->cfg.record_dir, (long)time(NULL), r->id);
+        r->rec = new_replay_writer(path, r->w, REPLAY_KEYFRAME_INTERVAL);
+        if(r->rec != NULL) printf("Room %i : recording the game in %s.\n", r->id, path);
+    }
+    if(r->cfg.rollback > 0){
+        r->history = new tick_record[r->cfg.rollback];
+        for(i = 0; i < (size_t)r->cfg.rollback; i++){
+            r->history[i].tick = -1;
+            r->history[i].snap = new_world_snapshot(r->w, false);
+        }
+        r->present = new_world_snapshot(r->w, false);
+        if(r->rec != NULL) r->replayed = new_world(r->cfg.width, r->cfg.height, r->cfg.timestep, nb_snakes, r->arena);
+    }
+    r->cast = (wk->m->hub != NULL) ? spectate_open(wk->m->hub, r->w, r->id) : NULL;
+    r->view_width = (r->cfg.view_width <= 0 || r->cfg.view_width > r->cfg.width) ? r->cfg.width : r->cfg.view_width;
+    r->view_height = (r->cfg.view_height <= 0 || r->cfg.view_height > r->cfg.height) ? r->cfg.height : r->cfg.view_height;
+    r->state = ROOM_RUNNING;
+    r->deadline = now;
+    add_ms(&r->deadline, r->cfg.timestep);
+    arm_timer(r, r->cfg.timestep);
+
+    for(i = 0; i < r->players.size(); i++){
+        room_player* p = r->players[i];
+        p->origin = new_coord(-r->view_height, -r->view_width);   //recentered on the first frame
+        p->window = new_area(0, 0, 0, 0);
+        if(p->fd == -1){
+            //player left during the lobby
+            r->w->dirs[p->id] = DEAD_DIR;
+            r->w->nb_alive--;
+            continue;
+        }
+        info[0] = r->cfg.size;
+        info[1] = nb_snakes;
+        info[2] = p->id;
+        info[3] = r->view_width;
+        info[4] = r->view_height;
+        info[5] = 1;    //start signal
+        write_player(wk, p, info, sizeof(info));
+    }
+
+    printf("Room %i started on worker %i with %i players (%i AI).\n",
+        r->id, wk->id, nb_snakes, nb_snakes - nb_humans);
+}
+
+/**
+* \fn void end_room(room_worker* wk, room* r);
+* \brief Disconnects every player of 'r', frees its game and prints how well its ticks were kept.
+* \details The last frame is sent to the players that can take it right away.
+*          The room and its players are freed by 'free_room()'.
+*/
+static void end_room(room_worker* wk, room* r){
+    size_t i;
+
+    if(r->timer_fd != -1){
+        epoll_ctl(wk->epfd, EPOLL_CTL_DEL, r->timer_fd, NULL);
+        close(r->timer_fd);
+        r->timer_fd = -1;
+    }
+    if(r->w != NULL){
+        char name[64];
+        printf("Room %i : %li ticks overran.\n", r->id, r->overruns);
+        if(r->history != NULL){
+            printf("Room %i : %li rollbacks for late inputs, %li squares corrected.\n", r->id, r->rollbacks, r->corrections);
+        }
+        snprintf(name, sizeof(name), "Room %i tick jitter", r->id);
+        print_histogram(stdout, name, &r->jitter);
+        snprintf(name, sizeof(name), "Room %i tick duration", r->id);
+        print_histogram(stdout, name, &r->duration);
+        print_phase_timer(stdout, &r->phases);
+        free_history(r);
+    }
+
+    //the players are freed with the room : events about them may still be
+    //waiting in the worker's batch
+    for(i = 0; i < r->players.size(); i++){
+        flush_player(wk, r->players[i]);
+        kill_player(wk, r->players[i]);
+    }
+    if(r->rec != NULL){
+        printf("Room %i : recording of %li bytes saved.\n", r->id, free_replay_writer(r->rec));
+        r->rec = NULL;
+    }
+    if(r->cast != NULL){
+        spectate_close(r->cast);
+        r->cast = NULL;
+    }
+    if(r->w != NULL){
+        free_interest_grid(r->g);
+        free_world(r->w);
+    }
+    r->w = NULL;
+
+    //whatever the game was made of goes at once with its arena, kept for the next room
+    if(r->arena != NULL){
+        arena_reset(r->arena);
+        if(wk->spare_arenas.size() < SPARE_ARENAS) wk->spare_arenas.push_back(r->arena);
+        else free_session_arena(r->arena);
+        r->arena = NULL;
+    }
+    r->state = ROOM_FINISHED;
+}
+
+/**
+* \fn void free_room(room* r);
+* \brief Frees 'r' and its players, once 'end_room()' ended it.
+*/
+static void free_room(room* r){
+    size_t i;
+    for(i = 0; i < r->players.size(); i++){
+        delete r->players[i];
+    }
+    for(i = 0; i < r->left.size(); i++){
+        delete r->left[i];
+    }
+    delete r;
+}
+
+/**
+* \fn void read_player(room_worker* wk, room_player* p);
+* \brief Reads the inputs sent by 'p', and keeps them until their tick comes.
+* \details An input can come in several parts : what came is kept until the rest comes.
+*/
+static void read_player(room_worker* wk, room_player* p){
+    input_msg in;
+    int ret;
+
+    while(p->fd != -1){
+        TRACE_BEGIN(start);
+        ret = read(p->fd, p->in_buf + p->in_len, sizeof(input_msg) - p->in_len);
+        TRACE_END_ARG(start, "read", "net", "bytes", ret);
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if(ret <= 0){
+            printf("Room %i : player %i left.\n", p->r->id, p->id);
+            kill_player(wk, p);
+            return;
+        }
+
+        p->in_len += ret;
+        if(p->in_len < (int)sizeof(input_msg)) continue;
+        p->in_len = 0;
+        memcpy(&in, p->in_buf, sizeof(input_msg));
+
+        if(p->r->w == NULL || in.dir < UP || in.dir > RIGHT) continue;
+        if(p->inputs.size() >= MAX_INPUT_LEAD){
+            //the player sends more than one input per tick
+            p->inputs.pop();
+        }
+        p->inputs.push(in);
+    }
+}
+
+/**
+* \fn void take_inputs(room_worker* wk, room* r);
+* \brief Gives every player's snake the direction its player asked for the coming tick.
+* \details Inputs meant for a later tick are kept. Inputs that came late for a
+*          step still in the history of the room are given to that step, and
+*          every step since is played again. Older ones are used as soon as
+*          possible. Inputs stamped too far ahead are not trusted and used now.
+*/
+static void take_inputs(room_worker* wk, room* r){
+    world* w = r->w;
+    int next_tick = w->tick + 1;
+    int late_from = next_tick;
+    size_t i;
+
+    //1 - let's sort the inputs
+    wk->inputs.clear();
+    for(i = 0; i < r->players.size(); i++){
+        room_player* p = r->players[i];
+        while(!p->inputs.empty()){
+            input_msg in = p->inputs.front();
+            if(in.tick > next_tick && in.tick <= next_tick + MAX_INPUT_LEAD) break;
+            p->inputs.pop();
+            chosen_dir c = {p->id, in.dir};
+            if(r->history != NULL && in.tick < next_tick && in.tick >= 0
+                && r->history[in.tick % r->cfg.rollback].tick == in.tick){
+                r->history[in.tick % r->cfg.rollback].inputs.push_back(c);
+                if(in.tick < late_from) late_from = in.tick;
+            }
+            else{
+                wk->inputs.push_back(c);
+            }
+        }
+    }
+
+    //2 - let's play again what the late inputs change
+    if(late_from < next_tick){
+        roll_back(wk, r, late_from);
+    }
+
+    //3 - let's give the snakes the inputs of the coming step
+    if(r->history != NULL){
+        save_step(r)->inputs = wk->inputs;
+    }
+    for(i = 0; i < wk->inputs.size(); i++){
+        if(w->dirs[wk->inputs[i].id] != DEAD_DIR){
+            //if player's move is valid and if he's not dead
+            w->dirs[wk->inputs[i].id] = wk->inputs[i].dir;
+        }
+    }
+}
+
+/**
+* \fn void send_frame(room_worker* wk, room* r, room_player* p);
+* \brief Queues for 'p' the frame of the tick that was just played : the state of
+*        its snake, the squares it sees for the first time, and the buffers of the
+*        buckets that changed in the part of its window it already saw.
+* \details Only the header and the new squares are built for 'p'. The buckets
+*          were serialized once for the whole room, 'p' only takes a reference.
+*          A player with more than SEND_HIGH_WATER bytes waiting gets no frame
+*          until it is back under SEND_LOW_WATER, and then gets a keyframe.
+*/
+static void send_frame(room_worker* wk, room* r, room_player* p){
+    world* w = r->w;
+    snake* s = w->snakes[p->id];
+    coord head = get_head_coord(s);
+    frame_header hdr;
+    size_t i;
+
+    if(p->fd == -1) return;
+
+    //1 - let's check the player keeps up
+    if(p->keyframe_only){
+        if(p->out.bytes > SEND_LOW_WATER){
+            if(w->tick - p->stalled_since > SEND_STALL_TICKS){
+                printf("Room %i : player %i is too slow, disconnecting.\n", r->id, p->id);
+                kill_player(wk, p);
+            }
+            return;
+        }
+        p->keyframe_only = false;
+        p->window = new_area(0, 0, 0, 0);
+    }
+    else if(p->out.bytes > SEND_HIGH_WATER){
+        printf("Room %i : player %i is too slow, sending keyframes only.\n", r->id, p->id);
+        p->keyframe_only = true;
+        p->stalled_since = w->tick;
+        return;
+    }
+
+    //2 - let's find what the player needs
+    p->origin.x = place_view(p->origin.x, head.x, r->view_height, w->map->height);
+    p->origin.y = place_view(p->origin.y, head.y, r->view_width, w->map->width);
+    area win = clip_area(new_area(p->origin.x - AOI_MARGIN, p->origin.y - AOI_MARGIN,
+                                  p->origin.x + r->view_height + AOI_MARGIN,
+                                  p->origin.y + r->view_width + AOI_MARGIN), w->map);
+
+    wk->cells.clear();
+    wk->shared.clear();
+    interest_collect(w->map, p->window, win, wk->cells);
+    int nb_shared = interest_shared(r->g, inter_area(p->window, win), wk->shared);
+
+    //3 - let's queue the frame
+    hdr.tick = w->tick;
+    hdr.flags = is_empty_area(p->window) ? FRAME_KEYFRAME : 0;
+    hdr.origin = p->origin;
+    hdr.head = head;
+    hdr.dir = w->dirs[p->id];
+    hdr.size = s->get_size();
+    hdr.period = w->periods[p->id];
+    hdr.next_move = w->next_moves[p->id];
+    hdr.nb_cells = wk->cells.size() + nb_shared;
+    p->window = win;
+
+    int own_len = wk->cells.size()*sizeof(cell_update);
+    net_buffer* b = new_net_buffer(sizeof(frame_header) + own_len);
+    memcpy(b->data, &hdr, sizeof(frame_header));
+    memcpy(b->data + sizeof(frame_header), wk->cells.data(), own_len);
+    send_queue_push(&p->out, b);
+    net_buffer_unref(b);
+    for(i = 0; i < wk->shared.size(); i++){
+        send_queue_push(&p->out, wk->shared[i]);
+    }
+    flush_player(wk, p);
+}
+
+/**
+* \fn bool room_tick(room_worker* wk, room* r);
+* \brief Plays one tick of the game of 'r'.
+* \details 1 - every snake chooses its direction. AI snakes all decide on the
+*              field as it is before the step, with the help of the AI pool,
+*              and their decisions are applied together.
+*          2 - snakes move, items pop
+*          3 - everyone is sent what changed around him
+*          4 - the game ends if only one snake is left
+* \returns true if the game is over
+*/
+static bool room_tick(room_worker* wk, room* r){
+    world* w = r->w;
+    int nb_humans = r->players.size();
+    size_t i;
+    int id;
+
+    //1 - every snake chooses its direction
+    phase_start(&r->phases);
+    take_inputs(wk, r);
+    phase_end(&r->phases, ROOM_PH_INPUT);
+    wk->ai_jobs.clear();
+    for(id = nb_humans; id < w->nb_snakes; id++){
+        if(w->dirs[id] == DEAD_DIR) continue;
+        ai_job j;
+        j.play = r->play;
+        j.version = ai_version_of(r, id);
+        j.id = id;
+        j.s = w->snakes[id];
+        j.map = w->map;
+        j.enemy = nearest_enemy(r, id);
+        wk->ai_jobs.push_back(j);
+    }
+    ai_pool_run(wk->m->ai, wk->ai_jobs.data(), wk->ai_jobs.size());
+    for(i = 0; i < wk->ai_jobs.size(); i++){
+        w->dirs[wk->ai_jobs[i].id] = wk->ai_jobs[i].dir;
+        if(r->history != NULL){
+            chosen_dir c = {wk->ai_jobs[i].id, wk->ai_jobs[i].dir};
+            r->history[(w->tick + 1) % r->cfg.rollback].ai.push_back(c);  //record of the coming step
+        }
+    }
+    phase_end(&r->phases, ROOM_PH_AI);
+    if(r->rec != NULL && r->history == NULL){
+        replay_record(r->rec, w);   //otherwise recorded once it can't be played again, see 'save_step()'
+    }
+    phase_end(&r->phases, ROOM_PH_RECORD);
+
+    //2 - snakes move, items pop
+    world_move(w);
+    phase_end(&r->phases, ROOM_PH_MOVE);
+    world_items(w);
+    phase_end(&r->phases, ROOM_PH_ITEMS);
+    interest_update(r->g, w);
+    if(r->cast != NULL){
+        spectate_publish(r->cast, w, r->g);
+    }
+    phase_end(&r->phases, ROOM_PH_PUBLISH);
+
+    //3 - everyone is sent what changed around him
+    for(i = 0; i < r->players.size(); i++){
+        send_frame(wk, r, r->players[i]);
+    }
+    phase_end(&r->phases, ROOM_PH_SEND);
+
+    //4 - the game ends if only one snake is left
+    if(w->nb_alive <= 1){
+        printf("Room %i : game has ended after %i ticks, only one player left alive.\n", r->id, w->tick);
+        return true;
+    }
+    return false;
+}
+
+// Workers =============================================================
+/**
+* \fn void watch_room(room_worker* wk, room* r);
+* \brief Makes 'wk' run 'r' : creates the timer of 'r' and waits for it.
+*/
+static void watch_room(room_worker* wk, room* r){
+    if((r->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1){
+        perror("timerfd_create in 'watch_room()'");
+        exit(1);
+    }
+    r->src.type = event_source::SRC_ROOM;
+    r->src.ptr = r;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &r->src;
+    epoll_ctl(wk->epfd, EPOLL_CTL_ADD, r->timer_fd, &ev);
+
+    r->phases.parent = &wk->phases;
+    wk->rooms.push_back(r);
+}
+
+/**
+* \fn void take_joining(room_worker* wk, struct timespec now);
+* \brief Moves the players handed over by the accepting thread into their rooms.
+*        A room is run by the worker from the moment its first player joins.
+*/
+static void take_joining(room_worker* wk, struct timespec now){
+    vector<room_player*> joining;
+    size_t i;
+
+    pthread_mutex_lock(&wk->lock);
+    joining.swap(wk->joining);
+    pthread_mutex_unlock(&wk->lock);
+
+    for(i = 0; i < joining.size(); i++){
+        room_player* p = joining[i];
+        room* r = p->r;
+
+        if(r->players.empty()){
+            watch_room(wk, r);
+            r->deadline = now;
+            add_ms(&r->deadline, r->cfg.lobby_time);
+            arm_timer(r, 0);
+        }
+        //a player who left the lobby gives its place, it is freed with the room
+        p->id = r->players.size();
+        for(size_t j = 0; j < r->players.size(); j++){
+            if(r->players[j]->fd == -1){
+                p->id = j;
+                r->left.push_back(r->players[j]);
+                break;
+            }
+        }
+        if(p->id == (int)r->players.size()) r->players.push_back(p);
+        else r->players[p->id] = p;
+
+        p->in_len = 0;
+        p->left_at = -1;
+        new_send_queue(&p->out);
+        p->writing = false;
+        p->keyframe_only = false;
+        p->src.type = event_source::SRC_PLAYER;
+        p->src.ptr = p;
+        if(set_nonblocking(p->fd) == -1){
+            perror("set_nonblocking in 'take_joining()'");
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &p->src;
+        epoll_ctl(wk->epfd, EPOLL_CTL_ADD, p->fd, &ev);
+
+        printf("Room %i : a new player joined. Connected players : %i.\n", r->id, (int)r->players.size());
+        if((int)r->players.size() == r->cfg.max_players){
+            start_room(wk, r, now);
+        }
+    }
+}
+
+/**
+* \fn void keep_bot_rooms(room_worker* wk, struct timespec now);
+* \brief Starts a room of AI snakes only for every one 'wk' is missing, so that
+*        spectators always have games to watch.
+*/
+static void keep_bot_rooms(room_worker* wk, struct timespec now){
+    room_manager* m = wk->m;
+    int nb = 0;
+    size_t i;
+
+    for(i = 0; i < wk->rooms.size(); i++){
+        if(wk->rooms[i]->bots_only && wk->rooms[i]->state != ROOM_FINISHED) nb++;
+    }
+    for(; nb < wk->bot_rooms && m->running; nb++){
+        pthread_mutex_lock(&m->lock);
+        room* r = new_room(m);
+        pthread_mutex_unlock(&m->lock);
+
+        r->bots_only = true;
+        r->cfg.ai_fill = true;
+        watch_room(wk, r);
+        start_room(wk, r, now);
+    }
+}
+
+/**
+* \fn void close_lobby(room_worker* wk, room* r, struct timespec now);
+* \brief Called when the lobby of 'r' is over. Starts 'r' if there are enough
+*        players, otherwise waits for another 'lobby_time'.
+*/
+static void close_lobby(room_worker* wk, room* r, struct timespec now){
+    room_manager* m = wk->m;
+    bool can_start;
+
+    pthread_mutex_lock(&m->lock);
+    can_start = m->lobby != r || r->cfg.ai_fill || m->lobby_count >= 2;
+    if(can_start && m->lobby == r){
+        m->lobby = NULL;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    if(!can_start){
+        add_ms(&r->deadline, r->cfg.lobby_time);
+        arm_timer(r, 0);
+        return;
+    }
+
+    //nobody can join 'r' anymore, but some players may still be on their way.
+    take_joining(wk, now);
+    if(r->state == ROOM_WAITING){
+        start_room(wk, r, now);
+    }
+}
+
+/**
+* \fn void room_timer(room_worker* wk, room* r);
+* \brief Called when the timer of 'r' expires : closes its lobby, or plays its
+*        next tick, measuring how late it starts and how long it lasts.
+* \details If more than one tick went by since the last one, only one is played
+*          and the others are counted as overruns.
+*/
+static void room_timer(room_worker* wk, room* r){
+    struct timespec start, end;
+    uint64_t expirations;
+    long late;
+
+    if(read(r->timer_fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t)) return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(r->state == ROOM_WAITING){
+        close_lobby(wk, r, start);
+        return;
+    }
+    if(r->state != ROOM_RUNNING) return;
+
+    //'deadline' was the first of the expirations, the tick was due at the last one
+    add_ms(&r->deadline, (expirations - 1) * r->cfg.timestep);
+    late = us_since(r->deadline, start);
+    add_ms(&r->deadline, r->cfg.timestep);
+    if(expirations > 1){
+        printf("Room %i : tick %i overran, %i ticks skipped.\n", r->id, r->w->tick, (int)expirations - 1);
+        r->overruns += expirations - 1;
+        wk->overruns.store(wk->overruns.load(memory_order_relaxed) + expirations - 1, memory_order_relaxed);
+    }
+
+    bool over = room_tick(wk, r);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(trace_on){
+        trace_span("tick", "tick", start.tv_sec * 1000000000L + start.tv_nsec,
+            end.tv_sec * 1000000000L + end.tv_nsec, "room", r->id);
+    }
+
+    histogram_add(&r->jitter, late);
+    histogram_add(&r->duration, us_since(start, end));
+    histogram_add(&wk->jitter, late);
+    histogram_add(&wk->duration, us_since(start, end));
+    if(over) end_room(wk, r);
+}
+
+/**
+* \fn void* run_worker(void* wk_p);
+* \brief Main loop of a worker : waits for the sockets of the players and for
+*        the timers of the rooms.
+* \details Inputs are read before the ticks they came with are played.
+*/
+static void* run_worker(void* wk_p){
+    room_worker* wk = (room_worker*)wk_p;
+    struct epoll_event events[MAX_EVENTS];
+    struct timespec now;
+    uint64_t trash;
+    int nb_events;
+    size_t i;
+    int e;
+
+    trace_thread_name(wk->phases.name);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    keep_bot_rooms(wk, now);
+    while(wk->m->running){
+        TRACE_BEGIN(wait_start);
+        nb_events = epoll_wait(wk->epfd, events, MAX_EVENTS, -1);
+        TRACE_END(wait_start, "epoll_wait", "sleep");
+        if(nb_events == -1){
+            if(errno != EINTR) perror("epoll_wait in 'run_worker()'");
+            continue;
+        }
+
+        //1 - let's read players' input
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        phase_start(&wk->phases);
+        for(e = 0; e < nb_events; e++){
+            event_source* src = (event_source*)events[e].data.ptr;
+            if(src->type == event_source::SRC_WAKE){
+                if(read(wk->wake_fd, &trash, sizeof(uint64_t)) == -1){
+                    perror("read on wake_fd");
+                }
+                take_joining(wk, now);
+            }
+            else if(src->type == event_source::SRC_PLAYER){
+                room_player* p = (room_player*)src->ptr;
+                if(events[e].events & EPOLLOUT) flush_player(wk, p);
+                if(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_player(wk, p);
+            }
+        }
+        phase_end(&wk->phases, ROOM_PH_READ);
+
+        //2 - let's run the rooms whose timer expired
+        for(e = 0; e < nb_events; e++){
+            event_source* src = (event_source*)events[e].data.ptr;
+            if(src->type == event_source::SRC_ROOM){
+                room_timer(wk, (room*)src->ptr);
+            }
+        }
+
+        //3 - let's forget about finished rooms
+        for(i = 0; i < wk->rooms.size(); ){
+            if(wk->rooms[i]->state == ROOM_FINISHED){
+                free_room(wk->rooms[i]);
+                wk->rooms[i] = wk->rooms.back();
+                wk->rooms.pop_back();
+            }
+            else{
+                i++;
+            }
+        }
+        keep_bot_rooms(wk, now);
+    }
+
+    for(i = 0; i < wk->rooms.size(); i++){
+        end_room(wk, wk->rooms[i]);
+        free_room(wk->rooms[i]);
+    }
+    wk->rooms.clear();
+    return NULL;
+}
+
+/**
+* \fn void wake_worker(room_worker* wk);
+* \brief Makes 'wk' leave 'epoll_wait()'.
+*/
+static void wake_worker(room_worker* wk){
+    uint64_t one = 1;
+    if(write(wk->wake_fd, &one, sizeof(uint64_t)) == -1){
+        perror("write on wake_fd");
+    }
+}
+
+// Manager =============================================================
+/**
+* \fn room_manager* new_room_manager(room_config cfg, int nb_workers, spectator_hub* hub);
+* \brief Creates a manager and launches its 'nb_workers' workers.
+* \param cfg configuration of every room the manager will create
+* \param hub hub every game is broadcast to, NULL for none. It must outlive the manager.
+* \returns a pointer to the newly created 'room_manager'
+*/
+room_manager* new_room_manager(room_config cfg, int nb_workers, spectator_hub* hub){
+    room_manager* m = new room_manager;
+    int i;
+
+    if(cfg.max_players > ROOM_MAX_PLAYERS) cfg.max_players = ROOM_MAX_PLAYERS;
+    if(cfg.max_players < 2) cfg.max_players = 2;
+
+    m->cfg = cfg;
+    m->nb_workers = nb_workers;
+    m->hub = hub;
+    m->ai = new_ai_pool(cfg.ai_threads);
+    m->lobby = NULL;
+    m->lobby_count = 0;
+    m->next_room_id = 0;
+    m->running = true;
+    pthread_mutex_init(&m->lock, NULL);
+
+    m->workers = new room_worker[nb_workers];
+    for(i = 0; i < nb_workers; i++){
+        room_worker* wk = &m->workers[i];
+        wk->id = i;
+        wk->m = m;
+        wk->overruns = 0;
+        wk->rollbacks = 0;
+        wk->corrections = 0;
+        wk->bot_rooms = cfg.bot_rooms / nb_workers + (i < cfg.bot_rooms % nb_workers ? 1 : 0);
+        init_histogram(&wk->jitter);
+        init_histogram(&wk->duration);
+        char name[32];
+        snprintf(name, sizeof(name), "worker %i", i);
+        init_phase_timer(&wk->phases, name, room_phase_names, NB_ROOM_PHASES);
+        register_phase_timer(&wk->phases);
+        pthread_mutex_init(&wk->lock, NULL);
+
+        if((wk->epfd = epoll_create1(0)) == -1 || (wk->wake_fd = eventfd(0, 0)) == -1){
+            perror("creating worker");
+            exit(1);
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        wk->wake_src.type = event_source::SRC_WAKE;
+        wk->wake_src.ptr = wk;
+        ev.data.ptr = &wk->wake_src;
+        epoll_ctl(wk->epfd, EPOLL_CTL_ADD, wk->wake_fd, &ev);
+
+        if(pthread_create(&wk->thread, 0, run_worker, wk) != 0){
+            printf("error : could not create thread for worker %i\n", i);
+            exit(1);
+        }
+    }
+
+    return m;
+}
+
+/**
+* \fn void free_room_manager(room_manager* m);
+* \brief Stops every worker, ends every room and frees the manager.
+*/
+void free_room_manager(room_manager* m){
+    int i;
+
+    m->running = false;
+    for(i = 0; i < m->nb_workers; i++){
+        wake_worker(&m->workers[i]);
+    }
+    for(i = 0; i < m->nb_workers; i++){
+        room_worker* wk = &m->workers[i];
+        pthread_join(wk->thread, NULL);
+        unregister_phase_timer(&wk->phases);
+        for(size_t j = 0; j < wk->joining.size(); j++){
+            close(wk->joining[j]->fd);
+            delete wk->joining[j];
+        }
+        for(size_t j = 0; j < wk->spare_arenas.size(); j++){
+            free_session_arena(wk->spare_arenas[j]);
+        }
+        close(wk->epfd);
+        close(wk->wake_fd);
+        pthread_mutex_destroy(&wk->lock);
+    }
+    delete[] m->workers;
+    free_ai_pool(m->ai);
+    pthread_mutex_destroy(&m->lock);
+    delete m;
+}
+
+/**
+* \fn void room_manager_add_player(room_manager* m, int fd);
+* \brief Puts the player connected on 'fd' in the open room, creating one if needed.
+* \details Rooms are spread among workers by their id. The room stops
+*          accepting players once it is full.
+*/
+void room_manager_add_player(room_manager* m, int fd){
+    room_player* p = new room_player;
+    p->fd = fd;
+
+    pthread_mutex_lock(&m->lock);
+    if(m->lobby == NULL){
+        m->lobby = new_room(m);
+        m->lobby_count = 0;
+    }
+    p->r = m->lobby;
+    room_worker* wk = &m->workers[m->lobby->id % m->nb_workers];
+
+    pthread_mutex_lock(&wk->lock);
+    wk->joining.push_back(p);
+    pthread_mutex_unlock(&wk->lock);
+
+    m->lobby_count++;
+    if(m->lobby_count == m->cfg.max_players){
+        m->lobby = NULL;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    wake_worker(wk);
+}
+
+/**
+* \fn void print_room_manager_stats(room_manager* m, FILE* f);
+* \brief Prints on 'f' how well the workers of 'm' kept the pace of their rooms' ticks.
+* \details Can be called from any thread while the workers run.
+*/
+void print_room_manager_stats(room_manager* m, FILE* f){
+    char name[64];
+    int i;
+
+    for(i = 0; i < m->nb_workers; i++){
+        room_worker* wk = &m->workers[i];
+        fprintf(f, "Worker %i : %li ticks overran.\n", wk->id, wk->overruns.load(memory_order_relaxed));
+        fprintf(f, "Worker %i : %li rollbacks for late inputs, %li squares corrected.\n", wk->id,
+            wk->rollbacks.load(memory_order_relaxed), wk->corrections.load(memory_order_relaxed));
+        snprintf(name, sizeof(name), "Worker %i tick jitter", wk->id);
+        print_histogram(f, name, &wk->jitter);
+        snprintf(name, sizeof(name), "Worker %i tick duration", wk->id);
+        print_histogram(f, name, &wk->duration);
+        print_phase_timer(f, &wk->phases);
+    }
+    fprintf(f, "AI pool : %li decisions taken by its %i threads.\n",
+        m->ai->nb_jobs.load(memory_order_relaxed), m->ai->nb_threads);
+}
+
+/**
+* \fn void write_room_manager_metrics(FILE* f, void* m_p);
+* \brief Writes on 'f' how the workers of the manager 'm_p' spend their time, in
+*        the Prometheus text format. Made to be given to 'new_metrics_endpoint()'.
+* \details Can be called from any thread while the workers run.
+*/
+void write_room_manager_metrics(FILE* f, void* m_p){
+    room_manager* m = (room_manager*)m_p;
+    char labels[32];
+    int i;
+
+    write_phase_metrics(f);
+    fprintf(f, "# HELP snake_tick_jitter_seconds Delay between the planned start of a tick and its real start.\n");
+    fprintf(f, "# TYPE snake_tick_jitter_seconds summary\n");
+    for(i = 0; i < m->nb_workers; i++){
+        snprintf(labels, sizeof(labels), "worker=\"%i\"", i);
+        write_histogram_metric(f, "snake_tick_jitter_seconds", labels, &m->workers[i].jitter, 1e-6);
+    }
+    fprintf(f, "# HELP snake_tick_duration_seconds Time spent playing a tick.\n");
+    fprintf(f, "# TYPE snake_tick_duration_seconds summary\n");
+    for(i = 0; i < m->nb_workers; i++){
+        snprintf(labels, sizeof(labels), "worker=\"%i\"", i);
+        write_histogram_metric(f, "snake_tick_duration_seconds", labels, &m->workers[i].duration, 1e-6);
+    }
+    fprintf(f, "# HELP snake_tick_overruns_total Ticks skipped because the previous ones were late.\n");
+    fprintf(f, "# TYPE snake_tick_overruns_total counter\n");
+    for(i = 0; i < m->nb_workers; i++){
+        fprintf(f, "snake_tick_overruns_total{worker=\"%i\"} %li\n", i, m->workers[i].overruns.load(memory_order_relaxed));
+    }
+    fprintf(f, "# HELP snake_rollbacks_total Times late inputs made a room play steps again.\n");
+    fprintf(f, "# TYPE snake_rollbacks_total counter\n");
+    for(i = 0; i < m->nb_workers; i++){
+        fprintf(f, "snake_rollbacks_total{worker=\"%i\"} %li\n", i, m->workers[i].rollbacks.load(memory_order_relaxed));
+    }
+    fprintf(f, "# HELP snake_rollback_corrections_total Squares sent again to correct what a rollback changed.\n");
+    fprintf(f, "# TYPE snake_rollback_corrections_total counter\n");
+    for(i = 0; i < m->nb_workers; i++){
+        fprintf(f, "snake_rollback_corrections_total{worker=\"%i\"} %li\n", i, m->workers[i].corrections.load(memory_order_relaxed));
+    }
+    fprintf(f, "# HELP snake_ai_pool_decisions_total AI decisions taken by the threads of the AI pool, rather than by the workers.\n");
+    fprintf(f, "# TYPE snake_ai_pool_decisions_total counter\n");
+    fprintf(f, "snake_ai_pool_decisions_total %li\n", m->ai->nb_jobs.load(memory_order_relaxed));
+}
@@ -0,0 +1,223 @@
+/**
+* \file room.h
+*/
+
+#ifndef H_ROOM
+#define H_ROOM
+
+#include <pthread.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+#include "types.h"
+#include "world.h"
+#include "interest.h"
+#include "stats.h"
+#include "replay.h"
+#include "spectate.h"
+#include "ai_pool.h"
+
+// CONSTANTS ============================================================
+#define ROOM_MAX_PLAYERS 12   /**< 'new_snake()' only knows 12 start positions */
+#define LOBBY_TIME 10000      /**< time in ms a room waits for more players before starting */
+#define MAX_EVENTS 64         /**< maximum events a worker handles per 'epoll_wait()' */
+#define SEND_HIGH_WATER 65536 /**< bytes waiting for a player above which it only gets keyframes */
+#define SEND_LOW_WATER 4096   /**< bytes waiting for a player below which it gets a keyframe */
+#define SEND_STALL_TICKS 200  /**< ticks a player can stay above SEND_LOW_WATER before being disconnected */
+#define SPARE_ARENAS 4        /**< session arenas a worker keeps for its next rooms */
+#define ROLLBACK_TICKS 4      /**< ticks in the past a late input can be applied at, by default */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef room_phase
+* \brief Phases of the work of a worker, timed by its 'phase_timer'. Every phase
+*        but ROOM_PH_READ is part of a room's tick.
+*/
+typedef enum {
+    ROOM_PH_READ,       /**< reading the players' sockets */
+    ROOM_PH_INPUT,      /**< giving the players' inputs to their snakes */
+    ROOM_PH_AI,         /**< AI snakes choosing their direction */
+    ROOM_PH_RECORD,     /**< recording the directions */
+    ROOM_PH_MOVE,       /**< 'world_move()' */
+    ROOM_PH_ITEMS,      /**< 'world_items()' */
+    ROOM_PH_PUBLISH,    /**< sorting what changed into buckets, for players and spectators */
+    ROOM_PH_SEND,       /**< building and sending the frames */
+    NB_ROOM_PHASES
+} room_phase;
+
+/**
+* \typedef room_state
+* \brief A room waits for players, then runs its game until only one snake is left.
+*/
+typedef enum {ROOM_WAITING, ROOM_RUNNING, ROOM_FINISHED} room_state;
+
+/**
+* \typedef event_source
+* \brief What a worker's epoll event is about : its 'wake_fd', a player's socket
+*        or a room's timer. 'ptr' points to the player or the room.
+*/
+struct event_source {
+    enum {SRC_WAKE, SRC_PLAYER, SRC_ROOM} type;
+    void* ptr;
+};
+
+/**
+* \typedef room_config
+* \brief Options of the games played in a room.
+*/
+struct room_config {
+    int width;          /**< width of the arena */
+    int height;         /**< height of the arena */
+    int view_width;     /**< width of the part of the arena a client sees, 0 for all of it */
+    int view_height;    /**< height of the part of the arena a client sees, 0 for all of it */
+    int timestep;       /**< time between two ticks, in ms */
+    int size;           /**< snake size sent to clients */
+    int max_players;    /**< maximum number of snakes in the room, humans and AI */
+    bool ai_fill;       /**< true if empty slots are given to AI snakes when the room starts */
+    int ai_version;     /**< version of the AI driving AI snakes, 0 to give them every version in turn */
+    int lobby_time;     /**< time in ms the room waits for players before starting */
+    const char* record_dir;     /**< directory games are recorded in, NULL to not record them */
+    int bot_rooms;      /**< rooms of AI snakes only the manager keeps running, for spectators */
+    int ai_threads;     /**< threads taking the AI decisions along with the workers */
+    int rollback;       /**< ticks in the past a late input can be applied at, 0 to apply it on the next tick */
+};
+
+/**
+* \typedef chosen_dir
+* \brief Direction snake 'id' took, or was asked to take, at some step.
+*/
+struct chosen_dir {
+    int id;
+    direction dir;
+};
+
+/**
+* \typedef tick_record
+* \brief What a room needs to play a step again : the world before it, and
+*        what the snakes chose.
+*/
+struct tick_record {
+    int tick;                   /**< step the record is about, -1 for none */
+    world_snapshot* snap;       /**< world before the inputs of the step */
+    vector<chosen_dir> inputs;  /**< directions the players asked for at this step, in the order they were received */
+    vector<chosen_dir> ai;      /**< directions the AI snakes chose */
+};
+
+struct room;
+
+/**
+* \typedef room_player
+* \brief A human player connected to a room. 'id' is the index of its snake.
+* \details The socket is non-blocking : frames wait in 'out' until the player
+*          can take them. A player that falls behind stops receiving frames until
+*          it caught up, and then gets a keyframe.
+*/
+struct room_player {
+    int fd;             /**< socket of the player, -1 once disconnected */
+    int id;             /**< id of the player's snake in the room's world */
+    room* r;            /**< room the player is in */
+    coord origin;       /**< top left square of the player's viewport */
+    area window;        /**< squares the player knows about : viewport and margin, clipped */
+    queue<input_msg> inputs;    /**< inputs received, waiting for their tick */
+    char in_buf[sizeof(input_msg)];     /**< input being received */
+    int in_len;                 /**< bytes of 'in_buf' already received */
+    int left_at;                /**< step from which the snake of the player is dead because it left, -1 while it is connected */
+    send_queue out;             /**< what is waiting to be sent to the player */
+    bool writing;               /**< true if the worker waits for the socket to accept more */
+    bool keyframe_only;         /**< true if the player is too slow to receive every frame */
+    int stalled_since;          /**< tick at which the player became too slow */
+    event_source src;           /**< registered with the socket in the worker's epoll */
+};
+
+/**
+* \typedef room
+* \brief A single game, with its own players, arena and tick.
+* \details A room is only ever touched by the worker running it.
+*/
+struct room {
+    int id;
+    room_config cfg;
+    room_state state;
+    bool bots_only;                 /**< true if the room was started with AI snakes only */
+    vector<room_player*> players;   /**< human players, their snakes come first in 'w' */
+    vector<room_player*> left;      /**< players who left the lobby and gave their place to another */
+    world* w;                       /**< game of the room, NULL until it starts */
+    session_arena* arena;           /**< memory of 'w' and 'replayed', NULL until the room starts */
+    ai_play_fn play;                /**< how its AI snakes decide, chosen for the size of 'w' */
+    interest_grid* g;               /**< what changed where during the last tick */
+    replay_writer* rec;             /**< recording of the game, NULL if it is not recorded */
+    broadcast* cast;                /**< stream of the game to the spectators, NULL if there are none */
+    int view_width;                 /**< size of the viewport of the players */
+    int view_height;
+    int timer_fd;                   /**< timerfd expiring at the end of the lobby, then every tick */
+    event_source src;               /**< registered with 'timer_fd' in the worker's epoll */
+    struct timespec deadline;       /**< next expiration of 'timer_fd' */
+    long overruns;                  /**< ticks skipped because the previous ones were late */
+    histogram jitter;               /**< delay between the planned start of a tick and its real start */
+    histogram duration;             /**< time spent playing a tick */
+    phase_timer phases;             /**< time spent in each phase of the ticks, its parent is the worker's */
+    tick_record* history;           /**< last 'cfg.rollback' steps, step t at t % cfg.rollback, NULL if late inputs aren't rolled back */
+    world_snapshot* present;        /**< world before a rollback, to find what it corrected */
+    world* replayed;                /**< world the steps are recorded from once they can't be played again, NULL if none */
+    long rollbacks;                 /**< times late inputs made the room play steps again */
+    long corrections;               /**< squares that were sent again because of them */
+};
+
+struct room_manager;
+
+/**
+* \typedef room_worker
+* \brief A thread running the ticks of every room it was given.
+* \details The worker sleeps in 'epoll_wait()' on the sockets of its players
+*          and the timers of its rooms.
+*/
+struct room_worker {
+    int id;
+    pthread_t thread;
+    room_manager* m;
+    int epfd;                       /**< epoll instance watching players and 'wake_fd' */
+    int wake_fd;                    /**< eventfd used to wake the worker up */
+    event_source wake_src;          /**< registered with 'wake_fd' */
+    pthread_mutex_t lock;           /**< protects 'joining' */
+    vector<room_player*> joining;   /**< players handed over by the accepting thread */
+    vector<room*> rooms;            /**< rooms run by this worker */
+    vector<cell_update> cells;      /**< squares a player sees for the first time, kept to avoid allocating every tick */
+    vector<net_buffer*> shared;     /**< buffers of the buckets a player sees */
+    vector<ai_job> ai_jobs;         /**< decisions of the AI snakes of a tick, kept to avoid allocating every tick */
+    vector<chosen_dir> inputs;      /**< inputs of the players for the coming step, kept to avoid allocating every tick */
+    vector<session_arena*> spare_arenas;  /**< arenas of ended rooms, emptied, for the next ones */
+    int bot_rooms;                  /**< rooms of AI snakes only the worker keeps running */
+    std::atomic<long> overruns;     /**< ticks skipped by every room of the worker */
+    std::atomic<long> rollbacks;    /**< times late inputs made a room of the worker play steps again */
+    std::atomic<long> corrections;  /**< squares sent again because of them */
+    histogram jitter;               /**< tick start jitter of every room of the worker */
+    histogram duration;             /**< tick duration of every room of the worker */
+    phase_timer phases;             /**< time spent in each phase, by every room of the worker */
+};
+
+/**
+* \typedef room_manager
+* \brief Dispatches new players into rooms, and rooms onto a fixed set of workers.
+*/
+struct room_manager {
+    room_config cfg;                /**< configuration of every new room */
+    room_worker* workers;
+    int nb_workers;
+    spectator_hub* hub;             /**< hub the games are broadcast to, NULL for none */
+    ai_pool* ai;                    /**< threads helping the workers with the AI decisions */
+    pthread_mutex_t lock;           /**< protects 'lobby', 'lobby_count' and 'next_room_id' */
+    room* lobby;                    /**< room new players join, NULL if none is open */
+    int lobby_count;                /**< players already sent to 'lobby' */
+    int next_room_id;
+    std::atomic<bool> running;      /**< cleared to stop the workers */
+};
+
+// PROTOTYPES ==========================================================
+room_manager* new_room_manager(room_config cfg, int nb_workers, spectator_hub* hub);
+void free_room_manager(room_manager* m);
+void room_manager_add_player(room_manager* m, int fd);
+void print_room_manager_stats(room_manager* m, FILE* f);
+void write_room_manager_metrics(FILE* f, void* m_p);
+
+#endif
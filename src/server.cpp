@@ -5,79 +5,97 @@
 #include <arpa/inet.h>  //for 'struct sockaddr_in'
 #include <strings.h>    //for 'bzero()'
 #include <unistd.h>     //for 'read()'
-#include <sys/time.h>
 #include <signal.h>
+#include <poll.h>       //for 'poll()'
+#include <errno.h>
+#include <getopt.h>     //for 'getopt()'
+#include <time.h>       //for 'time()'
+#include <atomic>       //before game.h, whose 'clear' macro breaks it
+#include "trace.h"
 
 #include "game.h"
+#include "AI.h"
+#include "room.h"
+#include "spectate.h"
+#include "metrics.h"
 
-#define BACKLOG 10
+#define BACKLOG 128
 //#define SERV_ADDR "192.168.0.38"
 #define SERV_ADDR "127.0.0.1"
 #define PORT 3490
+#define SPECTATE_PORT (PORT + 1)   //port spectators connect to
 #define MAX_PLAYERS 10
 #define SNAKESIZE 1         //size of the snake
-#define PING 10
 
 #define WIDTH 60    //size of the square arena
 #define HEIGHT 25
 
-vector<int> players;
-direction* players_dir;
 int sockfd;
+int quit_pipe[2];           //written to by 'on_sigint()', read by the accepting loop
+volatile sig_atomic_t quit_requested = 0;
+room_manager* manager = NULL;
+spectator_hub* hub = NULL;
+metrics_endpoint* endpoint = NULL;
 
 void safe_quit(int return_value)
 {
-    int i;
     close(sockfd);
-    for(i = 0; i<MAX_PLAYERS; i++)
+    if (endpoint != NULL)
     {
-        close(players[i]);
+        free_metrics_endpoint(endpoint);    //before the manager, whose measures it reads
     }
+    if (manager != NULL)
+    {
+        print_room_manager_stats(manager, stdout);
+        free_room_manager(manager);
+    }
+    if (hub != NULL)
+    {
+        free_spectator_hub(hub);    //after the rooms, which broadcast to it
+    }
+    trace_stop();   //once every thread is done
     printf("safe quitted\n");
     exit(return_value);
 }
 
 /**
-* \fn int diff(struct timeval big_time, struct timeval small_time);
-* \returns The time in ms that separates 'big_time' from 'small_time'
+* \fn void on_sigint(int sig);
+* \brief Asks the accepting loop to quit. Does nothing else : a signal handler
+*        may only do what is async-signal-safe, and the shutdown joins threads.
 */
-int diff_time(struct timeval big_time, struct timeval small_time)
+void on_sigint(int sig)
 {
-    int sec = big_time.tv_sec - small_time.tv_sec;
-    int usec = big_time.tv_usec - small_time.tv_usec;
-    return sec * 1000 + usec / 1000;
+    int saved = errno;
+    (void)sig;
+    quit_requested = 1;
+    if (write(quit_pipe[1], "q", 1) == -1) {}   //the pipe only has to be readable
+    errno = saved;
 }
 
-int count_players()
+int create_listen_socket(int port)
 {
-    int i;
-    for(i = 0; i<MAX_PLAYERS; i++)
-    {
-        if(players[i] == -1) return i;
-    }
-    return i;
-}
+    int fd;
 
-void create_listen_socket()
-{
     printf("Creating socket...\n");
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
     {
         perror("socket");
         safe_quit(1);
     }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
     printf("Ok.\n");
 
     printf("Preparing server adress...\n");
     struct sockaddr_in my_addr;
     my_addr.sin_family = AF_INET;
-    my_addr.sin_port = htons(PORT);
+    my_addr.sin_port = htons(port);
     inet_aton(SERV_ADDR, (struct in_addr*) &my_addr.sin_addr.s_addr);
     bzero(&(my_addr.sin_zero), 8);
     printf("Ok.\n");
 
     printf("Binding adress to socket...\n");
-    if (bind(sockfd, (struct sockaddr*) &my_addr, sizeof(struct sockaddr_in)) == -1)
+    if (bind(fd, (struct sockaddr*) &my_addr, sizeof(struct sockaddr_in)) == -1)
     {
         perror("bind");
         safe_quit(1);
@@ -85,250 +103,146 @@ void create_listen_socket()
     printf("Ok.\n");
 
     printf("Making socket a listen socket...\n");
-    if (listen(sockfd, BACKLOG) == -1)
+    if (listen(fd, BACKLOG) == -1)
     {
         perror("listen");
         exit(EXIT_FAILURE);
     }
     printf("Ok.\n");
-}
-
-void* read_client(void* id_p)
-{
-    int* id = (int*)id_p;
-    direction cur_dir;
-
-    while (true)
-    {
-        if (read(players[*id], &cur_dir, 1 * sizeof(direction)) == -1)
-        {
-            perror("read on a client");  safe_quit(1);
-        }
-        if (cur_dir >= 0 && cur_dir <= 3 && players_dir[*id] != 4)
-        {
-            //if player's move is valid and if he's not dead
-            players_dir[*id] = cur_dir;
-            printf("Read dir %i for client %i.\n", cur_dir, *id);
-        }
-    }
 
+    return fd;
 }
 
-void* accept_players(void*)
+void usage(char* name)
 {
-    int newfd;
-    struct sockaddr their_addr;
-    socklen_t serverlen = sizeof(struct sockaddr_in);
-
-    while (players.size() <= MAX_PLAYERS)
-    {
-        if ((newfd = accept(sockfd, &their_addr, &serverlen)) == -1)
-        {
-            perror("accept");
-            safe_quit(1);
-        }
-        players.push_back(newfd);
-        printf("A new player joined the game. Connected players : %i.\n", (int)players.size());
-    }
-    return 0;
+    printf("Usage : %s [-w workers] [-x width] [-y height] [-X view width] [-Y view height] [-t timestep] [-p max players] [-a AI version] [-b bot rooms] [-i AI threads] [-l lobby time] [-k rollback] [-r directory] [-d delay] [-m socket]\n", name);
+    printf("  -w  number of threads running the rooms (default : number of cpus)\n");
+    printf("  -x  width of the arenas, up to %i (default : %i)\n", NET_MAX_SIDE, WIDTH);
+    printf("  -y  height of the arenas, up to %i (default : %i)\n", NET_MAX_SIDE, HEIGHT);
+    printf("  -X  width of the part of the arena a player sees (default : all of it)\n");
+    printf("  -Y  height of the part of the arena a player sees (default : all of it)\n");
+    printf("  -t  time between two ticks in ms (default : %i)\n", REC_TIME_STEP);
+    printf("  -p  maximum number of snakes in a room, between 2 and %i (default : %i)\n", ROOM_MAX_PLAYERS, MAX_PLAYERS);
+    printf("  -a  fill empty slots of a room with AI of this version, between 1 and %i, 0 for every version in turn\n", NB_AI_VERSIONS);
+    printf("  -b  rooms of AI snakes only to keep running, for spectators (default : 0)\n");
+    printf("  -i  threads taking AI decisions along with the workers (default : number of cpus)\n");
+    printf("  -l  time in ms a room waits for players before starting (default : %i)\n", LOBBY_TIME);
+    printf("  -k  ticks in the past a late input can still be applied at, 0 to apply it on the next tick (default : %i)\n", ROLLBACK_TICKS);
+    printf("  -r  record every game in this directory, see 'replayer'\n");
+    printf("  -d  ticks spectators are behind the games (default : %i)\n", SPECTATE_DELAY);
+    printf("  -m  serve the measures of the server on this Unix socket\n");
 }
 
-void play_server(config cfg) 
+int main(int argc, char** argv)
 {
-    //creating field
-    field* map = new_field(WIDTH, HEIGHT, cfg.timestep);
-
-    //creating direction arr
-    players_dir = new direction[cfg.nb_players];
-
-    //creating snakes
-    int i;
-    snake** snakes = (snake**)malloc(cfg.nb_players*sizeof(snake*));
-    for (i = 0; i < cfg.nb_players; i++)
+    if (pipe(quit_pipe) == -1)
     {
-        snakes[i] = new_snake(T_SNAKE, cfg.size, map);
+        perror("pipe");
+        exit(1);
     }
-
-    struct timeval last_step_time;
-    gettimeofday(&last_step_time, NULL);
-    struct timeval now;
-    int elapsed_time;       //elapsed time
-    int c_dead = 0;         //count dead players
-    while (true)
+    signal(SIGINT, on_sigint);
+    signal(SIGPIPE, SIG_IGN);   //a client leaving must not kill the server
+    srand(time(NULL));          //seeds of the arenas
+    trace_start("server");
+
+    room_config cfg;
+    cfg.width = WIDTH;
+    cfg.height = HEIGHT;
+    cfg.view_width = 0;
+    cfg.view_height = 0;
+    cfg.timestep = REC_TIME_STEP;
+    cfg.size = SNAKESIZE;
+    cfg.max_players = MAX_PLAYERS;
+    cfg.ai_fill = false;
+    cfg.ai_version = 0;
+    cfg.lobby_time = LOBBY_TIME;
+    cfg.record_dir = NULL;
+    cfg.bot_rooms = 0;
+    cfg.ai_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    cfg.rollback = ROLLBACK_TICKS;
+    int nb_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int delay = SPECTATE_DELAY;
+    const char* metrics_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:x:y:X:Y:t:p:a:b:i:l:k:r:d:m:h")) != -1)
     {
-        //SUMMARY
-        //1 - let's check if it's time to process inputs
-        //2 - let's send everyone the directions
-        //3 - let's make snakes move
-        //4 - let's update last_step_time
-        //5 - let's check if the game has to end
-        //--------------------------------------
-
-        //1 - let's check if it's time to retrieve input
-        gettimeofday(&now, NULL);
-        elapsed_time = diff_time(now, last_step_time); //time elapsed since last round. in ms.
-        if (elapsed_time > cfg.timestep - (PING / 2))
-        {
-            //2 - let's send everyone the directions
-            for (i = 0; i < cfg.nb_players; i++)
-            {
-                write(players[i], &players_dir, cfg.nb_players * sizeof(direction));
-            }
-            printf("Directions sent : \n");
-            for (i = 0; i < cfg.nb_players; i++)
-            {
-                printf("%i ", players_dir[i]);
-            }
-            printf("\n");
-
-            //3 - let's make snakes move
-            for (i = 0; i < cfg.nb_players; i++)
-            {
-                if (players_dir[i] != 4)
-                {   
-                    if (move(snakes[i], (direction)players_dir[i], map))
-                    {
-                        players_dir[i] = (direction)4;
-                        printf("Player %i died.\n", i);
-                        c_dead++;
-                    }
-                }
-            }
-
-            //4 - let's update last_step_time
-            gettimeofday(&last_step_time, NULL);
-
-            //5 - let's check if the game has to end
-            if (c_dead >= cfg.nb_players - 1)
-            {
-                printf("Game has ended, only one player left alive.\n");
-                sleep(3);
-                break;
-            }
-            
-            //6 - let's generate item
-            coord item_pos;
-            if (rand() % 4 == 0) // 25%
-            {
-                square item = pop_item(map, false, item_pos);
-                for (int i = 0; i < cfg.nb_players; i++)
-                {
-                    write(players[i], &item, sizeof(square));
-                }
-            }
-            else
-            {
-
-            }
-        }
-        else
+        switch (opt)
         {
-            //sleep 90% of the remaining time
-            usleep((((cfg.timestep - (PING / 2)) - elapsed_time) * 0.9) * 1000);
+            case 'w': nb_workers = atoi(optarg); break;
+            case 'x': cfg.width = atoi(optarg); break;
+            case 'y': cfg.height = atoi(optarg); break;
+            case 'X': cfg.view_width = atoi(optarg); break;
+            case 'Y': cfg.view_height = atoi(optarg); break;
+            case 't': cfg.timestep = atoi(optarg); break;
+            case 'p': cfg.max_players = atoi(optarg); break;
+            case 'a': cfg.ai_fill = true; cfg.ai_version = atoi(optarg); break;
+            case 'b': cfg.bot_rooms = atoi(optarg); break;
+            case 'i': cfg.ai_threads = atoi(optarg); break;
+            case 'l': cfg.lobby_time = atoi(optarg); break;
+            case 'k': cfg.rollback = atoi(optarg); break;
+            case 'r': cfg.record_dir = optarg; break;
+            case 'd': delay = atoi(optarg); break;
+            case 'm': metrics_path = optarg; break;
+            default: usage(argv[0]); exit(1);
         }
     }
-
-    for(i = 0; i<cfg.nb_players; i++)
+    if (nb_workers < 1 || delay < 0 || cfg.width < MIN_WINDOW_WIDTH || cfg.height < MIN_WINDOW_HEIGHT || cfg.timestep <= 0
+        || cfg.width > NET_MAX_SIDE || cfg.height > NET_MAX_SIDE
+        || cfg.view_width < 0 || cfg.view_height < 0 || cfg.max_players < 2 || cfg.max_players > ROOM_MAX_PLAYERS
+        || cfg.ai_version < 0 || cfg.ai_version > NB_AI_VERSIONS || cfg.bot_rooms < 0 || cfg.ai_threads < 0
+        || cfg.lobby_time < 0 || cfg.rollback < 0)
     {
-        free_snake(snakes[i]);
+        usage(argv[0]);
+        exit(1);
     }
-    free_field(map);
-}
-
-int main()
-{
-    signal(SIGINT, safe_quit);
-
-    int size = SNAKESIZE;
-    int width = WIDTH;
-    int height = HEIGHT;
-    int i;
-    pthread_t accept_thread;                //accept_player thread
-    pthread_t threads[MAX_PLAYERS];         //read_clients threads
-    int wait_players = 1;
-    int ok = 1;     //signal to send players
-    int ret_cli;
-    char c;
-
-    //CREATING LISTEN SOCKET
-    create_listen_socket();
 
-    //RECIEVING CONNECTIONS
-    printf("The server is now open to connections.\nPress ctrl+D when everyone has joined.\n");
-    if (pthread_create(&accept_thread, 0, accept_players, &wait_players) != 0)
-    {
-        printf("error : could not create thread\n");
-        safe_quit(1);
-    }
+    //CREATING LISTEN SOCKETS
+    sockfd = create_listen_socket(PORT);
+    int spectate_fd = create_listen_socket(SPECTATE_PORT);
 
-    int player_cnt;
-    while (true)
+    //LAUNCHING ROOMS
+    hub = new_spectator_hub(spectate_fd, cfg.timestep, delay);
+    manager = new_room_manager(cfg, nb_workers, hub);
+    if (metrics_path != NULL)
     {
-        while (read(0, &c, sizeof(char)) != 0);
-        player_cnt = players.size();
-        if (player_cnt < 2)
-        {
-            printf("Not enough player to start a game.\n");
-        }
-        else
-        {
-            pthread_cancel(accept_thread);
-            break;
-        }
+        endpoint = new_metrics_endpoint(metrics_path, write_room_manager_metrics, manager);
+        if (endpoint != NULL) printf("Measures are served on %s.\n", metrics_path);
     }
 
-    wait_players = 0;   //this will cause the accept_players thread to terminate
-    printf("From now on, no new players will be accepted.\npress ctrl+D to start the game.\n");
-
-    //SENDING INFO TO CLIENTS
-    for (i = 0; i < player_cnt; i++)
-    {
-        write(players[i], &size, sizeof(int));
-        write(players[i], &player_cnt, sizeof(int));
-        write(players[i], &i, sizeof(int));
-        write(players[i], &width, sizeof(int));
-        write(players[i], &height, sizeof(int));
-    }
-
-    //LAUNCHING THREADS TO READ CLIENTS
-    for (i = 0; i < player_cnt; i++)
-    {
-        if (pthread_create(&threads[i], 0, read_client, 0) != 0)
-        {
-            printf("Couldn't create thread for client %i.\n", i);
-        }
-    }
+    //RECIEVING CONNECTIONS
+    printf("The server is now open to connections on %i workers.\nSpectators can connect on port %i.\nPress ctrl+C to terminate server.\n", nb_workers, SPECTATE_PORT);
+    int newfd;
+    struct sockaddr their_addr;
+    socklen_t serverlen;
 
-    //WAITING TO START THE GAME
-    while (read(0, &c, sizeof(char)) != 0);
+    struct pollfd fds[2];
+    fds[0].fd = sockfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = quit_pipe[0];
+    fds[1].events = POLLIN;
 
-    printf("Sending signal to clients...\n");
-    //SENDING SIGNAL TO CLIENTS
-    for(i = 0; i < player_cnt; i++)
+    //SIGINT may reach any thread : the pipe wakes this one up
+    while (!quit_requested)
     {
-        ret_cli = write(players[i], &ok, 1*sizeof(int));
-        if(ret_cli < 0)
+        if (poll(fds, 2, -1) == -1)
         {
-            perror("write sending signal"); safe_quit(1);
+            if (errno != EINTR) perror("poll");
+            continue;
         }
-        else if(ret_cli == 0)
+        if (!(fds[0].revents & POLLIN)) continue;
+        serverlen = sizeof(struct sockaddr_in);
+        if ((newfd = accept(sockfd, &their_addr, &serverlen)) == -1)
         {
-            printf("Client %i closed connection.\n", i); safe_quit(1);
+            perror("accept");
+            continue;
         }
+        room_manager_add_player(manager, newfd);
     }
-    printf("Ok.\n");
-
-    config cfg;
-    cfg.size = size;
-    cfg.nb_players = player_cnt;
-
-    play_server(cfg);
-
-    printf("Press ctrl+D to terminate server.\n");
-    while(read(0, &c, sizeof(char)) != 0);
+    printf("\n");
 
     //ENDING
     safe_quit(0);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,650 @@
+/**
+* \file spectate.cpp
+* \brief Sends the games played in the rooms to spectators, from a thread of its own.
+* \details This file is separated in 2 parts :
+*          1 - functions called by the rooms, publishing their ticks
+*          2 - the hub, delaying the broadcasts and sending them to spectators
+*/
+
+#include <stdio.h>          //for 'printf()'
+#include <stdlib.h>         //for 'exit()'
+#include <errno.h>          //for 'errno'
+#include <string.h>         //for 'memcpy()'
+#include <unistd.h>         //for 'read()'
+#include <sys/socket.h>     //for 'accept()'
+#include <sys/epoll.h>      //for 'epoll_wait()'
+#include <sys/timerfd.h>    //for 'timerfd_create()'
+
+#include "types.h"
+#include "world.h"
+#include "interest.h"
+#include "net.h"
+#include "trace.h"
+
+#include "spectate.h"
+
+static const unsigned char blank_chunk[CHUNK_SIZE*CHUNK_SIZE] = {EMPTY};    /**< chunk of every mirror with nothing in it */
+
+// Rooms ===============================================================
+/**
+* \fn void publish(broadcast* b, net_buffer* frame);
+* \brief Hands 'frame' over to the hub. The caller must not touch it anymore.
+*/
+static void publish(broadcast* b, net_buffer* frame){
+    pthread_mutex_lock(&b->lock);
+    b->inbox.push_back(frame);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/**
+* \fn broadcast* spectate_open(spectator_hub* h, world* w, int room);
+* \brief Opens the broadcast of a room whose game just started, and publishes
+*        the arena as it is before the first tick.
+* \param room id of the room, shown to spectators
+* \returns a pointer to the newly created 'broadcast'. It is freed by the hub,
+*          once 'spectate_close()' was called.
+*/
+broadcast* spectate_open(spectator_hub* h, world* w, int room){
+    broadcast* b = new broadcast;
+    field* map = w->map;
+    spectate_header hdr;
+    cell_update u;
+    coord c;
+    int cx, cy;
+    int i;
+
+    b->room = room;
+    b->width = map->width;
+    b->height = map->height;
+    b->nb_snakes = w->nb_snakes;
+    pthread_mutex_init(&b->lock, NULL);
+    b->over = false;
+    b->closed = false;
+    b->chunk_rows = (b->height + CHUNK_SIZE - 1) >> CHUNK_BITS;
+    b->chunk_cols = (b->width + CHUNK_SIZE - 1) >> CHUNK_BITS;
+    b->mirror = new unsigned char*[b->chunk_rows * b->chunk_cols];
+    for(i = 0; i < b->chunk_rows * b->chunk_cols; i++){
+        b->mirror[i] = (unsigned char*)blank_chunk;
+    }
+    b->mirror_tick = -1;
+    b->nb_alive = w->nb_alive;
+
+    //the hub's copy of the arena starts empty : let's send what is not
+    vector<cell_update> cells;
+    for(cx = 0; cx * CHUNK_SIZE < map->height; cx++){
+        for(cy = 0; cy * CHUNK_SIZE < map->width; cy++){
+            if(chunk_is_blank(get_chunk(map, cx, cy))) continue;
+            for(c.x = cx * CHUNK_SIZE; c.x < (cx + 1) * CHUNK_SIZE && c.x < map->height; c.x++){
+                for(c.y = cy * CHUNK_SIZE; c.y < (cy + 1) * CHUNK_SIZE && c.y < map->width; c.y++){
+                    if(get_square_at(map, c) == EMPTY) continue;
+                    u.x = c.x;
+                    u.y = c.y;
+                    u.content = get_square_at(map, c);
+                    cells.push_back(u);
+                }
+            }
+        }
+    }
+    hdr.tick = w->tick;
+    hdr.flags = 0;
+    hdr.nb_alive = w->nb_alive;
+    hdr.nb_runs = 0;
+    hdr.nb_cells = cells.size();
+    net_buffer* frame = new_net_buffer(sizeof(spectate_header) + cells.size()*sizeof(cell_update));
+    memcpy(frame->data, &hdr, sizeof(spectate_header));
+    memcpy(frame->data + sizeof(spectate_header), cells.data(), cells.size()*sizeof(cell_update));
+    publish(b, frame);
+
+    pthread_mutex_lock(&h->lock);
+    h->opening.push_back(b);
+    pthread_mutex_unlock(&h->lock);
+    return b;
+}
+
+/**
+* \fn void spectate_publish(broadcast* b, world* w, interest_grid* g);
+* \brief Publishes the tick that was just played.
+* \details The squares that changed are copied from the buffers 'interest_update()'
+*          built for the players : the cost only depends on what changed, not on
+*          the number of spectators.
+*/
+void spectate_publish(broadcast* b, world* w, interest_grid* g){
+    spectate_header hdr;
+    int len = 0;
+    size_t i;
+
+    for(i = 0; i < g->touched.size(); i++){
+        len += g->bufs[g->touched[i]]->len;
+    }
+    hdr.tick = w->tick;
+    hdr.flags = 0;
+    hdr.nb_alive = w->nb_alive;
+    hdr.nb_runs = 0;
+    hdr.nb_cells = len / sizeof(cell_update);
+
+    net_buffer* frame = new_net_buffer(sizeof(spectate_header) + len);
+    memcpy(frame->data, &hdr, sizeof(spectate_header));
+    len = sizeof(spectate_header);
+    for(i = 0; i < g->touched.size(); i++){
+        net_buffer* buf = g->bufs[g->touched[i]];
+        memcpy(frame->data + len, buf->data, buf->len);
+        len += buf->len;
+    }
+    publish(b, frame);
+}
+
+/**
+* \fn void spectate_close(broadcast* b);
+* \brief Tells the hub the room of 'b' will publish nothing more. 'b' must not be used anymore.
+*/
+void spectate_close(broadcast* b){
+    pthread_mutex_lock(&b->lock);
+    b->over = true;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Hub =================================================================
+/**
+* \fn void kill_spectator(spectator_hub* h, spectator* s);
+* \brief Closes the socket of 's'. It is freed at the end of the hub's loop.
+*/
+static void kill_spectator(spectator_hub* h, spectator* s){
+    if(s->fd == -1) return;
+
+    epoll_ctl(h->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->fd = -1;
+    send_queue_clear(&s->out);
+    h->nb_spectators--;
+    printf("Spectator hub : a spectator left. Spectators : %i.\n", h->nb_spectators);
+}
+
+/**
+* \fn void flush_spectator(spectator_hub* h, spectator* s);
+* \brief Sends 's' what its socket takes of its send queue. The hub is told
+*        when the socket can take more.
+*/
+static void flush_spectator(spectator_hub* h, spectator* s){
+    if(s->fd == -1) return;
+
+    int ret = send_queue_flush(&s->out, s->fd);
+    if(ret == -1){
+        kill_spectator(h, s);
+        return;
+    }
+    if((ret == 0) != s->writing){
+        struct epoll_event ev;
+        s->writing = (ret == 0);
+        ev.events = s->writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.ptr = s;
+        epoll_ctl(h->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+    }
+}
+
+/**
+* \fn void read_spectator(spectator_hub* h, spectator* s);
+* \brief Spectators have nothing to say : reading only tells when they leave.
+*/
+static void read_spectator(spectator_hub* h, spectator* s){
+    char trash[64];
+    int ret;
+
+    while(s->fd != -1){
+        ret = read(s->fd, trash, sizeof(trash));
+        if(ret == -1 && errno == EINTR) continue;
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if(ret <= 0) kill_spectator(h, s);
+    }
+}
+
+/**
+* \fn void accept_spectators(spectator_hub* h);
+* \brief Accepts every spectator waiting on the listening socket. They wait for a game.
+*/
+static void accept_spectators(spectator_hub* h){
+    int fd;
+
+    while((fd = accept(h->listen_fd, NULL, NULL)) != -1){
+        spectator* s = new spectator;
+        s->fd = fd;
+        s->b = NULL;
+        new_send_queue(&s->out);
+        s->writing = false;
+        s->need_keyframe = true;
+        s->skipping = false;
+        s->stalled_since = 0;
+        if(set_nonblocking(fd) == -1){
+            perror("set_nonblocking in 'accept_spectators()'");
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        epoll_ctl(h->epfd, EPOLL_CTL_ADD, fd, &ev);
+
+        h->waiting.push_back(s);
+        h->nb_spectators++;
+        printf("Spectator hub : a new spectator joined. Spectators : %i.\n", h->nb_spectators);
+    }
+    if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+        perror("accept in 'accept_spectators()'");
+    }
+}
+
+/**
+* \fn bool keeps_up(spectator_hub* h, spectator* s, int tick);
+* \brief Checks that 's' takes what it is sent. A spectator with more than
+*        SPECTATE_HIGH_WATER bytes waiting skips frames until it is back under
+*        SPECTATE_LOW_WATER, and then needs a keyframe.
+* \returns true if 's' can be sent the frame of 'tick'
+*/
+static bool keeps_up(spectator_hub* h, spectator* s, int tick){
+    if(s->skipping){
+        if(s->out.bytes > SPECTATE_LOW_WATER){
+            if(tick - s->stalled_since > SPECTATE_STALL_TICKS){
+                printf("Spectator hub : a spectator is too slow, disconnecting.\n");
+                kill_spectator(h, s);
+            }
+            return false;
+        }
+        s->skipping = false;
+        s->need_keyframe = true;
+        return false;
+    }
+    if(s->out.bytes > SPECTATE_HIGH_WATER){
+        s->skipping = true;
+        s->stalled_since = tick;
+        return false;
+    }
+    return true;
+}
+
+/**
+* \fn void send_buffer(spectator_hub* h, spectator* s, net_buffer* buf);
+* \brief Queues 'buf' for 's', and sends what can be.
+*/
+static void send_buffer(spectator_hub* h, spectator* s, net_buffer* buf){
+    send_queue_push(&s->out, buf);
+    h->bytes_sent += buf->len;
+    flush_spectator(h, s);
+}
+
+/**
+* \fn void mirror_set(broadcast* b, int x, int y, unsigned char content);
+* \brief Sets the square (x, y) of the hub's copy of the arena of 'b'. A chunk
+*        that was blank gets squares of its own once something is put in it.
+*/
+static void mirror_set(broadcast* b, int x, int y, unsigned char content){
+    unsigned char** ch = &b->mirror[(x >> CHUNK_BITS)*b->chunk_cols + (y >> CHUNK_BITS)];
+
+    if(*ch == blank_chunk){
+        if(content == EMPTY) return;
+        *ch = new unsigned char[CHUNK_SIZE*CHUNK_SIZE];
+        memcpy(*ch, blank_chunk, CHUNK_SIZE*CHUNK_SIZE);
+    }
+    (*ch)[((x & CHUNK_MASK) << CHUNK_BITS) | (y & CHUNK_MASK)] = content;
+}
+
+/**
+* \fn void apply_frame(broadcast* b, net_buffer* frame);
+* \brief Applies a frame published by a room to the hub's copy of its arena.
+*/
+static void apply_frame(broadcast* b, net_buffer* frame){
+    spectate_header* hdr = (spectate_header*)frame->data;
+    cell_update* cells = (cell_update*)(frame->data + sizeof(spectate_header));
+    int i;
+
+    for(i = 0; i < hdr->nb_cells; i++){
+        if(cells[i].x < 0 || cells[i].x >= b->height || cells[i].y < 0 || cells[i].y >= b->width) continue;
+        mirror_set(b, cells[i].x, cells[i].y, cells[i].content);
+    }
+    b->mirror_tick = hdr->tick;
+    b->nb_alive = hdr->nb_alive;
+}
+
+/**
+* \fn void add_to_runs(vector<square_run>& runs, square_run* run, unsigned char content, int count);
+* \brief Adds 'count' squares holding 'content' after those of 'run', the run
+*        being built, pushing it to 'runs' each time it ends.
+*/
+static void add_to_runs(vector<square_run>& runs, square_run* run, unsigned char content, int count){
+    while(count > 0){
+        if(run->content != (char)content || run->count == 0xffff){
+            if(run->count > 0) runs.push_back(*run);
+            run->content = content;
+            run->count = 0;
+        }
+        int n = (count < 0xffff - run->count) ? count : 0xffff - run->count;
+        run->count += n;
+        count -= n;
+    }
+}
+
+/**
+* \fn net_buffer* build_keyframe(spectator_hub* h, broadcast* b);
+* \brief Serializes the hub's copy of the arena of 'b', as runs of the same square.
+* \details The runs go row after row, a row being read a chunk at a time : the
+*          part of a blank chunk is a single run.
+* \returns a buffer holding the keyframe, with a single reference
+*/
+static net_buffer* build_keyframe(spectator_hub* h, broadcast* b){
+    vector<square_run> runs;
+    square_run run;
+    int x, y, cy;
+
+    run.content = EMPTY;
+    run.count = 0;
+    for(x = 0; x < b->height; x++){
+        unsigned char** row = b->mirror + (x >> CHUNK_BITS)*b->chunk_cols;
+        const int offset = (x & CHUNK_MASK) << CHUNK_BITS;
+        for(cy = 0; cy < b->chunk_cols; cy++){
+            int n = b->width - cy*CHUNK_SIZE;
+            if(n > CHUNK_SIZE) n = CHUNK_SIZE;
+            if(row[cy] == blank_chunk){
+                add_to_runs(runs, &run, EMPTY, n);
+                continue;
+            }
+            for(y = 0; y < n; y++){
+                add_to_runs(runs, &run, row[cy][offset + y], 1);
+            }
+        }
+    }
+    if(run.count > 0) runs.push_back(run);
+
+    spectate_header hdr;
+    hdr.tick = b->mirror_tick;
+    hdr.flags = FRAME_KEYFRAME;
+    hdr.nb_alive = b->nb_alive;
+    hdr.nb_runs = runs.size();
+    hdr.nb_cells = 0;
+    spectate_info info;
+    info.room = b->room;
+    info.width = b->width;
+    info.height = b->height;
+    info.nb_snakes = b->nb_snakes;
+    info.delay = h->delay;
+
+    int runs_len = runs.size() * sizeof(square_run);
+    net_buffer* frame = new_net_buffer(sizeof(spectate_header) + sizeof(spectate_info) + runs_len);
+    memcpy(frame->data, &hdr, sizeof(spectate_header));
+    memcpy(frame->data + sizeof(spectate_header), &info, sizeof(spectate_info));
+    memcpy(frame->data + sizeof(spectate_header) + sizeof(spectate_info), runs.data(), runs_len);
+    return frame;
+}
+
+/**
+* \fn void free_broadcast(broadcast* b);
+* \brief Frees 'b' and the frames it still holds.
+*/
+static void free_broadcast(broadcast* b){
+    size_t i;
+
+    for(i = 0; i < b->inbox.size(); i++) net_buffer_unref(b->inbox[i]);
+    for(i = 0; i < b->pending.size(); i++) net_buffer_unref(b->pending[i]);
+    pthread_mutex_destroy(&b->lock);
+    for(i = 0; i < (size_t)(b->chunk_rows * b->chunk_cols); i++){
+        if(b->mirror[i] != blank_chunk) delete[] b->mirror[i];
+    }
+    delete[] b->mirror;
+    delete b;
+}
+
+/**
+* \fn void release_frames(spectator_hub* h, broadcast* b);
+* \brief Takes the frames published by the room of 'b', and sends its spectators
+*        those that are now 'delay' ticks old. They all go once the room is over.
+*/
+static void release_frames(spectator_hub* h, broadcast* b){
+    bool over;
+    size_t i;
+
+    pthread_mutex_lock(&b->lock);
+    while(!b->inbox.empty()){
+        b->pending.push_back(b->inbox.front());
+        b->inbox.pop_front();
+    }
+    over = b->over;
+    pthread_mutex_unlock(&b->lock);
+
+    if(b->pending.empty()) return;
+    int newest = ((spectate_header*)b->pending.back()->data)->tick;
+    while(!b->pending.empty()){
+        net_buffer* frame = b->pending.front();
+        int tick = ((spectate_header*)frame->data)->tick;
+        if(!over && tick + h->delay > newest) break;
+        b->pending.pop_front();
+
+        apply_frame(b, frame);
+        for(i = 0; i < b->spectators.size(); i++){
+            spectator* s = b->spectators[i];
+            if(s->fd == -1 || s->need_keyframe) continue;
+            if(keeps_up(h, s, tick)) send_buffer(h, s, frame);
+        }
+        net_buffer_unref(frame);
+    }
+    b->closed = over;
+}
+
+/**
+* \fn void hub_step(spectator_hub* h);
+* \brief Called every tick : takes the new broadcasts, sends spectators the
+*        frames that are old enough, and gives a game to the spectators that have none.
+* \details 1 - let's take the broadcasts of the rooms that started
+*          2 - let's send the frames that waited long enough
+*          3 - let's move the spectators of finished games to the waiting ones
+*          4 - let's give the waiting spectators the newest game
+*          5 - let's send a keyframe to those that need one
+*/
+static void hub_step(spectator_hub* h){
+    vector<broadcast*> opening;
+    broadcast* newest = NULL;
+    size_t i, j;
+
+    //1 - let's take the broadcasts of the rooms that started
+    pthread_mutex_lock(&h->lock);
+    opening.swap(h->opening);
+    pthread_mutex_unlock(&h->lock);
+    for(i = 0; i < opening.size(); i++){
+        h->broadcasts.push_back(opening[i]);
+    }
+
+    //2 - let's send the frames that waited long enough
+    for(i = 0; i < h->broadcasts.size(); i++){
+        release_frames(h, h->broadcasts[i]);
+    }
+
+    //3 - let's move the spectators of finished games to the waiting ones
+    for(i = 0; i < h->broadcasts.size(); ){
+        broadcast* b = h->broadcasts[i];
+        if(!b->closed || !b->pending.empty()){
+            if(b->mirror_tick != -1 && (newest == NULL || b->room > newest->room)) newest = b;
+            i++;
+            continue;
+        }
+        for(j = 0; j < b->spectators.size(); j++){
+            b->spectators[j]->b = NULL;
+            b->spectators[j]->need_keyframe = true;
+            h->waiting.push_back(b->spectators[j]);
+        }
+        free_broadcast(b);
+        h->broadcasts[i] = h->broadcasts.back();
+        h->broadcasts.pop_back();
+    }
+
+    //4 - let's give the waiting spectators the newest game
+    if(newest != NULL){
+        for(i = 0; i < h->waiting.size(); i++){
+            h->waiting[i]->b = newest;
+            newest->spectators.push_back(h->waiting[i]);
+        }
+        h->waiting.clear();
+    }
+
+    //5 - let's send a keyframe to those that need one
+    for(i = 0; i < h->broadcasts.size(); i++){
+        broadcast* b = h->broadcasts[i];
+        net_buffer* keyframe = NULL;
+        for(j = 0; j < b->spectators.size(); j++){
+            spectator* s = b->spectators[j];
+            if(s->fd == -1) continue;
+            if(s->skipping) keeps_up(h, s, b->mirror_tick);
+            if(s->fd == -1 || !s->need_keyframe || s->skipping || b->mirror_tick == -1) continue;
+            if(keyframe == NULL) keyframe = build_keyframe(h, b);
+            send_buffer(h, s, keyframe);
+            s->need_keyframe = false;
+        }
+        if(keyframe != NULL) net_buffer_unref(keyframe);
+    }
+}
+
+/**
+* \fn void forget_dead(vector<spectator*>& v);
+* \brief Frees the spectators of 'v' that were disconnected, and removes them from it.
+*/
+static void forget_dead(vector<spectator*>& v){
+    size_t i;
+
+    for(i = 0; i < v.size(); ){
+        if(v[i]->fd == -1){
+            delete v[i];
+            v[i] = v.back();
+            v.pop_back();
+        }
+        else{
+            i++;
+        }
+    }
+}
+
+/**
+* \fn void* run_hub(void* h_p);
+* \brief Main loop of the hub : waits for spectators and for its timer.
+* \details Disconnected spectators are only freed once every event was handled,
+*          since a later event of the same batch can be about them.
+*/
+static void* run_hub(void* h_p){
+    spectator_hub* h = (spectator_hub*)h_p;
+    struct epoll_event events[SPECTATE_MAX_EVENTS];
+    uint64_t expirations;
+    int nb_events;
+    size_t i;
+    int e;
+
+    trace_thread_name("spectators");
+    while(h->running){
+        TRACE_BEGIN(wait_start);
+        nb_events = epoll_wait(h->epfd, events, SPECTATE_MAX_EVENTS, -1);
+        TRACE_END(wait_start, "epoll_wait", "sleep");
+        if(nb_events == -1){
+            if(errno != EINTR) perror("epoll_wait in 'run_hub()'");
+            continue;
+        }
+
+        for(e = 0; e < nb_events; e++){
+            void* ptr = events[e].data.ptr;
+            if(ptr == &h->listen_fd){
+                accept_spectators(h);
+            }
+            else if(ptr == &h->timer_fd){
+                if(read(h->timer_fd, &expirations, sizeof(uint64_t)) == sizeof(uint64_t)){
+                    TRACE_BEGIN(start);
+                    hub_step(h);
+                    TRACE_END(start, "hub step", "tick");
+                }
+            }
+            else{
+                spectator* s = (spectator*)ptr;
+                if(events[e].events & EPOLLOUT) flush_spectator(h, s);
+                if(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_spectator(h, s);
+            }
+        }
+
+        forget_dead(h->waiting);
+        for(i = 0; i < h->broadcasts.size(); i++){
+            forget_dead(h->broadcasts[i]->spectators);
+        }
+    }
+    return NULL;
+}
+
+/**
+* \fn spectator_hub* new_spectator_hub(int listen_fd, int timestep, int delay);
+* \brief Creates a hub and launches its thread.
+* \param listen_fd listening socket spectators connect to, owned by the hub from now on
+* \param timestep time between two ticks of the rooms, in ms
+* \param delay ticks spectators are behind the games
+* \returns a pointer to the newly created 'spectator_hub'
+*/
+spectator_hub* new_spectator_hub(int listen_fd, int timestep, int delay){
+    spectator_hub* h = new spectator_hub;
+    struct epoll_event ev;
+
+    h->listen_fd = listen_fd;
+    h->timestep = timestep;
+    h->delay = delay;
+    h->nb_spectators = 0;
+    h->bytes_sent = 0;
+    h->running = true;
+    pthread_mutex_init(&h->lock, NULL);
+
+    if((h->epfd = epoll_create1(0)) == -1 || (h->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1){
+        perror("creating spectator hub");
+        exit(1);
+    }
+    if(set_nonblocking(listen_fd) == -1){
+        perror("set_nonblocking in 'new_spectator_hub()'");
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &h->listen_fd;
+    epoll_ctl(h->epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.ptr = &h->timer_fd;
+    epoll_ctl(h->epfd, EPOLL_CTL_ADD, h->timer_fd, &ev);
+
+    struct itimerspec its;
+    its.it_value.tv_sec = timestep / 1000;
+    its.it_value.tv_nsec = (long)(timestep % 1000) * 1000000;
+    its.it_interval = its.it_value;
+    timerfd_settime(h->timer_fd, 0, &its, NULL);
+
+    if(pthread_create(&h->thread, 0, run_hub, h) != 0){
+        printf("error : could not create thread for the spectator hub\n");
+        exit(1);
+    }
+    return h;
+}
+
+/**
+* \fn void free_spectator_hub(spectator_hub* h);
+* \brief Stops the hub, disconnects every spectator and frees the hub.
+* \details The rooms must not publish anymore : the broadcasts are freed too.
+*/
+void free_spectator_hub(spectator_hub* h){
+    size_t i, j;
+
+    h->running = false;
+    pthread_join(h->thread, NULL);     //the timer wakes it up
+
+    for(i = 0; i < h->opening.size(); i++){
+        h->broadcasts.push_back(h->opening[i]);
+    }
+    for(i = 0; i < h->broadcasts.size(); i++){
+        broadcast* b = h->broadcasts[i];
+        for(j = 0; j < b->spectators.size(); j++){
+            h->waiting.push_back(b->spectators[j]);
+        }
+        free_broadcast(b);
+    }
+    for(i = 0; i < h->waiting.size(); i++){
+        if(h->waiting[i]->fd != -1){
+            send_queue_clear(&h->waiting[i]->out);
+            close(h->waiting[i]->fd);
+        }
+        delete h->waiting[i];
+    }
+    printf("Spectator hub : %li bytes sent to spectators.\n", h->bytes_sent);
+
+    close(h->listen_fd);
+    close(h->timer_fd);
+    close(h->epfd);
+    pthread_mutex_destroy(&h->lock);
+    delete h;
+}
@@ -0,0 +1,147 @@
+/**
+* \file spectate.h
+* \brief Spectators : clients watching a game without playing in it.
+* \details Rooms never send anything to spectators themselves. Every tick, a room
+*          hands the squares that changed over to the spectator hub, already
+*          serialized, and goes on. The hub runs in its own thread : it keeps
+*          a copy of every arena a few ticks behind the rooms, and sends that
+*          delayed stream to as many spectators as there are. The copy is made
+*          of chunks of the size of those of the field : the empty ones are
+*          all the same, so that it only takes room where something is.
+*
+*          What a spectator receives :
+*          - a keyframe : a 'spectate_header' with FRAME_KEYFRAME, a 'spectate_info',
+*            then the whole arena as 'nb_runs' 'square_run', row after row
+*          - then a frame per tick : a 'spectate_header' and 'nb_cells' 'cell_update'
+*          A new keyframe comes when the spectator is moved to another room, or
+*          when it was too slow to receive every frame.
+*/
+
+#ifndef H_SPECTATE
+#define H_SPECTATE
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "types.h"
+#include "world.h"
+#include "interest.h"
+#include "net.h"
+
+// CONSTANTS ============================================================
+#define SPECTATE_DELAY 10               /**< default ticks spectators are behind the game */
+#define SPECTATE_HIGH_WATER 262144      /**< bytes waiting for a spectator above which it skips frames */
+#define SPECTATE_LOW_WATER 16384        /**< bytes waiting for a spectator below which it gets a keyframe */
+#define SPECTATE_STALL_TICKS 400        /**< ticks a spectator can stay above SPECTATE_LOW_WATER before being disconnected */
+#define SPECTATE_MAX_EVENTS 64          /**< maximum events the hub handles per 'epoll_wait()' */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef spectate_header
+* \brief First part of what a spectator receives for a tick.
+*/
+struct spectate_header {
+    int tick;           /**< tick the frame describes */
+    int flags;          /**< FRAME_KEYFRAME or 0 */
+    int nb_alive;       /**< snakes still alive */
+    int nb_runs;        /**< number of 'square_run' following, keyframes only */
+    int nb_cells;       /**< number of 'cell_update' following, other frames only */
+};
+
+/**
+* \typedef spectate_info
+* \brief Follows the header of a keyframe : which game is watched.
+*/
+struct spectate_info {
+    int room;           /**< id of the room */
+    int width;          /**< size of the arena */
+    int height;
+    int nb_snakes;
+    int delay;          /**< ticks the stream is behind the game */
+};
+
+/**
+* \typedef square_run
+* \brief 'count' squares in a row holding 'content'.
+*/
+struct square_run {
+    unsigned short count;
+    char content;
+};
+
+struct spectator;
+
+/**
+* \typedef broadcast
+* \brief The stream of a room, from the room to the hub.
+* \details Only 'lock', 'inbox' and 'over' are shared with the room, the rest
+*          belongs to the hub. A frame in 'inbox' belongs to the hub : the room
+*          never touches it again.
+*/
+struct broadcast {
+    int room;
+    int width;
+    int height;
+    int nb_snakes;
+    pthread_mutex_t lock;           /**< protects 'inbox' and 'over' */
+    deque<net_buffer*> inbox;       /**< frames published by the room, not taken by the hub yet */
+    bool over;                      /**< true once the room will publish nothing more */
+
+    bool closed;                    /**< 'over', as the hub last saw it */
+    deque<net_buffer*> pending;     /**< frames taken by the hub, waiting for their delay */
+    int chunk_rows;                 /**< chunks of 'mirror' */
+    int chunk_cols;
+    unsigned char** mirror;         /**< arena as of 'mirror_tick', by chunks of the field, see 'mirror_set()' */
+    int mirror_tick;                /**< last frame applied to 'mirror', -1 if none */
+    int nb_alive;                   /**< snakes alive at 'mirror_tick' */
+    vector<spectator*> spectators;
+};
+
+/**
+* \typedef spectator
+* \brief A client watching a broadcast.
+* \details A spectator that falls behind skips frames until it caught up, and
+*          then gets a keyframe.
+*/
+struct spectator {
+    int fd;
+    broadcast* b;               /**< broadcast watched, NULL while waiting for a game */
+    send_queue out;             /**< what is waiting to be sent to the spectator */
+    bool writing;               /**< true if the hub waits for the socket to accept more */
+    bool need_keyframe;         /**< true if the spectator gets no frame until its next keyframe */
+    bool skipping;              /**< true if the spectator is too slow to receive every frame */
+    int stalled_since;          /**< tick at which the spectator became too slow */
+};
+
+/**
+* \typedef spectator_hub
+* \brief Thread accepting spectators and sending them the broadcasts of the rooms.
+*/
+struct spectator_hub {
+    pthread_t thread;
+    int listen_fd;                  /**< socket spectators connect to */
+    int epfd;                       /**< epoll instance watching 'listen_fd', 'timer_fd' and the spectators */
+    int timer_fd;                   /**< timerfd expiring every tick */
+    int timestep;                   /**< time between two ticks of the rooms, in ms */
+    int delay;                      /**< ticks spectators are behind the games */
+    pthread_mutex_t lock;           /**< protects 'opening' */
+    vector<broadcast*> opening;     /**< broadcasts of the rooms that started, not taken by the hub yet */
+    vector<broadcast*> broadcasts;  /**< broadcasts handled by the hub */
+    vector<spectator*> waiting;     /**< spectators with no game to watch yet */
+    int nb_spectators;
+    long bytes_sent;                /**< bytes queued for spectators */
+    std::atomic<bool> running;      /**< cleared to stop the hub */
+};
+
+// PROTOTYPES ==========================================================
+spectator_hub* new_spectator_hub(int listen_fd, int timestep, int delay);
+void free_spectator_hub(spectator_hub* h);
+
+// Called by the rooms =================================================
+broadcast* spectate_open(spectator_hub* h, world* w, int room);
+void spectate_publish(broadcast* b, world* w, interest_grid* g);
+void spectate_close(broadcast* b);
+
+#endif
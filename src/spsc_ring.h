@@ -0,0 +1,132 @@
+/**
+* \file spsc_ring.h
+* \brief Ring of values handed from one thread to another, without locking.
+* \details A single thread pushes, a single thread pops : they can be the same.
+*          The ring holds SIZE values, a power of 2, and never allocates.
+*          Nothing blocks : a push to a full ring and a pop from an empty one
+*          fail, and tell it.
+*
+*          What the producer writes and what the consumer writes are on cache
+*          lines of their own. Each side keeps the last position of the other
+*          it read, and only reads it again when that one says the ring is
+*          full, or empty : most pushes and pops touch no line of the other side.
+*/
+
+#ifndef H_SPSC_RING
+#define H_SPSC_RING
+
+#include <atomic>
+
+// CONSTANTS ============================================================
+#define CACHE_LINE 64       /**< size of a cache line, in bytes */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef spsc_ring
+* \brief SIZE values of type T, from a producer to a consumer, see the file.
+* \details 'head' and 'tail' count the values pushed and popped since
+*          'init_ring()' : the ring holds 'head - tail' of them.
+*/
+template<class T, int SIZE>
+struct spsc_ring {
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "the size of a ring must be a power of 2");
+
+    alignas(CACHE_LINE) std::atomic<unsigned long> head;    /**< values pushed so far, written by the producer */
+    unsigned long cached_tail;                              /**< last 'tail' the producer read */
+    alignas(CACHE_LINE) std::atomic<unsigned long> tail;    /**< values popped so far, written by the consumer */
+    unsigned long cached_head;                              /**< last 'head' the consumer read */
+    alignas(CACHE_LINE) T values[SIZE];
+};
+
+// FUNCTIONS ===========================================================
+/**
+* \fn void init_ring(spsc_ring<T, SIZE>* r);
+* \brief Empties 'r'. Neither side may use it meanwhile.
+*/
+template<class T, int SIZE>
+void init_ring(spsc_ring<T, SIZE>* r){
+    r->head.store(0, std::memory_order_relaxed);
+    r->tail.store(0, std::memory_order_relaxed);
+    r->cached_tail = 0;
+    r->cached_head = 0;
+}
+
+/**
+* \fn int ring_push_batch(spsc_ring<T, SIZE>* r, const T* v, int n);
+* \brief Pushes the 'n' values of 'v', or as many of them as fit, the first ones.
+*        Called by the producer only.
+* \returns the number of values pushed
+*/
+template<class T, int SIZE>
+int ring_push_batch(spsc_ring<T, SIZE>* r, const T* v, int n){
+    unsigned long head = r->head.load(std::memory_order_relaxed);
+    int i;
+
+    //1 - let's see how much room there is, reading 'tail' again if it seems short
+    if(head - r->cached_tail + n > SIZE) r->cached_tail = r->tail.load(std::memory_order_acquire);
+    if(head - r->cached_tail + n > SIZE) n = SIZE - (int)(head - r->cached_tail);
+
+    //2 - let's write the values, then publish them at once
+    for(i = 0; i < n; i++){
+        r->values[(head + i) & (SIZE - 1)] = v[i];
+    }
+    if(n > 0) r->head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+/**
+* \fn int ring_pop_batch(spsc_ring<T, SIZE>* r, T* out, int max);
+* \brief Pops up to 'max' values into 'out', the oldest first.
+*        Called by the consumer only.
+* \returns the number of values popped
+*/
+template<class T, int SIZE>
+int ring_pop_batch(spsc_ring<T, SIZE>* r, T* out, int max){
+    unsigned long tail = r->tail.load(std::memory_order_relaxed);
+    int n, i;
+
+    //1 - let's see how many values wait, reading 'head' again if it seems too few
+    if(r->cached_head - tail < (unsigned long)max) r->cached_head = r->head.load(std::memory_order_acquire);
+    n = (r->cached_head - tail < (unsigned long)max) ? (int)(r->cached_head - tail) : max;
+
+    //2 - let's read them, then give their slots back at once
+    for(i = 0; i < n; i++){
+        out[i] = r->values[(tail + i) & (SIZE - 1)];
+    }
+    if(n > 0) r->tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+/**
+* \fn bool ring_try_push(spsc_ring<T, SIZE>* r, const T& v);
+* \brief Pushes 'v' if the ring is not full. Called by the producer only.
+* \returns true if 'v' was pushed
+*/
+template<class T, int SIZE>
+bool ring_try_push(spsc_ring<T, SIZE>* r, const T& v){
+    return ring_push_batch(r, &v, 1) == 1;
+}
+
+/**
+* \fn bool ring_try_pop(spsc_ring<T, SIZE>* r, T* out);
+* \brief Pops the oldest value into 'out' if the ring is not empty. Called by
+*        the consumer only.
+* \returns true if a value was popped
+*/
+template<class T, int SIZE>
+bool ring_try_pop(spsc_ring<T, SIZE>* r, T* out){
+    return ring_pop_batch(r, out, 1) == 1;
+}
+
+/**
+* \fn int ring_count(spsc_ring<T, SIZE>* r);
+* \returns the number of values in 'r'. Exact for either side when the other
+*          is idle, otherwise a value it had a moment ago.
+*/
+template<class T, int SIZE>
+int ring_count(spsc_ring<T, SIZE>* r){
+    unsigned long tail = r->tail.load(std::memory_order_acquire);
+    return (int)(r->head.load(std::memory_order_acquire) - tail);
+}
+
+#endif
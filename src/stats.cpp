@@ -0,0 +1,269 @@
+/**
+* \file stats.cpp
+* \brief Histograms used to measure the server, and the phase timers built on them.
+*/
+
+#include <stdio.h>      //for 'fprintf()'
+#include <string.h>     //for 'strncpy()'
+#include <pthread.h>
+
+#include "stats.h"
+
+using namespace std;
+
+/**
+* \fn void init_histogram(histogram* h);
+* \brief Empties 'h'.
+*/
+void init_histogram(histogram* h){
+    int i;
+    for(i = 0; i < HIST_BUCKETS; i++){
+        h->counts[i].store(0, memory_order_relaxed);
+    }
+    h->total.store(0, memory_order_relaxed);
+    h->sum.store(0, memory_order_relaxed);
+    h->max.store(0, memory_order_relaxed);
+}
+
+/**
+* \fn int bucket_of(long us);
+* \returns the bucket counting the value 'us'
+*/
+static int bucket_of(long us){
+    int octave = HIST_SUB_BITS;
+    if(us < (1L << HIST_SUB_BITS)) return us;
+    while(octave < HIST_OCTAVES - 1 && (1L << (octave + 1)) <= us){
+        octave++;
+    }
+    int sub = (us >> (octave - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return ((octave - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+/**
+* \fn long bucket_end(int b);
+* \returns the first value after the ones counted in bucket 'b'
+*/
+static long bucket_end(int b){
+    if(b < (1 << HIST_SUB_BITS)) return b + 1;
+    int octave = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    long sub = b & ((1 << HIST_SUB_BITS) - 1);
+    return ((1L << HIST_SUB_BITS) + sub + 1) << (octave - HIST_SUB_BITS);
+}
+
+/**
+* \fn void histogram_add(histogram* h, long us);
+* \brief Adds a duration of 'us' microseconds to 'h'. Negative durations count as 0.
+* \details Only the thread owning 'h' may call this function.
+*/
+void histogram_add(histogram* h, long us){
+    int b;
+    if(us < 0) us = 0;
+    b = bucket_of(us);
+
+    h->counts[b].store(h->counts[b].load(memory_order_relaxed) + 1, memory_order_relaxed);
+    h->sum.store(h->sum.load(memory_order_relaxed) + us, memory_order_relaxed);
+    if((unsigned long)us > h->max.load(memory_order_relaxed)){
+        h->max.store(us, memory_order_relaxed);
+    }
+    h->total.store(h->total.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+/**
+* \fn void histogram_merge(histogram* h, histogram* from);
+* \brief Adds the values of 'from' to 'h'.
+* \details Only the thread owning 'h' may call this function.
+*/
+void histogram_merge(histogram* h, histogram* from){
+    int i;
+    for(i = 0; i < HIST_BUCKETS; i++){
+        h->counts[i].store(h->counts[i].load(memory_order_relaxed)
+            + from->counts[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    h->sum.store(h->sum.load(memory_order_relaxed) + from->sum.load(memory_order_relaxed), memory_order_relaxed);
+    if(from->max.load(memory_order_relaxed) > h->max.load(memory_order_relaxed)){
+        h->max.store(from->max.load(memory_order_relaxed), memory_order_relaxed);
+    }
+    h->total.store(h->total.load(memory_order_relaxed) + from->total.load(memory_order_acquire), memory_order_release);
+}
+
+/**
+* \fn long histogram_percentile(histogram* h, double p);
+* \returns An upper bound, in us, of the 'p' percentile of the values of 'h'
+*          ('p' between 0 and 1). 0 if 'h' is empty.
+*/
+long histogram_percentile(histogram* h, double p){
+    unsigned long total = h->total.load(memory_order_acquire);
+    unsigned long seen = 0;
+    int b;
+
+    if(total == 0) return 0;
+    for(b = 0; b < HIST_BUCKETS; b++){
+        seen += h->counts[b].load(memory_order_relaxed);
+        if(seen >= p * total) break;
+    }
+    long max = h->max.load(memory_order_relaxed);
+    if(b >= HIST_BUCKETS || bucket_end(b) > max) return max;
+    return bucket_end(b);
+}
+
+/**
+* \fn void print_histogram(FILE* f, const char* name, histogram* h);
+* \brief Prints a one line summary of 'h' on 'f'.
+*/
+void print_histogram(FILE* f, const char* name, histogram* h){
+    unsigned long total = h->total.load(memory_order_acquire);
+    fprintf(f, "%s : %lu values, mean %lu us, p50 <= %li us, p99 <= %li us, max %lu us\n",
+        name, total, total ? h->sum.load(memory_order_relaxed) / total : 0,
+        histogram_percentile(h, 0.5), histogram_percentile(h, 0.99),
+        h->max.load(memory_order_relaxed));
+}
+
+/**
+* \fn void write_histogram_metric(FILE* f, const char* metric, const char* labels, histogram* h, double scale);
+* \brief Writes on 'f' the samples of a Prometheus summary describing 'h' : its
+*        quantiles, sum and count. The '# TYPE' line is up to the caller.
+* \param labels labels of the samples, without braces. Can be empty.
+* \param scale what a value of 'h' is worth in the unit of 'metric'
+*/
+void write_histogram_metric(FILE* f, const char* metric, const char* labels, histogram* h, double scale){
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    const char* sep = (labels[0] != '\0') ? "," : "";
+    unsigned long total = h->total.load(memory_order_acquire);
+    int i;
+
+    for(i = 0; i < 3; i++){
+        fprintf(f, "%s{%s%squantile=\"%g\"} %g\n", metric, labels, sep, quantiles[i],
+            histogram_percentile(h, quantiles[i]) * scale);
+    }
+    fprintf(f, "%s_sum{%s} %g\n", metric, labels, h->sum.load(memory_order_relaxed) * scale);
+    fprintf(f, "%s_count{%s} %lu\n", metric, labels, total);
+}
+
+// Phase timers ========================================================
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;    /**< protects 'timers' */
+static phase_timer* timers = NULL;      /**< every registered timer */
+
+/**
+* \fn void init_phase_timer(phase_timer* t, const char* name, const char** phases, int nb_phases);
+* \brief Empties 't', and names it and its phases. The names of the phases are not copied.
+*/
+void init_phase_timer(phase_timer* t, const char* name, const char** phases, int nb_phases){
+    int i;
+
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->name[sizeof(t->name) - 1] = '\0';
+    t->nb_phases = (nb_phases > MAX_PHASES) ? MAX_PHASES : nb_phases;
+    for(i = 0; i < t->nb_phases; i++){
+        t->phases[i] = phases[i];
+        init_histogram(&t->h[i]);
+    }
+    t->parent = NULL;
+    t->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &t->last);
+}
+
+/**
+* \fn void phase_start(phase_timer* t);
+* \brief The next phase of 't' starts now.
+*/
+void phase_start(phase_timer* t){
+    clock_gettime(CLOCK_MONOTONIC, &t->last);
+}
+
+/**
+* \fn void phase_end(phase_timer* t, int phase);
+* \brief Counts the time since the previous phase ended as time spent in 'phase'.
+*        The next phase starts now.
+*/
+void phase_end(phase_timer* t, int phase){
+    struct timespec now;
+    long ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (now.tv_sec - t->last.tv_sec) * 1000000000L + now.tv_nsec - t->last.tv_nsec;
+    histogram_add(&t->h[phase], ns);
+    if(t->parent != NULL) histogram_add(&t->parent->h[phase], ns);
+    t->last = now;
+}
+
+/**
+* \fn void print_phase_timer(FILE* f, phase_timer* t);
+* \brief Prints on 'f' a line per phase of 't' : how long it lasts, and its share
+*        of the time. Phases that never happened are left out.
+*/
+void print_phase_timer(FILE* f, phase_timer* t){
+    unsigned long all = 0;
+    int i;
+
+    for(i = 0; i < t->nb_phases; i++){
+        all += t->h[i].sum.load(memory_order_relaxed);
+    }
+    for(i = 0; i < t->nb_phases; i++){
+        histogram* h = &t->h[i];
+        unsigned long total = h->total.load(memory_order_acquire);
+        unsigned long sum = h->sum.load(memory_order_relaxed);
+        if(total == 0) continue;
+        fprintf(f, "%s %-8s : %5.1f %% of the time, %lu times, mean %.1f us, p50 <= %.1f us, p99 <= %.1f us, max %.1f us\n",
+            t->name, t->phases[i], all ? 100.0 * sum / all : 0.0, total, total ? sum / 1000.0 / total : 0.0,
+            histogram_percentile(h, 0.5) / 1000.0, histogram_percentile(h, 0.99) / 1000.0,
+            h->max.load(memory_order_relaxed) / 1000.0);
+    }
+}
+
+/**
+* \fn void register_phase_timer(phase_timer* t);
+* \brief Makes 't' part of what 'write_phase_metrics()' writes, until it is unregistered.
+*/
+void register_phase_timer(phase_timer* t){
+    pthread_mutex_lock(&timers_lock);
+    t->next = timers;
+    timers = t;
+    pthread_mutex_unlock(&timers_lock);
+}
+
+/**
+* \fn void unregister_phase_timer(phase_timer* t);
+* \brief Removes 't' from the registered timers. It can be freed afterwards.
+*/
+void unregister_phase_timer(phase_timer* t){
+    phase_timer** p;
+
+    pthread_mutex_lock(&timers_lock);
+    for(p = &timers; *p != NULL; p = &(*p)->next){
+        if(*p == t){
+            *p = t->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&timers_lock);
+}
+
+/**
+* \fn void write_phase_metrics(FILE* f);
+* \brief Writes on 'f' every registered timer, in the Prometheus text format.
+* \details The timers' threads are never waited for.
+*/
+void write_phase_metrics(FILE* f){
+    char labels[128];
+    phase_timer* t;
+    int i;
+
+    pthread_mutex_lock(&timers_lock);
+    fprintf(f, "# HELP snake_phase_seconds Time spent in each phase of a tick.\n");
+    fprintf(f, "# TYPE snake_phase_seconds summary\n");
+    for(t = timers; t != NULL; t = t->next){
+        for(i = 0; i < t->nb_phases; i++){
+            snprintf(labels, sizeof(labels), "thread=\"%s\",phase=\"%s\"", t->name, t->phases[i]);
+            write_histogram_metric(f, "snake_phase_seconds", labels, &t->h[i], 1e-9);
+        }
+    }
+    fprintf(f, "# HELP snake_phase_max_seconds Longest time spent in each phase of a tick.\n");
+    fprintf(f, "# TYPE snake_phase_max_seconds gauge\n");
+    for(t = timers; t != NULL; t = t->next){
+        for(i = 0; i < t->nb_phases; i++){
+            fprintf(f, "snake_phase_max_seconds{thread=\"%s\",phase=\"%s\"} %g\n",
+                t->name, t->phases[i], t->h[i].max.load(memory_order_relaxed) * 1e-9);
+        }
+    }
+    pthread_mutex_unlock(&timers_lock);
+}
@@ -0,0 +1,70 @@
+/**
+* \file stats.h
+*/
+
+#ifndef H_STATS
+#define H_STATS
+
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+
+// CONSTANTS ============================================================
+#define HIST_SUB_BITS 3     /**< every power of 2 is cut into 2^HIST_SUB_BITS buckets */
+#define HIST_OCTAVES 40     /**< values go up to 2^HIST_OCTAVES */
+#define HIST_BUCKETS ((HIST_OCTAVES - HIST_SUB_BITS + 1) << HIST_SUB_BITS)  /**< buckets of a histogram */
+#define MAX_PHASES 10       /**< maximum number of phases of a 'phase_timer' */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef histogram
+* \brief Distribution of durations, in microseconds unless told otherwise, on a logarithmic scale.
+* \details Values below 2^HIST_SUB_BITS have their own bucket. Above, every power
+*          of 2 is cut into 2^HIST_SUB_BITS buckets of equal width : a bucket is
+*          at most 1/2^HIST_SUB_BITS of its values wide.
+*          A histogram has a single writer and any number of readers : the
+*          writer never waits, readers may see a value being added half-way.
+*/
+struct histogram {
+    std::atomic<unsigned long> counts[HIST_BUCKETS];    /**< number of values per bucket */
+    std::atomic<unsigned long> total;                   /**< number of values */
+    std::atomic<unsigned long> sum;                     /**< sum of the values */
+    std::atomic<unsigned long> max;                     /**< biggest value */
+};
+
+/**
+* \typedef phase_timer
+* \brief Time a thread spends in each phase of its ticks, in nanoseconds.
+* \details Phases are timed one after the other : 'phase_end()' counts the time
+*          since the previous phase ended, or since 'phase_start()'. Like its
+*          histograms, a timer is only written by its thread.
+*          A timer can have a parent, counting the phases of all its children.
+*/
+struct phase_timer {
+    char name[32];                      /**< name of the thread */
+    int nb_phases;
+    const char* phases[MAX_PHASES];     /**< name of every phase */
+    histogram h[MAX_PHASES];            /**< duration of every phase, in ns */
+    struct timespec last;               /**< end of the previous phase */
+    phase_timer* parent;                /**< timer also counting every phase of this one, NULL if none */
+    phase_timer* next;                  /**< next registered timer, see 'register_phase_timer()' */
+};
+
+// PROTOTYPES ==========================================================
+void init_histogram(histogram* h);
+void histogram_add(histogram* h, long us);
+void histogram_merge(histogram* h, histogram* from);
+long histogram_percentile(histogram* h, double p);
+void print_histogram(FILE* f, const char* name, histogram* h);
+void write_histogram_metric(FILE* f, const char* metric, const char* labels, histogram* h, double scale);
+
+// Phase timers ========================================================
+void init_phase_timer(phase_timer* t, const char* name, const char** phases, int nb_phases);
+void phase_start(phase_timer* t);
+void phase_end(phase_timer* t, int phase);
+void print_phase_timer(FILE* f, phase_timer* t);
+void register_phase_timer(phase_timer* t);
+void unregister_phase_timer(phase_timer* t);
+void write_phase_metrics(FILE* f);
+
+#endif
@@ -0,0 +1,115 @@
+/**
+* \file timer_wheel.cpp
+* \brief Hierarchical timing wheel of timed effects, see 'timer_wheel.h'.
+*/
+
+#include "types.h"
+#include "timer_wheel.h"
+
+#define TIMER_MASK (TIMER_SLOTS - 1)
+
+/**
+* \fn void place(timer_wheel* tw, timed_effect e);
+* \brief Puts 'e', due at 'tw->now' or later, in the slot of the lowest level
+*        that reaches its tick.
+* \details Effects out of reach of the top level wait in its farthest slot,
+*          and are placed again when the wheel turns to it.
+*/
+static void place(timer_wheel* tw, timed_effect e){
+    int delta = e.due - tw->now;
+    int l;
+
+    for(l = 0; l < TIMER_LEVELS; l++){
+        if((delta >> (TIMER_BITS*(l + 1))) == 0){
+            tw->slots[l][(e.due >> (TIMER_BITS*l)) & TIMER_MASK].push_back(e);
+            tw->nb_waiting++;
+            return;
+        }
+    }
+    l = TIMER_LEVELS - 1;
+    tw->slots[l][((tw->now >> (TIMER_BITS*l)) + TIMER_MASK) & TIMER_MASK].push_back(e);
+    tw->nb_waiting++;
+}
+
+/**
+* \fn void empty_list(effect_list* list, session_arena* arena);
+* \brief Empties 'list', and moves it to 'arena' if it is not there yet.
+*/
+static void empty_list(effect_list* list, session_arena* arena){
+    if(list->get_allocator().arena != arena) *list = effect_list(arena_allocator<timed_effect>(arena));
+    else list->clear();
+}
+
+/**
+* \fn void init_timer_wheel(timer_wheel* tw, int now, session_arena* arena);
+* \brief Empties 'tw' and sets it at tick 'now'.
+* \param arena where the effects wait, NULL for the heap
+*/
+void init_timer_wheel(timer_wheel* tw, int now, session_arena* arena){
+    int l, i;
+
+    tw->now = now;
+    tw->nb_waiting = 0;
+    for(l = 0; l < TIMER_LEVELS; l++){
+        for(i = 0; i < TIMER_SLOTS; i++){
+            empty_list(&tw->slots[l][i], arena);
+        }
+    }
+    empty_list(&tw->fired, arena);
+    empty_list(&tw->spill, arena);
+}
+
+/**
+* \fn void timer_add(timer_wheel* tw, timed_effect e);
+* \brief Makes 'e' fire at tick 'e.due', or on the next tick if it is already past.
+*/
+void timer_add(timer_wheel* tw, timed_effect e){
+    if(e.due <= tw->now) e.due = tw->now + 1;
+    place(tw, e);
+}
+
+/**
+* \fn int timer_advance(timer_wheel* tw);
+* \brief Moves 'tw' to the next tick, and takes out the effects due then.
+* \details Each time the wheel of a level goes round, the next slot of the
+*          level above is placed again, in the levels below.
+* \returns the number of effects that fired, found in 'tw->fired' until the next call
+*/
+int timer_advance(timer_wheel* tw){
+    int l;
+
+    tw->now++;
+    tw->fired.clear();
+    if(tw->nb_waiting == 0) return 0;
+
+    //1 - let's bring down the slots the upper levels turned to, the highest first
+    for(l = TIMER_LEVELS - 1; l > 0; l--){
+        if((tw->now & ((1 << (TIMER_BITS*l)) - 1)) != 0) continue;
+
+        tw->spill.swap(tw->slots[l][(tw->now >> (TIMER_BITS*l)) & TIMER_MASK]);
+        tw->nb_waiting -= tw->spill.size();
+        for(size_t i = 0; i < tw->spill.size(); i++){
+            place(tw, tw->spill[i]);
+        }
+        tw->spill.clear();
+    }
+
+    //2 - let's fire the slot of this tick
+    tw->fired.swap(tw->slots[0][tw->now & TIMER_MASK]);
+    tw->nb_waiting -= tw->fired.size();
+    return tw->fired.size();
+}
+
+/**
+* \fn void timer_list(timer_wheel* tw, vector<timed_effect>& out);
+* \brief Appends to 'out' every effect waiting in 'tw'.
+*/
+void timer_list(timer_wheel* tw, vector<timed_effect>& out){
+    int l, i;
+
+    for(l = 0; l < TIMER_LEVELS; l++){
+        for(i = 0; i < TIMER_SLOTS; i++){
+            out.insert(out.end(), tw->slots[l][i].begin(), tw->slots[l][i].end());
+        }
+    }
+}
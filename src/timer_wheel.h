@@ -0,0 +1,70 @@
+/**
+* \file timer_wheel.h
+* \brief Effects that end, or happen, a number of ticks from now.
+* \details A hierarchical timing wheel : TIMER_LEVELS wheels of TIMER_SLOTS
+*          slots. Level 0 has one slot per tick, level l one slot per
+*          TIMER_SLOTS^l ticks. An effect waits in the level that fits how far
+*          its tick is, and falls to the level below when the wheel turns to
+*          its slot. Advancing one tick only looks at the slots due then :
+*          O(1) amortized, and nothing at all when no effect is waiting.
+*/
+
+#ifndef H_TIMER_WHEEL
+#define H_TIMER_WHEEL
+
+#include <vector>
+
+#include "types.h"
+
+// CONSTANTS ============================================================
+#define TIMER_BITS 6                    /**< a level has 2^TIMER_BITS slots */
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_LEVELS 3                  /**< effects up to 2^(3*TIMER_BITS) ticks away are placed at once */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef effect_kind
+* \brief What a 'timed_effect' does when its tick comes.
+*/
+typedef enum {
+    EFFECT_UNFREEZE,    /**< 'target' stops being frozen */
+    EFFECT_BOOST_END,   /**< 'target' loses the speed-up 'value' */
+    EFFECT_DESPAWN      /**< the item 'value' at 'loc' is taken away if it is still the one that popped at tick 'target' */
+} effect_kind;
+
+/**
+* \typedef timed_effect
+* \brief Something that happens to a snake, or to the field, at tick 'due'.
+*/
+struct timed_effect {
+    int due;        /**< tick the effect fires at */
+    int kind;       /**< an 'effect_kind' */
+    int target;     /**< id of the snake it is about */
+    int value;
+    coord loc;
+};
+
+/**
+* \typedef timer_wheel
+* \brief Effects waiting for their tick, see the file.
+* \details Copying a timer_wheel copies every waiting effect : once its
+*          vectors grew, copying into the same timer_wheel again allocates nothing.
+*          The effects wait in the session arena given to 'init_timer_wheel()'.
+*/
+typedef vector<timed_effect, arena_allocator<timed_effect> > effect_list;
+
+struct timer_wheel {
+    int now;            /**< last tick the wheel was advanced to */
+    int nb_waiting;     /**< effects in the slots */
+    effect_list slots[TIMER_LEVELS][TIMER_SLOTS];
+    effect_list fired;  /**< effects whose tick came on the last 'timer_advance()' */
+    effect_list spill;  /**< slot being moved to the level below */
+};
+
+// PROTOTYPES ==========================================================
+void init_timer_wheel(timer_wheel* tw, int now, session_arena* arena);
+void timer_add(timer_wheel* tw, timed_effect e);
+int timer_advance(timer_wheel* tw);
+void timer_list(timer_wheel* tw, vector<timed_effect>& out);
+
+#endif
@@ -0,0 +1,198 @@
+/**
+* \file trace.cpp
+* \brief Records what the threads do, and writes it as Chrome trace events.
+*/
+
+#include <stdio.h>          //for 'fprintf()'
+#include <stdlib.h>         //for 'getenv()'
+#include <string.h>         //for 'strncpy()'
+#include <time.h>           //for 'clock_gettime()'
+#include <unistd.h>         //for 'getpid()'
+
+#include "trace.h"
+
+using namespace std;
+
+bool trace_on = false;
+
+static FILE* trace_file = NULL;
+static pthread_t flusher;
+static atomic<bool> flushing(false);
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;  //protects 'rings', 'next_tid' and writing to 'trace_file'
+static trace_ring* rings = NULL;        //ring of every thread that traced something
+static int next_tid = 1;
+static thread_local trace_ring* my_ring = NULL;
+
+/**
+* \fn long trace_now();
+* \returns the time in ns given by the monotonic clock
+*/
+long trace_now(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/**
+* \fn trace_ring* get_ring();
+* \returns the ring of the calling thread, created on its first event.
+*/
+static trace_ring* get_ring(){
+    if(my_ring != NULL) return my_ring;
+
+    trace_ring* r = new trace_ring;
+    r->head = 0;
+    r->tail = 0;
+    r->dropped = 0;
+    r->name[0] = '\0';
+    r->named = false;
+
+    pthread_mutex_lock(&rings_lock);
+    r->tid = next_tid++;
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&rings_lock);
+
+    my_ring = r;
+    return r;
+}
+
+/**
+* \fn void trace_thread_name(const char* name);
+* \brief Names the calling thread in the trace.
+*/
+void trace_thread_name(const char* name){
+    if(!trace_on) return;
+    trace_ring* r = get_ring();
+
+    pthread_mutex_lock(&rings_lock);
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    r->named = false;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/**
+* \fn void trace_span(const char* name, const char* cat, long start, long end, const char* arg_name, long arg);
+* \brief Records that the calling thread did 'name' from 'start' to 'end'. Never waits.
+* \details Use 'TRACE_BEGIN()' and 'TRACE_END()' rather than calling it.
+*/
+void trace_span(const char* name, const char* cat, long start, long end, const char* arg_name, long arg){
+    trace_ring* r = get_ring();
+    unsigned long head = r->head.load(memory_order_relaxed);
+
+    if(head - r->tail.load(memory_order_acquire) >= TRACE_RING_SIZE){
+        r->dropped.store(r->dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+    trace_event* e = &r->events[head & (TRACE_RING_SIZE - 1)];
+    e->name = name;
+    e->cat = cat;
+    e->start = start;
+    e->end = end;
+    e->arg_name = arg_name;
+    e->arg = arg;
+    r->head.store(head + 1, memory_order_release);
+}
+
+/**
+* \fn void flush_rings();
+* \brief Writes the events of every ring to the trace file.
+*/
+static void flush_rings(){
+    int pid = getpid();
+    trace_ring* r;
+
+    pthread_mutex_lock(&rings_lock);
+    for(r = rings; r != NULL; r = r->next){
+        if(!r->named && r->name[0] != '\0'){
+            fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%i,\"args\":{\"name\":\"%s\"}},\n",
+                pid, r->tid, r->name);
+            r->named = true;
+        }
+
+        unsigned long head = r->head.load(memory_order_acquire);
+        unsigned long tail = r->tail.load(memory_order_relaxed);
+        for(; tail != head; tail++){
+            trace_event* e = &r->events[tail & (TRACE_RING_SIZE - 1)];
+            fprintf(trace_file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%i,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f",
+                e->name, e->cat, pid, r->tid, e->start / 1000.0, (e->end - e->start) / 1000.0);
+            if(e->arg_name != NULL){
+                fprintf(trace_file, ",\"args\":{\"%s\":%li}", e->arg_name, e->arg);
+            }
+            fprintf(trace_file, "},\n");
+        }
+        r->tail.store(tail, memory_order_release);
+    }
+    fflush(trace_file);
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/**
+* \fn void* run_flusher(void* arg);
+* \brief Main loop of the tracer's thread : empties the rings every TRACE_FLUSH_MS.
+*/
+static void* run_flusher(void* arg){
+    (void)arg;
+    trace_thread_name("tracer");
+    while(flushing){
+        usleep(TRACE_FLUSH_MS * 1000);
+        flush_rings();
+    }
+    return NULL;
+}
+
+/**
+* \fn void trace_start(const char* process_name);
+* \brief Starts tracing if the TRACE_ENV environment variable names a file.
+* \details The calling thread is named after the process.
+*/
+void trace_start(const char* process_name){
+    const char* path = getenv(TRACE_ENV);
+    if(path == NULL || path[0] == '\0' || trace_on) return;
+
+    if((trace_file = fopen(path, "w")) == NULL){
+        perror("fopen in 'trace_start()'");
+        return;
+    }
+    fprintf(trace_file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":\"%s\"}},\n",
+        (int)getpid(), process_name);
+    trace_on = true;
+    trace_thread_name(process_name);
+
+    flushing = true;
+    if(pthread_create(&flusher, 0, run_flusher, NULL) != 0){
+        printf("error : could not create thread for the tracer\n");
+        flushing = false;
+    }
+}
+
+/**
+* \fn void trace_stop();
+* \brief Stops tracing, and writes what is left. Events recorded afterwards are lost.
+*/
+void trace_stop(){
+    trace_ring* r;
+    long dropped = 0;
+
+    if(!trace_on) return;
+    if(flushing){
+        flushing = false;
+        pthread_join(flusher, NULL);
+    }
+    trace_on = false;
+    flush_rings();
+
+    pthread_mutex_lock(&rings_lock);
+    for(r = rings; r != NULL; r = r->next){
+        dropped += r->dropped.load(memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    //the last event ends with a comma : let's end with an event with no comma
+    fprintf(trace_file, "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"g\",\"pid\":%i,\"tid\":0,\"ts\":%.3f,\"args\":{\"dropped\":%li}}\n]\n",
+        (int)getpid(), trace_now() / 1000.0, dropped);
+    fclose(trace_file);
+    trace_file = NULL;
+    if(dropped > 0) printf("Trace : %li events were dropped, the rings were full.\n", dropped);
+}
@@ -0,0 +1,73 @@
+/**
+* \file trace.h
+* \brief Timeline of what every thread does, in the Chrome trace-event format.
+* \details Tracing is off unless the SNAKE_TRACE environment variable names the
+*          file to write, which can then be opened in chrome://tracing or
+*          https://ui.perfetto.dev. When it is off, a traced span costs a test.
+*
+*          Every thread writes its events to a ring of its own, without locking.
+*          A thread of the tracer empties the rings into the file every
+*          TRACE_FLUSH_MS. When a ring is full its events are dropped, and counted.
+*/
+
+#ifndef H_TRACE
+#define H_TRACE
+
+#include <pthread.h>
+#include <atomic>
+
+// CONSTANTS ============================================================
+#define TRACE_ENV "SNAKE_TRACE"     /**< environment variable naming the trace file */
+#define TRACE_RING_SIZE 16384       /**< events a thread can hold before they are written, a power of 2 */
+#define TRACE_FLUSH_MS 100          /**< time between two flushes of the rings, in ms */
+
+// MACROS ==============================================================
+/** Starts a span : 't' is the time it began, 0 if tracing is off. */
+#define TRACE_BEGIN(t) long t = trace_on ? trace_now() : 0
+/** Ends the span started by 'TRACE_BEGIN(t)'. 'name' and 'cat' must be literals, or live as long as the program. */
+#define TRACE_END(t, name, cat) do{ if(trace_on) trace_span(name, cat, t, trace_now(), NULL, 0); }while(0)
+/** Ends the span started by 'TRACE_BEGIN(t)', tagged with the value 'arg' named 'arg_name'. */
+#define TRACE_END_ARG(t, name, cat, arg_name, arg) do{ if(trace_on) trace_span(name, cat, t, trace_now(), arg_name, arg); }while(0)
+
+// STRUCTURES ==========================================================
+/**
+* \typedef trace_event
+* \brief Something a thread did, from 'start' to 'end'.
+*/
+struct trace_event {
+    const char* name;
+    const char* cat;        /**< category, used to filter events */
+    long start;             /**< in ns, on the monotonic clock */
+    long end;
+    const char* arg_name;   /**< name of 'arg', NULL if the event has none */
+    long arg;
+};
+
+/**
+* \typedef trace_ring
+* \brief Events of a thread, waiting to be written.
+* \details The thread is the only one adding events, the tracer's thread the
+*          only one taking them.
+*/
+struct trace_ring {
+    trace_event events[TRACE_RING_SIZE];
+    std::atomic<unsigned long> head;    /**< events added so far */
+    std::atomic<unsigned long> tail;    /**< events taken so far */
+    std::atomic<long> dropped;          /**< events lost because the ring was full */
+    int tid;                            /**< id of the thread in the trace */
+    char name[32];                      /**< name of the thread, empty if it has none */
+    bool named;                         /**< true once 'name' was written to the file */
+    trace_ring* next;                   /**< next ring of the tracer */
+};
+
+// GLOBALS =============================================================
+extern bool trace_on;   /**< true if events are recorded */
+
+// PROTOTYPES ==========================================================
+void trace_start(const char* process_name);
+void trace_stop();
+void trace_thread_name(const char* name);
+long trace_now();
+void trace_span(const char* name, const char* cat, long start, long end, const char* arg_name, long arg);
+
+#endif
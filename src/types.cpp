@@ -13,6 +13,7 @@
 #include <string.h> //for 'memcpy()'
 
 #include "types.h"
+#include "item_index.h"
 #include "game.h"
 
 // Constructors ========================================================
@@ -43,11 +44,12 @@ coord new_coord_empty() {
 }
 
 /**
-* \fn field* new_field();
+* \fn field* new_field(int width, int height, int timestep, session_arena* arena);
 * \brief Used to create a new 'field'
+* \param arena where the field and what is on it are made, NULL for the heap
 * \returns a pointer to the newly created 'field' variable
 */
-field* new_field(int width, int height, int timestep) {
+field* new_field(int width, int height, int timestep, session_arena* arena) {
     struct winsize sz; // Struct containing size of window
     ioctl(0, TIOCGWINSZ, &sz); // Calculate size of window
     //sz.ws_col is the width, sz.ws_col the height of the window
@@ -62,36 +64,42 @@ field* new_field(int width, int height, int timestep) {
 
     int a, b;
 
-    field* map = (field*)malloc(sizeof(field));
+    field* map = (field*)arena_calloc(arena, sizeof(field));
 
+    map->arena = arena;
     map->width = width;
     map->height = height;
-
-    //creation of 'f'
-    map->f = (square**)malloc(map->height*sizeof(square*));
-    for (a = 0; a<map->height; a++) {
-        map->f[a] = (square*)malloc(map->width*sizeof(square));
+    map->changes = NULL;
+    map->items = new_item_index(width, height, arena);
+
+    //creation of the chunks : empty ones, surrounded by a ring of walls
+    map->chunk_rows = (height + CHUNK_MASK) / CHUNK_SIZE + 2;
+    map->chunk_cols = (width + CHUNK_MASK) / CHUNK_SIZE + 2;
+    map->chunks = (field_chunk**)arena_calloc(arena, map->chunk_rows*map->chunk_cols*sizeof(field_chunk*));
+    for (a = 0; a<map->chunk_rows; a++) {
+        for (b = 0; b<map->chunk_cols; b++) {
+            bool ring = a == 0 || b == 0 || a == map->chunk_rows-1 || b == map->chunk_cols-1;
+            map->chunks[a*map->chunk_cols + b] = shared_chunk(ring ? WALL : EMPTY);
+        }
     }
 
-    //initialisation of 'f'
-    coord c = new_coord_empty();
+    //walls : only the chunks they are in get their own copy.
     for (a = 0; a<map->height; a++) {
         for (b = 0; b<map->width; b++) {
-            c.x = a;
-            c.y = b;
             if (a == 1 || a == map->height-1 || b == 1 || b == map->width-1) {
-                map->f[a][b] = WALL;
-                print_to_pos_colored(c, '#', RED);
-            } else {
-                map->f[a][b] = EMPTY;
-                print_to_pos(c, ' ');
+                coord c = new_coord(a, b);
+                set_square_at(map, c, WALL);
+            }
+            else if (a > 1 && a < map->height-1 && b > 1) {
+                b = map->width - 2;     //skip to the right wall
             }
         }
     }
+    field_clean(map);
 
-    map->freeze_snake = map->freeze_schlanga = 0;
     map->timestep = timestep;
     map->speed = 0;
+    map->seed = rand();
 
     return map;
 }
@@ -108,8 +116,9 @@ snake* new_snake(t_type type, int start_pos, field* map) {
         exit(1);
     }
 
-    snake* s = (snake*)malloc(sizeof(snake));
-    s->body = queue<coord>();
+    snake* s;
+    if(map->arena == NULL) s = new snake;   //'body' has to be constructed
+    else s = new (arena_alloc(map->arena, sizeof(snake))) snake(map->arena);
 
     s->type = type;
     s->add_size = false;
@@ -166,13 +175,6 @@ snake* new_snake(t_type type, int start_pos, field* map) {
             break;
     }
 
-    if(s->type == T_SNAKE){
-        print_to_pos_colored(head_coord, 's', BLUE);
-    }
-    if(s->type == T_SCHLANGA){
-        print_to_pos_colored(head_coord, '$', YELLOW);
-    }
-
     push_head(map, s, head_coord);
     //set_square_at(map, head_coord, SNAKE);
 
@@ -181,35 +183,52 @@ snake* new_snake(t_type type, int start_pos, field* map) {
 
 // Destructors =========================================================
 /**
-* \fn void free_snake(snake* s);
-* \brief Used to free memory used by the 's' snake
+* \fn void free_snake(field* map, snake* s);
+* \brief Used to free memory used by the 's' snake, made on 'map'. Snakes made
+*        in a session arena go with it.
+*/
+void free_snake(field* map, snake* s){
+    if(map->arena == NULL) delete s;
+}
+
+/**
+* \fn void free_field_chunk(field* map, field_chunk* ch);
+* \brief Frees 'ch', made by 'new_field_chunk()' for 'map'.
 */
-void free_snake(snake* s){
-    free(s);
+void free_field_chunk(field* map, field_chunk* ch){
+    if(map->arena == NULL) free(ch);
+    else arena_free(map->arena, ch, sizeof(field_chunk));
 }
 
 /**
 * \fn void free_field(field* map);
-* \brief Used to free memory used by the 'map' field
+* \brief Used to free memory used by the 'map' field. Its chunks are left to
+*        its session arena, if it has one.
 */
 void free_field(field* map){
     int i;
-    for(i = 0; i<map->height; i++){
-        free(map->f[i]);
+    delete map->changes;
+    free_item_index(map->items);
+    if(map->arena != NULL) return;
+    for(i = 0; i<map->chunk_rows*map->chunk_cols; i++){
+        if(!map->chunks[i]->shared) free_field_chunk(map, map->chunks[i]);
     }
-    free(map->f);
+    free(map->chunks);
     free(map);
 }
 
 /**
 * \fn void free_all(field* map, snake* s1, snake* s2);
-* \brief frees the field and the two snakes passed in parameter
+* \brief frees the field and the two snakes passed in parameter, and the
+*        session arena they were made in, if any
 */
 void free_all(field* map, snake* s1, snake* s2){
+    session_arena* arena = map->arena;
     //freeing memory
+    free_snake(map, s1);
+    free_snake(map, s2);
     free_field(map);
-    free_snake(s1);
-    free_snake(s2);
+    if(arena != NULL) free_session_arena(arena);
 }
 
 // Objects managment ===================================================
@@ -304,16 +323,96 @@ direction turn_right(direction d){
 * \return the square at 'c' on 'map'
 */
 square get_square_at(field* map, coord c){
-    return map->f[c.x][c.y];
+    field_chunk* ch = map->chunks[((c.x >> CHUNK_BITS) + 1)*map->chunk_cols + (c.y >> CHUNK_BITS) + 1];
+    return (square)ch->squares[((c.x & CHUNK_MASK) << CHUNK_BITS) | (c.y & CHUNK_MASK)];
 }
 
 /**
 * \fn square set_square_at(field* map, coord c, square stuff);
 * \brief Sets 'square' at 'c' on 'map'.
+* \details If 'map->changes' is set, 'c' is logged in it. A shared chunk is
+*          copied before it is written. The items taken away or put are
+*          indexed in 'map->items'.
 */
 void set_square_at(field* map, coord c, square stuff){
     if(c.x == -1 && c.y == -1) return;
-    map->f[c.x][c.y] = stuff;
+    field_chunk** slot = &map->chunks[((c.x >> CHUNK_BITS) + 1)*map->chunk_cols + (c.y >> CHUNK_BITS) + 1];
+    int i = ((c.x & CHUNK_MASK) << CHUNK_BITS) | (c.y & CHUNK_MASK);
+    square old = (square)(*slot)->squares[i];
+    if(old != stuff){
+        if(is_item(old)) item_index_remove(map->items, c, old);
+        if(is_item(stuff)) item_index_add(map->items, c, stuff);
+    }
+    if((*slot)->shared && old != stuff){
+        field_chunk* ch = new_field_chunk(map);
+        memcpy(ch->squares, (*slot)->squares, sizeof(ch->squares));
+        ch->shared = false;
+        *slot = ch;
+    }
+    if(!(*slot)->shared){
+        (*slot)->squares[i] = stuff;
+        (*slot)->dirty = true;
+    }
+    if(map->changes != NULL) map->changes->push_back(c);
+}
+
+/**
+* \fn field_chunk* new_field_chunk(field* map);
+* \returns a new chunk of 'map', not set, to be freed with 'free_field_chunk()'
+*/
+field_chunk* new_field_chunk(field* map){
+    if(map->arena == NULL) return (field_chunk*)malloc(sizeof(field_chunk));
+    return (field_chunk*)arena_alloc(map->arena, sizeof(field_chunk));
+}
+
+/**
+* \fn field_chunk* new_shared_chunk(square stuff);
+* \returns a new chunk full of 'stuff', to be shared
+*/
+static field_chunk* new_shared_chunk(square stuff){
+    field_chunk* ch = new field_chunk;
+    memset(ch->squares, stuff, sizeof(ch->squares));
+    ch->shared = true;
+    ch->dirty = false;
+    return ch;
+}
+
+/**
+* \fn field_chunk* shared_chunk(square stuff);
+* \returns the chunk shared by every field, full of 'stuff' : EMPTY or WALL.
+*/
+field_chunk* shared_chunk(square stuff){
+    static field_chunk* empty = new_shared_chunk(EMPTY);   //created on the first call, by a single thread
+    static field_chunk* walls = new_shared_chunk(WALL);
+    return (stuff == WALL) ? walls : empty;
+}
+
+/**
+* \fn field_chunk* get_chunk(field* map, int cx, int cy);
+* \returns the chunk of 'map' holding the squares from (cx, cy)*CHUNK_SIZE.
+*          -1 and the chunk after the last one are the ring of walls.
+*/
+field_chunk* get_chunk(field* map, int cx, int cy){
+    return map->chunks[(cx + 1)*map->chunk_cols + cy + 1];
+}
+
+/**
+* \fn bool chunk_is_blank(field_chunk* ch);
+* \returns true if 'ch' holds nothing but empty squares, and is shared : scans can skip it.
+*/
+bool chunk_is_blank(field_chunk* ch){
+    return ch == shared_chunk(EMPTY);
+}
+
+/**
+* \fn void field_clean(field* map);
+* \brief Marks every chunk of 'map' as unchanged.
+*/
+void field_clean(field* map){
+    int i;
+    for(i = 0; i<map->chunk_rows*map->chunk_cols; i++){
+        if(!map->chunks[i]->shared) map->chunks[i]->dirty = false;
+    }
 }
 
 /**
@@ -340,7 +439,6 @@ void push_head(field* map, snake* s, coord head) {
 void remove_tail(field* map, snake* s) {
     coord tail = get_tail_coord(s);
     s->body.pop();
-    print_to_pos(tail, ' ');
     set_square_at(map, tail, EMPTY);
 }
 
@@ -364,3 +462,14 @@ coord coord_after_dir(coord c, direction dir){
         exit(0);
     }
 }
+
+/**
+* \fn int field_rand(field* map);
+* \brief Random numbers used to play on 'map'.
+* \details Every field has its own generator, so that a game only depends on its
+*          seed and on the directions its snakes took : it can be replayed.
+* \returns a random number between 0 and RAND_MAX
+*/
+int field_rand(field* map){
+    return rand_r(&map->seed);
+}
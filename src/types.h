@@ -5,9 +5,18 @@
 #ifndef H_TYPES
 #define H_TYPES
 
+#include <deque>
 #include <queue>
+#include <vector>
 using namespace std;
 
+#include "arena.h"
+
+
+// CONSTANTS ============================================================
+#define CHUNK_BITS 6                    /**< a chunk of a field is 2^CHUNK_BITS squares high and wide */
+#define CHUNK_SIZE (1 << CHUNK_BITS)    /**< height and width of a chunk */
+#define CHUNK_MASK (CHUNK_SIZE - 1)     /**< position of a square in its chunk, along one axis */
 
 // STRUCTURES ==========================================================
 /**
@@ -37,6 +46,9 @@ typedef enum {EMPTY, WALL, SNAKE, SCHLANGA, FOOD, POPWALL, HIGHSPEED, LOWSPEED,
 */
 typedef enum {T_SNAKE=2, T_SCHLANGA=3} t_type;
 
+typedef std::deque<coord, arena_allocator<coord> > body_deque;
+typedef std::queue<coord, body_deque> snake_body;   /**< tail at the front, head at the back */
+
 /**
 * \typedef snake
 * \brief Represents a snake
@@ -44,39 +56,76 @@ typedef enum {T_SNAKE=2, T_SCHLANGA=3} t_type;
 *          'head' holds the index of the coordinates of the head in 'body'
 *          'tail' holds the index of the coordinates of the tail in 'body'
 *          'dir' is the direction the snake is currently moving.
+*          The body lives in the arena of the field of the snake, if it has one.
 */
 struct snake {
     t_type type;    /**< type of snake, can be 'SCHLANGA' or 'SNAKE' */
-    std::queue<coord> body;   /**< array containing the coords of every part of the snake*/
+    snake_body body;   /**< array containing the coords of every part of the snake*/
     direction dir;  /**< current direction the snake is faceing */
     bool add_size;
     
+    snake(session_arena* arena = NULL) : body(arena_allocator<coord>(arena)) {}
     int get_size() const {return body.size();}
 };
 
+/**
+* \typedef body_access
+* \brief Gives access to the container of a body, that 'std::queue' keeps for its subclasses.
+*/
+struct body_access : snake_body {
+    static body_deque& of(snake_body& body){
+        return body.*(&body_access::c);
+    }
+};
+
+/**
+* \typedef field_chunk
+* \brief CHUNK_SIZE x CHUNK_SIZE squares of a field.
+* \details A chunk holding nothing but empty squares, or nothing but walls, is
+*          shared by every field and never written : 'set_square_at()' gives the
+*          field its own copy first. A field only owns the chunks something was put in.
+*/
+struct field_chunk {
+    unsigned char squares[CHUNK_SIZE * CHUNK_SIZE];    /**< content of every square, row after row */
+    bool shared;    /**< true for the chunks shared by every field, see 'shared_chunk()' */
+    bool dirty;     /**< true if a square was set since the last 'field_clean()' */
+};
+
+struct item_index;
+
 /**
 * \typedef field
 * \brief Represents the arena on which the game is played
+* \details The field is cut into chunks. Around the arena is a ring of chunks of
+*          walls : squares up to CHUNK_SIZE out of the arena can be read, and are walls.
+*          With a session arena, the field, its chunks and its snakes are made
+*          in it and go with it : 'free_field()' does not free them one by one.
 */
 struct field {
-    square** f;     		/**< 2D array representing the field*/
+    field_chunk** chunks;	/**< 'chunk_rows' x 'chunk_cols' chunks, row after row, the ring included */
+    int chunk_rows;
+    int chunk_cols;
     int width;     			/**< width of the field */
     int height;     		/**< height of the field */
     int timestep;				/**< basic speed of game */
     int speed;
-    int freeze_snake;		/**< freezing-time left for snake */
-    int freeze_schlanga;	/**< freezing-time left for schlanga */
+    vector<coord>* changes;	/**< if not NULL, every square that is set gets logged here */
+    item_index* items;		/**< where the items are, see 'item_index.h' */
+    unsigned int seed;		/**< state of the random generator of the field, see 'field_rand()' */
+    session_arena* arena;	/**< memory of the game the field is in, NULL for the heap */
 };
 
 // PROTOTYPES ==========================================================
 // Constructors ========================================================
 coord new_coord(int x, int y);
 coord new_coord_empty();
-field* new_field(int width, int height, int timestep);
+field* new_field(int width, int height, int timestep, session_arena* arena);
 snake* new_snake(t_type type, int start_pos, field* map);
+field_chunk* new_field_chunk(field* map);
 
 // Destructors =========================================================
-void free_snake(snake* s);
+void free_snake(field* map, snake* s);
+void free_field_chunk(field* map, field_chunk* ch);
 void free_field(field* map);
 void free_all(field* map, snake* s1, snake* s2);
 
@@ -87,10 +136,15 @@ direction turn_left(direction d);
 direction turn_right(direction d);
 square get_square_at(field* map, coord c);
 void set_square_at(field* map, coord c, square stuff);
+field_chunk* shared_chunk(square stuff);
+field_chunk* get_chunk(field* map, int cx, int cy);
+bool chunk_is_blank(field_chunk* ch);
+void field_clean(field* map);
 coord get_head_coord(snake* s);
 coord get_tail_coord(snake* s);
 coord coord_after_dir(coord c, direction dir);
 void remove_tail(field* map, snake* s);
 void push_head(field* map, snake* s, coord head);
+int field_rand(field* map);
 
 #endif
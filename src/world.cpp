@@ -0,0 +1,568 @@
+/**
+* \file world.cpp
+* \brief A multiplayer game, independent from the way it is displayed or played over network.
+* \details Used by the server : each room owns a world and steps it on every tick.
+*/
+
+#include <stdlib.h>     //for 'malloc()'
+#include <string.h>     //for 'memcpy()'
+#include <algorithm>    //for 'sort()'
+
+#include "types.h"
+#include "game.h"
+#include "world.h"
+
+/**
+* \fn world* new_world(int width, int height, int timestep, int nb_snakes, session_arena* arena);
+* \brief Creates a field of size 'width'x'height' and 'nb_snakes' snakes on it.
+* \details Snakes are placed exactly like 'play_client()' places them, so that
+*          every client starts with the same arena as the server.
+* \param arena where the world and all it holds are made, NULL for the heap
+* \returns a pointer to the newly created 'world'
+*/
+world* new_world(int width, int height, int timestep, int nb_snakes, session_arena* arena) {
+    world* w = new (arena_calloc(arena, sizeof(world))) world;   //the wheel has to be constructed
+    int i;
+
+    w->map = new_field(width, height, timestep, arena);
+    w->nb_snakes = nb_snakes;
+    w->nb_alive = nb_snakes;
+    w->tick = 0;
+    w->last_item = (square)-1;
+    w->last_item_loc = new_coord(-1, -1);
+
+    w->snakes = (snake**)arena_calloc(arena, nb_snakes*sizeof(snake*));
+    w->dirs = (direction*)arena_calloc(arena, nb_snakes*sizeof(direction));
+    w->periods = (int*)arena_calloc(arena, nb_snakes*sizeof(int));
+    w->next_moves = (int*)arena_calloc(arena, nb_snakes*sizeof(int));
+    w->frozen = (int*)arena_calloc(arena, nb_snakes*sizeof(int));
+    w->boosts = (int*)arena_calloc(arena, nb_snakes*sizeof(int));
+    w->round = 0;
+    for (i = 0; i < nb_snakes; i++) {
+        if (i == 1) w->snakes[i] = new_snake(T_SCHLANGA, i, w->map);
+        else w->snakes[i] = new_snake(T_SNAKE, i, w->map);
+        w->dirs[i] = w->snakes[i]->dir;
+        w->periods[i] = WORLD_SUBSTEPS;
+        w->next_moves[i] = WORLD_SUBSTEPS;     //last sub-step of the first step
+    }
+    world_schedule(w);
+    init_timer_wheel(&w->effects, 0, arena);
+
+    return w;
+}
+
+/**
+* \fn void free_world(world* w);
+* \brief Used to free memory used by the 'w' world, its field and its snakes
+* \details In a session arena, only what the containers of the world hold goes
+*          back to the heap : the rest goes with the arena, however big the world.
+*/
+void free_world(world* w) {
+    session_arena* arena = w->map->arena;
+    int i;
+    if (arena == NULL) {
+        for (i = 0; i < w->nb_snakes; i++) {
+            free_snake(w->map, w->snakes[i]);
+        }
+        free(w->snakes);
+        free(w->dirs);
+        free(w->periods);
+        free(w->next_moves);
+        free(w->frozen);
+        free(w->boosts);
+    }
+    free_field(w->map);
+    w->~world();
+    if (arena == NULL) free(w);
+}
+
+/**
+* \fn void world_schedule(world* w);
+* \brief Puts every living snake of 'w' in the slot of the wheel of the sub-step
+*        it moves next at. Needed once 'next_moves' was set from outside.
+*/
+void world_schedule(world* w) {
+    int i;
+
+    for (i = 0; i < MOVE_WHEEL; i++) {
+        w->wheel[i].resize(0);     //game.h makes a macro of "clear"
+    }
+    for (i = 0; i < w->nb_snakes; i++) {
+        if (w->dirs[i] != DEAD_DIR) w->wheel[w->next_moves[i] & (MOVE_WHEEL - 1)].push_back(i);
+    }
+}
+
+/**
+* \fn void boost(world* w, int id, int speed_up);
+* \brief Adds 'speed_up' to the speed-up of snake 'id' for BOOST_TIME steps.
+* \details The pace of a snake only depends on the speed-ups running, so they
+*          can wear off in any order.
+*/
+static void boost(world* w, int id, int speed_up) {
+    timed_effect e;
+    int period;
+
+    w->boosts[id] += speed_up;
+    period = WORLD_SUBSTEPS - w->boosts[id];
+    if (period < MIN_PERIOD) period = MIN_PERIOD;
+    if (period > MAX_PERIOD) period = MAX_PERIOD;
+    w->periods[id] = period;
+
+    if (speed_up == 0) return;
+    e.due = w->tick + BOOST_TIME;
+    e.kind = EFFECT_BOOST_END;
+    e.target = id;
+    e.value = speed_up;
+    timer_add(&w->effects, e);
+}
+
+/**
+* \fn void freeze_others(world* w, int id);
+* \brief Freezes every living snake but 'id' for FREEZING_TIME steps, this one
+*        included.
+*/
+static void freeze_others(world* w, int id) {
+    timed_effect e;
+    int i;
+
+    e.due = w->tick + FREEZING_TIME;
+    e.kind = EFFECT_UNFREEZE;
+    for (i = 0; i < w->nb_snakes; i++) {
+        if (i == id || w->dirs[i] == DEAD_DIR) continue;
+        w->frozen[i]++;
+        e.target = i;
+        timer_add(&w->effects, e);
+    }
+}
+
+/**
+* \fn unsigned int claim_hash(coord c);
+* \returns where the claim of 'c' starts looking in the table of claims
+*/
+static inline unsigned int claim_hash(coord c) {
+    return ((unsigned int)c.x * 0x9E3779B1u) ^ ((unsigned int)c.y * 0x85EBCA77u);
+}
+
+/**
+* \fn cell_claim& find_claim(world* w, coord c, unsigned int mask);
+* \returns the slot of the claims of 'c' at the current sub-step, or the free
+*          slot it goes in : one whose round is not 'w->round'
+*/
+static cell_claim& find_claim(world* w, coord c, unsigned int mask) {
+    unsigned int i = claim_hash(c) & mask;
+    while (true) {
+        cell_claim& cl = w->claims[i];
+        if (cl.round != w->round || (cl.c.x == c.x && cl.c.y == c.y)) return cl;
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+* \fn void resolve(world* w);
+* \brief Decides which of the moves of 'w->intents' kill their snake.
+* \details A snake dies if its head goes to a wall or a snake, as the field was
+*          before anyone moved this sub-step, or to a square another head goes
+*          to as well : every snake involved dies, whatever their ids.
+*          The squares heads go to are claimed in a table of at least twice as
+*          many slots as moves, a power of 2, probed linearly. Its slots are
+*          freed all at once by the next round : the table is only allocated
+*          when more snakes than ever move at once, however big the arena.
+*/
+static void resolve(world* w) {
+    size_t nb = w->intents.size();
+    unsigned int size = MIN_CLAIMS;
+    size_t k;
+
+    //1 - let's claim the squares heads go to
+    while (size < 2*nb) size <<= 1;
+    if (w->claims.size() < size) w->claims.resize(size);     //new slots have round 0, never the current one
+    w->round++;
+    for (k = 0; k < nb; k++) {
+        cell_claim& cl = find_claim(w, w->intents[k].head, size - 1);
+        if (cl.round != w->round) {
+            cl.round = w->round;
+            cl.c = w->intents[k].head;
+            cl.id = w->intents[k].id;
+        }
+        else cl.id = -1;
+    }
+
+    //2 - let's find who dies
+    for (k = 0; k < nb; k++) {
+        move_intent& it = w->intents[k];
+        it.dies = (it.ahead == WALL || it.ahead == SNAKE || it.ahead == SCHLANGA);
+        if (!it.dies && find_claim(w, it.head, size - 1).id == -1) it.dies = true;
+    }
+}
+
+/**
+* \fn int world_move(world* w);
+* \brief First half of a step : moves every living snake whose time came in its
+*        direction, as many times as its pace allows during the step.
+* \details At normal speed, every snake moves once, on the last sub-step.
+*          The snakes moving at a sub-step do it at the same time, in 3 phases :
+*          1 - every snake tells where its head goes, reading the field only,
+*              independently of the others
+*          2 - 'resolve()' decides who dies, see it
+*          3 - the survivors move, then take what they went on, in the order
+*              of their ids for the items using the random generator of the field
+*          Ids never decide who lives. A snake that dies does not move, gets
+*          DEAD_DIR as direction, and is never moved again.
+*          HIGHSPEED and LOWSPEED only change the pace of the snake that took them.
+*          A frozen snake lets its sub-steps go by without moving.
+* \returns the number of snakes that died
+*/
+int world_move(world* w) {
+    field* map = w->map;
+    int nb_dead = 0;
+    int sub;
+    size_t i, k;
+
+    for (sub = 1; sub <= WORLD_SUBSTEPS; sub++) {
+        int now = w->tick*WORLD_SUBSTEPS + sub;
+        vector<int>& due = w->wheel[now & (MOVE_WHEEL - 1)];
+        if (due.empty()) continue;
+        sort(due.begin(), due.end());
+
+        //1 - let's see where every head goes
+        //a snake is scheduled at most MAX_PERIOD sub-steps ahead : never in 'due'
+        w->intents.resize(0);
+        for (i = 0; i < due.size(); i++) {
+            int id = due[i];
+            if (w->dirs[id] == DEAD_DIR) continue;     //killed since it was scheduled
+            if (w->frozen[id] > 0) {
+                w->next_moves[id] = now + w->periods[id];
+                w->wheel[w->next_moves[id] & (MOVE_WHEEL - 1)].push_back(id);
+                continue;
+            }
+
+            move_intent it;
+            it.id = id;
+            it.head = coord_after_dir(get_head_coord(w->snakes[id]), w->dirs[id]);
+            it.ahead = get_square_at(map, it.head);
+            w->intents.push_back(it);
+        }
+
+        //2 - let's find who dies
+        resolve(w);
+
+        //3 - let's move the survivors
+        for (k = 0; k < w->intents.size(); k++) {
+            move_intent& it = w->intents[k];
+            snake* s = w->snakes[it.id];
+            if (it.dies) {
+                w->dirs[it.id] = DEAD_DIR;
+                w->nb_alive--;
+                nb_dead++;
+                continue;
+            }
+
+            bool grows = s->add_size || it.ahead == FOOD;
+            s->add_size = false;
+            s->dir = w->dirs[it.id];
+            push_head(map, s, it.head);
+            if (!grows) remove_tail(map, s);     //no head goes to a square a snake was on
+        }
+        for (k = 0; k < w->intents.size(); k++) {
+            move_intent& it = w->intents[k];
+            if (it.dies) continue;
+            if (it.ahead == POPWALL) pop_walls(map);
+            if (it.ahead == HIGHSPEED) boost(w, it.id, 1);
+            if (it.ahead == LOWSPEED) boost(w, it.id, -1);
+            if (it.ahead == FREEZE) freeze_others(w, it.id);
+
+            w->next_moves[it.id] = now + w->periods[it.id];
+            w->wheel[w->next_moves[it.id] & (MOVE_WHEEL - 1)].push_back(it.id);
+        }
+        due.resize(0);
+    }
+    return nb_dead;
+}
+
+/**
+* \fn void world_items(world* w);
+* \brief Second half of a step : maybe pops an item, ends the step, and lets
+*        wear off what was due at the new step.
+*/
+void world_items(world* w) {
+    size_t i;
+
+    w->last_item = (square)-1;
+    if (field_rand(w->map) % ITEM_CHANCE == 0) {
+        w->last_item = pop_item(w->map, false, w->last_item_loc);
+        if (w->last_item > 0) {
+            timed_effect e;
+            item_index_set_tag(w->map->items, w->last_item_loc, w->last_item, w->tick);
+            e.due = w->tick + ITEM_LIFETIME;
+            e.kind = EFFECT_DESPAWN;
+            e.target = w->tick;
+            e.value = w->last_item;
+            e.loc = w->last_item_loc;
+            timer_add(&w->effects, e);
+        }
+    }
+
+    w->tick++;
+    timer_advance(&w->effects);
+    for (i = 0; i < w->effects.fired.size(); i++) {
+        timed_effect& e = w->effects.fired[i];
+        switch (e.kind) {
+            case EFFECT_UNFREEZE:
+                w->frozen[e.target]--;
+                break;
+            case EFFECT_BOOST_END:
+                boost(w, e.target, -e.value);
+                break;
+            case EFFECT_DESPAWN:
+                //someone may have taken it, and something else be there now, even
+                //another item of the same kind : the tag tells them apart
+                if (get_square_at(w->map, e.loc) == e.value
+                    && item_index_tag(w->map->items, e.loc, (square)e.value) == e.target) {
+                    set_square_at(w->map, e.loc, EMPTY);
+                }
+                break;
+        }
+    }
+}
+
+/**
+* \fn int world_step(world* w);
+* \brief Moves every living snake one square in its direction, then maybe pops an item.
+* \returns the number of snakes that died during this step
+*/
+int world_step(world* w) {
+    int nb_dead = world_move(w);
+    world_items(w);
+    return nb_dead;
+}
+
+// Snapshots ===========================================================
+/**
+* \fn world_snapshot* new_world_snapshot(world* w, bool cow);
+* \brief Creates a snapshot for 'w', holding nothing until 'world_save()'.
+* \param cow true for the copy-on-write mode, see 'world_snapshot'
+* \returns a pointer to the newly created 'world_snapshot'
+*/
+world_snapshot* new_world_snapshot(world* w, bool cow) {
+    world_snapshot* snap = new world_snapshot;
+    size_t body_size = 0;
+    int i;
+
+    snap->cow = cow;
+    snap->saved = false;
+    snap->nb_chunks = w->map->chunk_rows * w->map->chunk_cols;
+    snap->shared = (field_chunk**)malloc(snap->nb_chunks*sizeof(field_chunk*));
+    snap->slots = (int*)malloc(snap->nb_chunks*sizeof(int));
+    snap->nb_slots = 0;
+    snap->max_slots = MIN_SNAPSHOT_SLOTS;
+    for (i = 0; i < snap->nb_chunks; i++) {
+        snap->slots[i] = -1;
+        if (!w->map->chunks[i]->shared) snap->max_slots++;
+    }
+    snap->squares = (unsigned char*)malloc((size_t)snap->max_slots*CHUNK_SIZE*CHUNK_SIZE);
+    snap->items = new_item_index(w->map->width, w->map->height, w->map->arena);
+    snap->dirs = (direction*)malloc(w->nb_snakes*sizeof(direction));
+    snap->snake_dirs = (direction*)malloc(w->nb_snakes*sizeof(direction));
+    snap->periods = (int*)malloc(w->nb_snakes*sizeof(int));
+    snap->next_moves = (int*)malloc(w->nb_snakes*sizeof(int));
+    snap->frozen = (int*)malloc(w->nb_snakes*sizeof(int));
+    snap->boosts = (int*)malloc(w->nb_snakes*sizeof(int));
+    snap->add_size = (bool*)malloc(w->nb_snakes*sizeof(bool));
+    snap->body_sizes = (int*)malloc(w->nb_snakes*sizeof(int));
+    for (i = 0; i < w->nb_snakes; i++) {
+        body_size += w->snakes[i]->get_size();
+    }
+    snap->bodies.reserve(2*body_size + SNAPSHOT_BODY_SLACK*w->nb_snakes);   //it grows with the snakes
+
+    return snap;
+}
+
+/**
+* \fn void free_world_snapshot(world_snapshot* snap);
+* \brief Used to free memory used by 'snap'.
+*/
+void free_world_snapshot(world_snapshot* snap) {
+    free(snap->shared);
+    free(snap->slots);
+    free(snap->squares);
+    free_item_index(snap->items);
+    free(snap->dirs);
+    free(snap->snake_dirs);
+    free(snap->periods);
+    free(snap->next_moves);
+    free(snap->frozen);
+    free(snap->boosts);
+    free(snap->add_size);
+    free(snap->body_sizes);
+    delete snap;
+}
+
+/**
+* \fn int new_snapshot_slot(world_snapshot* snap);
+* \brief Gives a slot of 'snap->squares' to a chunk, growing it if it is full.
+* \returns the slot given
+*/
+static int new_snapshot_slot(world_snapshot* snap) {
+    if (snap->nb_slots == snap->max_slots) {
+        snap->max_slots *= 2;
+        snap->squares = (unsigned char*)realloc(snap->squares, (size_t)snap->max_slots*CHUNK_SIZE*CHUNK_SIZE);
+    }
+    return snap->nb_slots++;
+}
+
+/**
+* \fn unsigned char* snapshot_squares(world_snapshot* snap, int i);
+* \returns the squares saved for chunk 'i', which the field had its own of
+*/
+static unsigned char* snapshot_squares(world_snapshot* snap, int i) {
+    return snap->squares + (size_t)snap->slots[i]*CHUNK_SIZE*CHUNK_SIZE;
+}
+
+/**
+* \fn void world_save(world* w, world_snapshot* snap);
+* \brief Saves the state of 'w' in 'snap', made for it.
+*/
+void world_save(world* w, world_snapshot* snap) {
+    field* map = w->map;
+    size_t chunk_size = CHUNK_SIZE*CHUNK_SIZE;
+    int i;
+
+    //1 - let's save the chunks : a shared one is kept as it is
+    for (i = 0; i < snap->nb_chunks; i++) {
+        field_chunk* ch = map->chunks[i];
+        if (ch->shared) {
+            snap->shared[i] = ch;
+        } else {
+            if (snap->slots[i] == -1) {
+                snap->slots[i] = new_snapshot_slot(snap);
+            } else if (snap->cow && snap->saved && !ch->dirty && snap->shared[i] == NULL) {
+                continue;
+            }
+            memcpy(snapshot_squares(snap, i), ch->squares, chunk_size);
+            snap->shared[i] = NULL;
+        }
+    }
+    if (snap->cow) field_clean(map);
+
+    //2 - let's save the rest of the field and of the world
+    snap->timestep = map->timestep;
+    snap->speed = map->speed;
+    snap->seed = map->seed;
+    copy_item_index(snap->items, map->items);
+    memcpy(snap->dirs, w->dirs, w->nb_snakes*sizeof(direction));
+    memcpy(snap->periods, w->periods, w->nb_snakes*sizeof(int));
+    memcpy(snap->next_moves, w->next_moves, w->nb_snakes*sizeof(int));
+    memcpy(snap->frozen, w->frozen, w->nb_snakes*sizeof(int));
+    memcpy(snap->boosts, w->boosts, w->nb_snakes*sizeof(int));
+    snap->effects = w->effects;
+    snap->nb_alive = w->nb_alive;
+    snap->tick = w->tick;
+    snap->last_item = w->last_item;
+    snap->last_item_loc = w->last_item_loc;
+
+    //3 - let's save the snakes
+    snap->bodies.resize(0);     //game.h makes a macro of "clear"
+    for (i = 0; i < w->nb_snakes; i++) {
+        snake* s = w->snakes[i];
+        body_deque& body = body_access::of(s->body);
+        snap->snake_dirs[i] = s->dir;
+        snap->add_size[i] = s->add_size;
+        snap->body_sizes[i] = body.size();
+        snap->bodies.insert(snap->bodies.end(), body.begin(), body.end());
+    }
+    snap->saved = true;
+}
+
+/**
+* \fn void world_restore(world* w, world_snapshot* snap);
+* \brief Puts 'w' back in the state saved in 'snap'.
+* \details The squares restored are not logged in 'map->changes'. Out of the
+*          copy-on-write mode, 'w' can be another world than the one 'snap' was
+*          made for, as long as it has the same size and as many snakes.
+*/
+void world_restore(world* w, world_snapshot* snap) {
+    field* map = w->map;
+    size_t chunk_size = CHUNK_SIZE*CHUNK_SIZE;
+    coord* saved_body = snap->bodies.data();
+    int i;
+
+    //1 - let's restore the chunks : one the field has its own copy of since
+    //the save goes back to being shared, and the other way around
+    for (i = 0; i < snap->nb_chunks; i++) {
+        field_chunk* ch = map->chunks[i];
+        if (snap->shared[i] != NULL) {
+            if (ch != snap->shared[i]) {
+                if (!ch->shared) free_field_chunk(map, ch);
+                map->chunks[i] = snap->shared[i];
+            }
+            continue;
+        }
+        if (ch->shared) {
+            ch = new_field_chunk(map);
+            ch->shared = false;
+            map->chunks[i] = ch;
+        } else if (snap->cow && !ch->dirty) {
+            continue;
+        }
+        memcpy(ch->squares, snapshot_squares(snap, i), chunk_size);
+        ch->dirty = true;
+    }
+    if (snap->cow) field_clean(map);
+
+    //2 - let's restore the rest of the field and of the world
+    map->timestep = snap->timestep;
+    map->speed = snap->speed;
+    map->seed = snap->seed;
+    copy_item_index(map->items, snap->items);
+    memcpy(w->dirs, snap->dirs, w->nb_snakes*sizeof(direction));
+    memcpy(w->periods, snap->periods, w->nb_snakes*sizeof(int));
+    memcpy(w->next_moves, snap->next_moves, w->nb_snakes*sizeof(int));
+    memcpy(w->frozen, snap->frozen, w->nb_snakes*sizeof(int));
+    memcpy(w->boosts, snap->boosts, w->nb_snakes*sizeof(int));
+    w->effects = snap->effects;
+    w->nb_alive = snap->nb_alive;
+    w->tick = snap->tick;
+    w->last_item = snap->last_item;
+    w->last_item_loc = snap->last_item_loc;
+
+    //3 - let's restore the snakes
+    for (i = 0; i < w->nb_snakes; i++) {
+        snake* s = w->snakes[i];
+        s->dir = snap->snake_dirs[i];
+        s->add_size = snap->add_size[i];
+        body_access::of(s->body).assign(saved_body, saved_body + snap->body_sizes[i]);
+        saved_body += snap->body_sizes[i];
+    }
+    world_schedule(w);
+}
+
+/**
+* \fn int world_diff(world* w, world_snapshot* snap, vector<coord>& out);
+* \brief Appends to 'out' every square of the arena of 'w' that differs from the
+*        field saved in 'snap'.
+* \returns the number of squares appended
+*/
+int world_diff(world* w, world_snapshot* snap, vector<coord>& out) {
+    field* map = w->map;
+    size_t chunk_size = CHUNK_SIZE*CHUNK_SIZE;
+    int nb = 0;
+    int i;
+    size_t j;
+
+    for (i = 0; i < snap->nb_chunks; i++) {
+        const unsigned char* saved = (snap->shared[i] != NULL) ? snap->shared[i]->squares : snapshot_squares(snap, i);
+        const unsigned char* now = map->chunks[i]->squares;
+        if (saved == now || memcmp(saved, now, chunk_size) == 0) continue;
+
+        int x0 = (i / map->chunk_cols - 1) * CHUNK_SIZE;
+        int y0 = (i % map->chunk_cols - 1) * CHUNK_SIZE;
+        for (j = 0; j < chunk_size; j++) {
+            if (saved[j] == now[j]) continue;
+            coord c = new_coord(x0 + (j >> CHUNK_BITS), y0 + (j & CHUNK_MASK));
+            if (c.x < 0 || c.y < 0 || c.x >= map->height || c.y >= map->width) continue;
+            out.push_back(c);
+            nb++;
+        }
+    }
+    return nb;
+}
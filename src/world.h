@@ -0,0 +1,140 @@
+/**
+* \file world.h
+*/
+
+#ifndef H_WORLD
+#define H_WORLD
+
+#include <vector>
+
+#include "types.h"
+#include "timer_wheel.h"
+#include "item_index.h"
+
+// CONSTANTS ============================================================
+#define DEAD_DIR ((direction)4)   /**< direction of a snake that is dead */
+#define ITEM_CHANCE 4             /**< an item pops once every ITEM_CHANCE steps, on average */
+#define WORLD_SUBSTEPS 4          /**< snakes move on a clock WORLD_SUBSTEPS times finer than the steps */
+#define MIN_PERIOD 2              /**< sub-steps between two moves of the fastest snakes */
+#define MAX_PERIOD 8              /**< sub-steps between two moves of the slowest snakes */
+#define MOVE_WHEEL 16             /**< slots of the wheel of moves, a power of 2 above MAX_PERIOD */
+#define BOOST_TIME 30             /**< steps a HIGHSPEED or LOWSPEED changes the pace of a snake for */
+#define ITEM_LIFETIME 150         /**< steps an item stays on the field if nobody takes it */
+#define MIN_CLAIMS 16             /**< slots of the table of claims, at least : a power of 2 */
+#define MIN_SNAPSHOT_SLOTS 4      /**< slots of chunks a snapshot has room for, besides the chunks its world has its own of */
+#define SNAPSHOT_BODY_SLACK 64    /**< squares of body a snapshot has room for, per snake, besides twice the snakes */
+
+// STRUCTURES ==========================================================
+/**
+* \typedef move_intent
+* \brief Where a snake moving at the current sub-step goes, see 'world_move()'.
+*/
+struct move_intent {
+    int id;             /**< snake moving */
+    coord head;         /**< square its head goes to */
+    square ahead;       /**< what the square held before anyone moved */
+    bool dies;
+};
+
+/**
+* \typedef cell_claim
+* \brief Snake whose head goes to a square at some sub-step, in the table of
+*        claims of the world.
+*/
+struct cell_claim {
+    unsigned int round;     /**< 'world.round' the square was claimed at, the slot is free if it is another */
+    coord c;                /**< square claimed */
+    int id;                 /**< snake that claimed it, -1 if several did */
+};
+
+/**
+* \typedef world
+* \brief Everything a multiplayer game needs to advance : the field and every snake on it.
+* \details 'dirs[i]' is the direction snake 'i' will take on the next step,
+*          or DEAD_DIR once it died.
+*          Every snake moves at its own pace : once every 'periods[i]' sub-steps,
+*          WORLD_SUBSTEPS at normal speed. Sub-step s of step t is numbered
+*          (t - 1)*WORLD_SUBSTEPS + s, s going from 1 to WORLD_SUBSTEPS.
+*          Snakes are kept in a timing wheel, in the slot of the sub-step they
+*          move next at : a sub-step only looks at the snakes moving then.
+*          What wears off, freezes, speed-ups and items, waits in 'effects' :
+*          a FREEZE freezes every other snake for FREEZING_TIME steps, a
+*          HIGHSPEED or LOWSPEED changes the pace of the snake for BOOST_TIME
+*          steps, and items vanish after ITEM_LIFETIME steps.
+*/
+struct world {
+    field* map;             /**< arena on which the game is played */
+    snake** snakes;         /**< every snake of the game, indexed by player id */
+    direction* dirs;        /**< direction of every snake for the next step */
+    int* periods;           /**< sub-steps between two moves of every snake */
+    int* next_moves;        /**< sub-step every snake moves next at */
+    vector<int> wheel[MOVE_WHEEL];  /**< ids of the living snakes moving at sub-step s, in slot s % MOVE_WHEEL */
+    int* frozen;            /**< number of freezes every snake is under, it moves at none of its sub-steps while above 0 */
+    int* boosts;            /**< speed-up of every snake, HIGHSPEEDs minus LOWSPEEDs still running */
+    timer_wheel effects;    /**< what wears off, at the step it does */
+    vector<move_intent> intents;    /**< moves of the current sub-step */
+    vector<cell_claim> claims;      /**< open addressing table of the squares heads go to at the current sub-step, see 'resolve()' */
+    unsigned int round;     /**< sub-steps 'world_move()' resolved, rolled back or not */
+    int nb_snakes;          /**< number of snakes in 'snakes' */
+    int nb_alive;           /**< number of snakes still alive */
+    int tick;               /**< number of steps played so far */
+    square last_item;       /**< item popped during the last step, -1 if none */
+    coord last_item_loc;    /**< where 'last_item' popped */
+};
+
+/**
+* \typedef world_snapshot
+* \brief State of a world at some step, to go back to it with 'world_restore()'.
+* \details Made for one world by 'new_world_snapshot()' : saving and restoring
+*          only copy into and from buffers allocated once. Only the chunks
+*          the field has its own of take room : a chunk gets a slot of
+*          'squares' the first time it is saved, and keeps it.
+*          In copy-on-write mode, the snapshot follows its world : a save or a
+*          restore only copies the chunks set since the previous save or restore,
+*          and marks every chunk as unchanged with 'field_clean()'. A world can
+*          only be followed by one such snapshot, and nothing else may clean its field.
+*/
+struct world_snapshot {
+    bool cow;                   /**< true in copy-on-write mode */
+    bool saved;                 /**< false until the first save */
+    int nb_chunks;              /**< chunks of the field, the ring included */
+    field_chunk** shared;       /**< for every chunk, the shared chunk it was, NULL if the field had its own */
+    int* slots;                 /**< for every chunk, its slot in 'squares', -1 until the field has its own */
+    unsigned char* squares;     /**< the squares of the chunks the field had its own of, a slot each */
+    int nb_slots;               /**< slots given so far */
+    int max_slots;              /**< slots 'squares' can hold before it grows */
+    item_index* items;          /**< where the items were */
+    int timestep;               /**< state of the field, besides its squares */
+    int speed;
+    unsigned int seed;
+    direction* dirs;            /**< state of the world, see 'world' */
+    int nb_alive;
+    int tick;
+    square last_item;
+    coord last_item_loc;
+    direction* snake_dirs;      /**< direction every snake is facing */
+    int* periods;               /**< pace of every snake, see 'world' */
+    int* next_moves;
+    int* frozen;
+    int* boosts;
+    timer_wheel effects;
+    bool* add_size;             /**< 'add_size' of every snake */
+    int* body_sizes;            /**< length of every snake */
+    vector<coord> bodies;       /**< body of every snake, one after the other, tail first */
+};
+
+// PROTOTYPES ==========================================================
+world* new_world(int width, int height, int timestep, int nb_snakes, session_arena* arena);
+void free_world(world* w);
+int world_step(world* w);
+int world_move(world* w);
+void world_items(world* w);
+void world_schedule(world* w);
+
+world_snapshot* new_world_snapshot(world* w, bool cow);
+void free_world_snapshot(world_snapshot* snap);
+void world_save(world* w, world_snapshot* snap);
+void world_restore(world* w, world_snapshot* snap);
+int world_diff(world* w, world_snapshot* snap, vector<coord>& out);
+
+#endif